@@ -27,8 +27,9 @@ namespace pumipic {
 
     using host_space = Kokkos::HostSpace;
     typedef Kokkos::TeamPolicy<execution_space> PolicyType;
-    typedef Kokkos::UnorderedMap<gid_t, lid_t, device_type> GID_Mapping;
+    typedef GidMapping<device_type> GID_Mapping;
     typedef CabM_Input<DataTypes, MemSpace> Input_T;
+    template <typename MSpace> using Mirror = CabM<DataTypes, MSpace>;
 
     //from https://github.com/SCOREC/Cabana/blob/53ad18a030f19e0956fd0cab77f62a9670f31941/core/src/CabanaM.hpp#L18-L19
     using CM_DT = PS_DTBool<DataTypes>;
@@ -47,6 +48,9 @@ namespace pumipic {
     CabM(CabM_Input<DataTypes, MemSpace>&);
     ~CabM();
 
+    template <class MSpace>
+    Mirror<MSpace>* copy();
+
     //Functions from ParticleStructure
     using ParticleStructure<DataTypes, MemSpace>::nElems;
     using ParticleStructure<DataTypes, MemSpace>::nPtcls;
@@ -60,15 +64,41 @@ namespace pumipic {
                  Distributor<MemSpace> dist = Distributor<MemSpace>(),
                  kkLidView new_particle_elements = kkLidView(),
                  MTVs new_particle_info = NULL);
+    void migrateBegin(MigrationHandle<DataTypes, MemSpace>& handle,
+                      kkLidView new_element, kkLidView new_process,
+                      Distributor<MemSpace> dist = Distributor<MemSpace>(),
+                      kkLidView new_particle_elements = kkLidView(),
+                      MTVs new_particle_info = NULL);
+    void migrateEnd(MigrationHandle<DataTypes, MemSpace>& handle);
 
     void rebuild(kkLidView new_element, kkLidView new_particle_elements = kkLidView(),
                  MTVs new_particles = NULL);
 
+    //Change whether or not to try shuffling
+    void setShuffling(bool newS) {tryShuffling = newS;}
+
+    /* Moves the particles changing elements and the new particles into the empty
+         slots of their new element's SoAs without copying the other particles
+       Returns false, leaving the structure unchanged, if an element does not have
+         enough empty slots
+       new_element - array sized capacity with the new element for each particle
+       new_particle_elements - the new element for each new particle
+       new_particles - the data for the new particles
+    */
+    bool reshuffle(kkLidView new_element, kkLidView new_particle_elements = kkLidView(),
+                   MTVs new_particles = NULL);
+
     template <typename FunctionType>
     void parallel_for(FunctionType& fn, std::string s="");
+    template <typename FunctionType, typename ReturnType>
+    void parallel_reduce(FunctionType& fn, ReturnType&& result, std::string s="");
 
     void printMetrics() const;
     void printFormat(const char* prefix) const;
+    //Copies the active particles into packed arrays, see ParticleStructure::packParticles
+    void packParticles(kkLidView particle_elements, MTVs particle_info);
+    //Groups the active particles by element from the offsets, see ps::groupByElement
+    void buildElementGroups(kkLidView& elm_offsets, kkLidView& ptcl_ids);
 
     // Do not call these functions:
     kkLidView buildOffset(const kkLidView particles_per_element, const lid_t num_ptcls, const double padding, lid_t &padding_start);
@@ -89,6 +119,8 @@ namespace pumipic {
     using ParticleStructure<DataTypes, MemSpace>::capacity_;
     using ParticleStructure<DataTypes, MemSpace>::num_rows;
     using ParticleStructure<DataTypes, MemSpace>::ptcl_data;
+    using ParticleStructure<DataTypes, MemSpace>::migration_buffers;
+    using ParticleStructure<DataTypes, MemSpace>::invalidateElementGroups;
     using ParticleStructure<DataTypes, MemSpace>::num_types;
 
     // mappings from row to element gid and back to row
@@ -108,7 +140,14 @@ namespace pumipic {
     AoSoA_t* aosoa_;
     // extra AoSoA copy for swapping (same size as aosoa_)
     AoSoA_t* aosoa_swap;
-    
+    // try to move particles into empty slots before a full rebuild
+    bool tryShuffling;
+
+    template <typename DT, typename MSpace> friend class CabM;
+    // constructor used by copy
+    CabM(lid_t team_size) : ParticleStructure<DataTypes, MemSpace>(PS_CABM),
+                            policy(PolicyType(1000, team_size)), aosoa_(NULL),
+                            aosoa_swap(NULL), tryShuffling(true) {}
   };
 
   /**
@@ -133,10 +172,10 @@ namespace pumipic {
                                    kkGidView element_gids,
                                    kkLidView particle_elements, // optional
                                    MTVs particle_info) :        // optional
-    ParticleStructure<DataTypes, MemSpace>(),
+    ParticleStructure<DataTypes, MemSpace>(PS_CABM),
     policy(p),
-    element_gid_to_lid(num_elements),
-    extra_padding(0.05) // default extra padding at 5%
+    extra_padding(0.05), // default extra padding at 5%
+    tryShuffling(true)
   {
     assert(num_elements == particles_per_element.size());
     num_elems = num_elements;
@@ -173,9 +212,9 @@ namespace pumipic {
 
   template<class DataTypes, typename MemSpace>
   CabM<DataTypes, MemSpace>::CabM(Input_T& input) :
-    ParticleStructure<DataTypes, MemSpace>(input.name),
+    ParticleStructure<DataTypes, MemSpace>(input.name, PS_CABM),
     policy(input.policy),
-    element_gid_to_lid(input.ne)
+    tryShuffling(true)
   {
     num_elems = input.ne;
     num_rows = num_elems;
@@ -215,6 +254,128 @@ namespace pumipic {
   template <class DataTypes, typename MemSpace>
   CabM<DataTypes, MemSpace>::~CabM() { delete aosoa_; }
 
+  /**
+   * Copy the structure to another memory space
+   *    The AoSoA, offsets and global id mapping are deep copied, the structure is
+   *    not reconstructed. If the SoA length differs between the memory spaces each
+   *    element keeps its slots and the particles are copied slot by slot.
+   * @return new CabM in memory space MSpace
+  */
+  template <class DataTypes, typename MemSpace>
+  template <class MSpace>
+  typename CabM<DataTypes, MemSpace>::template Mirror<MSpace>* CabM<DataTypes, MemSpace>::copy() {
+    typedef typename Mirror<MSpace>::AoSoA_t MirrorAoSoA;
+    typedef typename Mirror<MSpace>::kkLidView MirrorLidView;
+    typedef typename Mirror<MSpace>::execution_space MirrorExecSpace;
+    const auto team_size = maxChunk<MSpace>(policy.team_size());
+    Mirror<MSpace>* mirror_copy = new CabM<DataTypes, MSpace>(team_size);
+    mirror_copy->copySizes(this);
+    //Copy constants
+    mirror_copy->extra_padding = extra_padding;
+    mirror_copy->tryShuffling = tryShuffling;
+    //Deep copy the global ids
+    mirror_copy->element_to_gid = typename Mirror<MSpace>::kkGidView("mirror element_to_gid",
+                                                                     element_to_gid.size());
+    Kokkos::deep_copy(mirror_copy->element_to_gid, element_to_gid);
+    mirror_copy->element_gid_to_lid.copy(element_gid_to_lid);
+
+    const lid_t soa_len = AoSoA_t::vector_length;
+    const lid_t mirror_soa_len = MirrorAoSoA::vector_length;
+    if (soa_len == mirror_soa_len) {
+      //Same layout, copy the offsets, parent elements and AoSoA as is
+      mirror_copy->num_soa_ = num_soa_;
+      mirror_copy->padding_start = padding_start;
+      mirror_copy->offsets = MirrorLidView("mirror offsets", offsets.size());
+      Kokkos::deep_copy(mirror_copy->offsets, offsets);
+      mirror_copy->parentElms_ = MirrorLidView("mirror parentElms", parentElms_.size());
+      Kokkos::deep_copy(mirror_copy->parentElms_, parentElms_);
+      mirror_copy->aosoa_ = mirror_copy->makeAoSoA(capacity_, num_soa_);
+      Cabana::deep_copy(*(mirror_copy->aosoa_), *aosoa_);
+    }
+    else {
+      //Give each element enough SoAs to hold its slots
+      kkLidHostMirror offsets_h = deviceToHost(offsets);
+      Kokkos::View<lid_t*, host_space> mirror_offsets_h("mirror_offsets_host", offsets_h.size());
+      mirror_offsets_h(0) = 0;
+      for (lid_t i = 0; i < num_elems; ++i) {
+        const lid_t slots = (offsets_h(i+1) - offsets_h(i)) * soa_len;
+        mirror_offsets_h(i+1) = mirror_offsets_h(i) + (slots + mirror_soa_len - 1) / mirror_soa_len;
+      }
+      mirror_copy->padding_start = 0;
+      if (num_elems > 0) {
+        const lid_t last = num_elems - 1;
+        const lid_t slots = (padding_start - offsets_h(last)) * soa_len;
+        mirror_copy->padding_start = mirror_offsets_h(last) +
+          (slots + mirror_soa_len - 1) / mirror_soa_len;
+      }
+      const lid_t mirror_num_soa = mirror_offsets_h(num_elems);
+      mirror_copy->num_soa_ = mirror_num_soa;
+      mirror_copy->capacity_ = mirror_num_soa * mirror_soa_len;
+      mirror_copy->offsets = MirrorLidView("mirror offsets", offsets.size());
+      Kokkos::deep_copy(mirror_copy->offsets, mirror_offsets_h);
+      mirror_copy->parentElms_ = mirror_copy->getParentElms(num_elems, mirror_num_soa,
+                                                            mirror_copy->offsets);
+      mirror_copy->aosoa_ = mirror_copy->makeAoSoA(mirror_copy->capacity_, mirror_num_soa);
+
+      //Bring the AoSoA and offsets to the new memory space in the current layout
+      auto aosoa_mirror = Cabana::create_mirror_view_and_copy(MSpace(), *aosoa_);
+      MirrorLidView offsets_mirror("offsets_mirror", offsets.size());
+      Kokkos::deep_copy(offsets_mirror, offsets);
+      //Copy each particle to the same slot of its element in the new layout
+      MirrorAoSoA dst = *(mirror_copy->aosoa_);
+      MirrorLidView dst_offsets = mirror_copy->offsets;
+      MirrorLidView dst_parents = mirror_copy->parentElms_;
+      const auto activeSliceIdx = MirrorAoSoA::number_of_members-1;
+      auto dst_active = Cabana::slice<activeSliceIdx>(dst);
+      Kokkos::parallel_for("cabm_copy_relayout",
+                           Kokkos::RangePolicy<MirrorExecSpace>(0, mirror_copy->capacity_),
+                           KOKKOS_LAMBDA(const lid_t& i) {
+        const lid_t soa = i / mirror_soa_len;
+        const lid_t elm = dst_parents(soa);
+        const lid_t slot = (soa - dst_offsets(elm)) * mirror_soa_len + i % mirror_soa_len;
+        const lid_t num_slots = (offsets_mirror(elm+1) - offsets_mirror(elm)) * soa_len;
+        if (slot < num_slots)
+          dst.setTuple(i, aosoa_mirror.getTuple(offsets_mirror(elm) * soa_len + slot));
+        else
+          dst_active(i) = false;
+      });
+    }
+    mirror_copy->aosoa_swap = mirror_copy->makeAoSoA(mirror_copy->capacity_, mirror_copy->num_soa_);
+    return mirror_copy;
+  }
+
+  template <class DataTypes, typename MemSpace>
+  void CabM<DataTypes, MemSpace>::packParticles(kkLidView particle_elements,
+                                                MTVs particle_info) {
+    kkLidView ptcl_index("ptcl_index", capacity_ + 1);
+    packParticleIndices(this, ptcl_index, particle_elements);
+    //Copy every active particle, ps_to_array never matches the rank
+    kkLidView ps_to_array("ps_to_array", capacity_);
+    Kokkos::deep_copy(ps_to_array, -1);
+    CopyParticlesToSendFromAoSoA<CabM<DataTypes, MemSpace>, DataTypes>(this, particle_info,
+                                                                       *aosoa_, ps_to_array,
+                                                                       ptcl_index);
+  }
+
+  template <class DataTypes, typename MemSpace>
+  void CabM<DataTypes, MemSpace>::buildElementGroups(kkLidView& elm_offsets,
+                                                     kkLidView& ptcl_ids) {
+    //The SoAs of each element are contiguous between its offsets
+    const auto soa_len = AoSoA_t::vector_length;
+    const auto activeSliceIdx = aosoa_->number_of_members-1;
+    const auto mask = Cabana::slice<activeSliceIdx>(*aosoa_);
+    kkLidView offsets_cpy = offsets;
+    kkLidView slot_offsets(Kokkos::ViewAllocateWithoutInitializing("slot_offsets"),
+                           num_elems + 1);
+    Kokkos::parallel_for("group_slot_offsets", num_elems + 1, KOKKOS_LAMBDA(const lid_t& e) {
+      slot_offsets(e) = offsets_cpy(e) * soa_len;
+    });
+    auto slotPtcl = KOKKOS_LAMBDA(const lid_t& slot) -> lid_t {
+      return mask.access(slot / soa_len, slot % soa_len) ? slot : -1;
+    };
+    packElementGroups(num_elems, slot_offsets, slotPtcl, elm_offsets, ptcl_ids);
+  }
+
   /**
    * a parallel for-loop that iterates through all particles
    * @param[in] fn function of the form fn(elm, particle_id, mask), where
@@ -250,6 +411,46 @@ namespace pumipic {
       }, "parallel_for");
   }
 
+  /**
+   * a parallel reduction over all active particles
+   * @param[in] fn function of the form fn(elm, particle_id, update), where
+   *    elm is the element the particle is in
+   *    particle_id is the overall index of the particle in the structure
+   *    update is the partial result to add the particle's contribution to
+   * @param[in,out] result scalar or Kokkos reducer receiving the result
+   * @param[in] s string for labelling purposes
+  */
+  template <class DataTypes, typename MemSpace>
+  template <typename FunctionType, typename ReturnType>
+  void CabM<DataTypes, MemSpace>::parallel_reduce(FunctionType& fn, ReturnType&& result,
+                                                  std::string s) {
+    typedef typename ReduceValueType<typename std::decay<ReturnType>::type>::type ValueType;
+    // move function pointer to GPU (if needed)
+    FunctionType* fn_d;
+    #ifdef PP_USE_CUDA
+        cudaMalloc(&fn_d, sizeof(FunctionType));
+        cudaMemcpy(fn_d,&fn, sizeof(FunctionType), cudaMemcpyHostToDevice);
+    #else
+        fn_d = &fn;
+    #endif
+    kkLidView parentElms_cpy = parentElms_;
+    const auto soa_len = AoSoA_t::vector_length;
+    const auto activeSliceIdx = aosoa_->number_of_members-1;
+    const auto mask = Cabana::slice<activeSliceIdx>(*aosoa_); // get active mask
+    Kokkos::parallel_reduce(s, Kokkos::RangePolicy<execution_space>(0, capacity_),
+      KOKKOS_LAMBDA(const lid_t& particle_id, ValueType& update) {
+        const lid_t soa = particle_id / soa_len;
+        const lid_t ptcl = particle_id % soa_len;
+        if (mask.access(soa,ptcl)) {
+          const lid_t elm = parentElms_cpy(soa); // calculate element
+          (*fn_d)(elm, particle_id, update);
+        }
+      }, std::forward<ReturnType>(result));
+    #ifdef PP_USE_CUDA
+        cudaFree(fn_d);
+    #endif
+  }
+
   template <class DataTypes, typename MemSpace>
   void CabM<DataTypes, MemSpace>::printMetrics() const {
     // Sum number of empty cells
@@ -387,7 +588,8 @@ namespace pumipic {
 
     using host_space = Kokkos::HostSpace;
     typedef Kokkos::TeamPolicy<execution_space> PolicyType;
-    typedef Kokkos::UnorderedMap<gid_t, lid_t, device_type> GID_Mapping;
+    typedef GidMapping<device_type> GID_Mapping;
+    template <typename MSpace> using Mirror = CabM<DataTypes, MSpace>;
 
     CabM() = delete;
     CabM(const CabM&) = delete;
@@ -398,9 +600,13 @@ namespace pumipic {
           kkLidView particles_per_element,
           kkGidView element_gids,
           kkLidView particle_elements = kkLidView(),
-          MTVs particle_info = NULL) {reportError();}
+          MTVs particle_info = NULL) :
+      ParticleStructure<DataTypes, MemSpace>(PS_CABM) {reportError();}
     ~CabM() {}
 
+    template <class MSpace>
+    Mirror<MSpace>* copy() {reportError(); return NULL;}
+
     //Functions from ParticleStructure
     using ParticleStructure<DataTypes, MemSpace>::nElems;
     using ParticleStructure<DataTypes, MemSpace>::nPtcls;
@@ -414,15 +620,29 @@ namespace pumipic {
                  Distributor<MemSpace> dist = Distributor<MemSpace>(),
                  kkLidView new_particle_elements = kkLidView(),
                  MTVs new_particle_info = NULL) {reportError();}
+    void migrateBegin(MigrationHandle<DataTypes, MemSpace>& handle,
+                      kkLidView new_element, kkLidView new_process,
+                      Distributor<MemSpace> dist = Distributor<MemSpace>(),
+                      kkLidView new_particle_elements = kkLidView(),
+                      MTVs new_particle_info = NULL) {reportError();}
+    void migrateEnd(MigrationHandle<DataTypes, MemSpace>& handle) {reportError();}
 
     void rebuild(kkLidView new_element, kkLidView new_particle_elements = kkLidView(),
                  MTVs new_particles = NULL) {reportError();}
 
+    void setShuffling(bool newS) {reportError();}
+    bool reshuffle(kkLidView new_element, kkLidView new_particle_elements = kkLidView(),
+                   MTVs new_particles = NULL) {reportError(); return false;}
+
     template <typename FunctionType>
     void parallel_for(FunctionType& fn, std::string s="") {reportError();}
+    template <typename FunctionType, typename ReturnType>
+    void parallel_reduce(FunctionType& fn, ReturnType&& result, std::string s="") {reportError();}
 
     void printMetrics() const {reportError();}
     void printFormat(const char* prefix) const {reportError();}
+    void packParticles(kkLidView particle_elements, MTVs particle_info) {reportError();}
+    void buildElementGroups(kkLidView& elm_offsets, kkLidView& ptcl_ids) {reportError();}
 
   private:
     void reportError() const {fprintf(stderr, "[ERROR] pumi-pic was built "
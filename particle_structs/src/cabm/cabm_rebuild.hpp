@@ -2,9 +2,126 @@
 #include <ppTiming.hpp>
 
 namespace pumipic {
+  /**
+   * Move the particles changing elements and the new particles into the empty
+   *     slots of the SoAs of their new element. The particles that stay are not copied.
+   *     Delete particles with new_element(ptcl) < 0
+   * @param[in] new_element view of ints with new elements for each particle
+   * @param[in] new_particle_elements view of ints, representing which elements
+   *    particle reside in
+   * @param[in] new_particles array of views filled with particle data
+   * @return false if an element does not have enough empty slots, the structure is unchanged
+  */
+  template <class DataTypes, typename MemSpace>
+  bool CabM<DataTypes, MemSpace>::reshuffle(kkLidView new_element,
+                                           kkLidView new_particle_elements,
+                                           MTVs new_particles) {
+    invalidateElementGroups();
+    const lid_t num_new_ptcls = new_particle_elements.size();
+    const auto soa_len = AoSoA_t::vector_length;
+    const auto activeSliceIdx = aosoa_->number_of_members-1;
+    auto active = Cabana::slice<activeSliceIdx>(*aosoa_);
+
+    // count the particles arriving in and the empty slots of each element
+    kkLidView arrivals_d("arrivals_d", num_elems + 1);
+    kkLidView holes_d("holes_d", num_elems);
+    kkLidView num_removed_d("num_removed_d", 1);
+    auto countArrivals = PS_LAMBDA(const lid_t& elm, const lid_t& ptcl, const bool& mask) {
+      const lid_t new_elm = new_element(ptcl);
+      if (mask && new_elm > -1 && new_elm != elm)
+        Kokkos::atomic_increment<lid_t>(&arrivals_d(new_elm));
+      if (!mask || new_elm < 0)
+        Kokkos::atomic_increment<lid_t>(&holes_d(elm));
+      if (mask && new_elm < 0)
+        Kokkos::atomic_increment<lid_t>(&num_removed_d(0));
+    };
+    parallel_for(countArrivals, "countArrivals");
+    Kokkos::parallel_for("count_new_ptcls", num_new_ptcls, KOKKOS_LAMBDA(const lid_t& i) {
+      Kokkos::atomic_increment<lid_t>(&arrivals_d(new_particle_elements(i)));
+    });
+
+    // check if the particles fit in the current SoAs
+    kkLidView fail("fail", 1);
+    Kokkos::parallel_for("check_holes", num_elems, KOKKOS_LAMBDA(const lid_t& i) {
+      if (arrivals_d(i) > holes_d(i))
+        fail(0) = 1;
+    });
+    if (getLastValue<lid_t>(fail))
+      return false;
+    const lid_t num_removed = getLastValue<lid_t>(num_removed_d);
+
+    // offset the arriving particles by element
+    kkLidView offset_arrivals("offset_arrivals", num_elems + 1);
+    kkLidView counting_offset("counting_offset", num_elems + 1);
+    exclusive_scan(arrivals_d, offset_arrivals);
+    Kokkos::deep_copy(counting_offset, offset_arrivals);
+    const lid_t num_moving = getLastValue<lid_t>(offset_arrivals);
+
+    // gather the moving particles followed by the new particles of each element
+    kkLidView moving_ptcls(Kokkos::ViewAllocateWithoutInitializing("moving_ptcls"), num_moving);
+    kkLidView from_ps(Kokkos::ViewAllocateWithoutInitializing("from_ps"), num_moving);
+    auto gatherMoving = PS_LAMBDA(const lid_t& elm, const lid_t& ptcl, const bool& mask) {
+      const lid_t new_elm = new_element(ptcl);
+      if (mask && new_elm > -1 && new_elm != elm) {
+        const lid_t index = Kokkos::atomic_fetch_add(&counting_offset(new_elm), 1);
+        moving_ptcls(index) = ptcl;
+        from_ps(index) = 1;
+      }
+    };
+    parallel_for(gatherMoving, "gatherMoving");
+    Kokkos::parallel_for("gather_new_ptcls", num_new_ptcls, KOKKOS_LAMBDA(const lid_t& i) {
+      const lid_t index = Kokkos::atomic_fetch_add(&counting_offset(new_particle_elements(i)), 1);
+      moving_ptcls(index) = i;
+      from_ps(index) = 0;
+    });
+
+    // remove the deleted particles and assign an empty slot to each arriving particle
+    kkLidView holes(Kokkos::ViewAllocateWithoutInitializing("holes"), num_moving);
+    auto assignHoles = PS_LAMBDA(const lid_t& elm, const lid_t& ptcl, const bool& mask) {
+      const lid_t new_elm = new_element(ptcl);
+      if (!mask || new_elm < 0) {
+        active(ptcl) = false;
+        const lid_t index = Kokkos::atomic_fetch_add(&offset_arrivals(elm), 1);
+        if (index < counting_offset(elm))
+          holes(index) = ptcl;
+      }
+    };
+    parallel_for(assignHoles, "assignHoles");
+
+    // move the particles into their slots
+    kkLidView soa_indices(Kokkos::ViewAllocateWithoutInitializing("soa_indices"), num_new_ptcls);
+    kkLidView soa_ptcl_indices(Kokkos::ViewAllocateWithoutInitializing("soa_ptcl_indices"), num_new_ptcls);
+    AoSoA_t aosoa_copy = *aosoa_; // copy of member variable aosoa_ (necessary, Kokkos doesn't like member variables)
+    Kokkos::parallel_for("move_ptcls", num_moving, KOKKOS_LAMBDA(const lid_t& i) {
+      const lid_t src = moving_ptcls(i);
+      const lid_t dst = holes(i);
+      const lid_t destSoa = dst/soa_len;
+      const lid_t destTuple = dst%soa_len;
+      if (from_ps(i)) {
+        Cabana::Impl::tupleCopy(
+          aosoa_copy.access(destSoa), destTuple, // dest
+          aosoa_copy.access(src/soa_len), src%soa_len); // src
+        active(src) = false;
+      }
+      else {
+        soa_indices(src) = destSoa;
+        soa_ptcl_indices(src) = destTuple;
+      }
+      active(dst) = true;
+    });
+    if (num_new_ptcls > 0 && new_particles != NULL) {
+      CopyMTVsToAoSoA<CabM<DataTypes, MemSpace>, DataTypes>(*aosoa_, new_particles,
+        soa_indices, soa_ptcl_indices); // copy data over
+    }
+
+    num_ptcls = num_ptcls - num_removed + num_new_ptcls;
+    return true;
+  }
+
   /**
    * Fully rebuild the AoSoA with these new parent SoAs and particles
    *     by copying into a new AoSoA and overwriting the old one.
+   *     Tries reshuffle first unless shuffling is turned off with setShuffling(false)
    *     Delete particles with new_element(ptcl) < 0
    * @param[in] new_element view of ints with new elements for each particle
    * @param[in] new_particle_elements view of ints, representing which elements
@@ -23,6 +140,14 @@ namespace pumipic {
 
     Kokkos::Profiling::pushRegion("CabM Rebuild");
     Kokkos::Timer overall_timer; // timer for rebuild
+    invalidateElementGroups();
+
+    // try moving the particles into the empty slots of their new elements first
+    if (tryShuffling && reshuffle(new_element, new_particle_elements, new_particles)) {
+      RecordTime("CabM rebuild", overall_timer.seconds(), btime);
+      Kokkos::Profiling::popRegion();
+      return;
+    }
 
     const auto num_new_ptcls = new_particle_elements.size();
     const auto soa_len = AoSoA_t::vector_length;
@@ -25,9 +25,10 @@ namespace pumipic {
     using typename ParticleStructure<DataTypes, MemSpace>::MTVs;
 
     typedef Kokkos::TeamPolicy<execution_space> PolicyType;
-    typedef Kokkos::UnorderedMap<gid_t, lid_t, device_type> GID_Mapping;
+    typedef GidMapping<device_type> GID_Mapping;
 
     typedef CSR_Input<DataTypes,MemSpace> Input_T;
+    template <typename MSpace> using Mirror = CSR<DataTypes, MSpace>;
 
     CSR() = delete;
     CSR(const CSR&) = delete;
@@ -42,6 +43,9 @@ namespace pumipic {
     CSR(Input_T& input);
     ~CSR();
 
+    template <class MSpace>
+    Mirror<MSpace>* copy();
+
     //Functions from ParticleStructure
     using ParticleStructure<DataTypes, MemSpace>::nElems;
     using ParticleStructure<DataTypes, MemSpace>::nPtcls;
@@ -53,17 +57,51 @@ namespace pumipic {
                  Distributor<MemSpace> dist = Distributor<MemSpace>(),
                  kkLidView new_particle_elements = kkLidView(),
                  MTVs new_particle_info = NULL);
+    void migrateBegin(MigrationHandle<DataTypes, MemSpace>& handle,
+                      kkLidView new_element, kkLidView new_process,
+                      Distributor<MemSpace> dist = Distributor<MemSpace>(),
+                      kkLidView new_particle_elements = kkLidView(),
+                      MTVs new_particle_info = NULL);
+    void migrateEnd(MigrationHandle<DataTypes, MemSpace>& handle);
 
     void rebuild(kkLidView new_element, kkLidView new_particle_elements = kkLidView(),
                  MTVs new_particles = NULL);
 
+    //Change whether or not to try shuffling
+    void setShuffling(bool newS) {tryShuffling = newS;}
+
+    /* Moves the particles changing elements and the new particles into the empty
+         slots of their new element without copying the other particles
+       Returns false, leaving the structure unchanged, if an element does not have
+         enough empty slots
+       new_element - array sized capacity with the new element for each particle
+       new_particle_elements - the new element for each new particle
+       new_particles - the data for the new particles
+    */
+    bool reshuffle(kkLidView new_element, kkLidView new_particle_elements = kkLidView(),
+                   MTVs new_particles = NULL);
+
     template <typename FunctionType>
     void parallel_for(FunctionType& fn, std::string name="");
+    template <typename FunctionType, typename ReturnType>
+    void parallel_reduce(FunctionType& fn, ReturnType&& result, std::string name="");
 
     void printMetrics() const;
     void printFormat(const char* prefix) const;
+    //Copies the active particles into packed arrays, see ParticleStructure::packParticles
+    void packParticles(kkLidView particle_elements, MTVs particle_info);
+    //Groups the active particles by element from the offsets, see ps::groupByElement
+    void buildElementGroups(kkLidView& elm_offsets, kkLidView& ptcl_ids);
+
+    //Change the execution strategy of parallel_for, CSR_LOOP_AUTO chooses on the next rebuild
+    void setLoopStrategy(CSRLoopStrategy strategy);
+    //Returns true if parallel_for runs over a flat range of particles
+    bool flatLoops() const {return flat_loops;}
 
     // Do not call these functions:
+    void chooseLoopStrategy(kkLidView ptcls_per_elem);
+    kkLidView buildOffsets(kkLidView ptcls_per_elem);
+    void setMask(kkLidView ptcls_per_elem);
     void createGlobalMapping(kkGidView element_gids, kkGidView& lid_to_gid, GID_Mapping& gid_to_lid);
     void initCsrData(kkLidView particle_elements, MTVs particle_info);
 
@@ -77,13 +115,17 @@ namespace pumipic {
     using ParticleStructure<DataTypes, MemSpace>::capacity_;
     using ParticleStructure<DataTypes, MemSpace>::num_rows;
     using ParticleStructure<DataTypes, MemSpace>::ptcl_data;
+    using ParticleStructure<DataTypes, MemSpace>::migration_buffers;
+    using ParticleStructure<DataTypes, MemSpace>::invalidateElementGroups;
     using ParticleStructure<DataTypes, MemSpace>::num_types;
 
     // Data types for keeping track of global IDs
     kkGidView element_to_gid;
     GID_Mapping element_gid_to_lid;
-    // Offsets array into CSR
+    // Offsets array into CSR, element e owns the slots [offsets(e), offsets(e+1))
     kkLidView offsets;
+    //particle_mask true means there is a particle at this slot, false otherwise
+    Kokkos::View<bool*, device_type> particle_mask;
 
     //Swap memory
     MTVs ptcl_data_swap;
@@ -99,6 +141,17 @@ namespace pumipic {
     bool always_realloc;
     double minimize_size;
     double padding_amount;
+    double elem_padding;
+    bool tryShuffling;
+
+    //Execution strategy of parallel_for and the current choice
+    CSRLoopStrategy loop_strategy;
+    bool flat_loops;
+
+    template <typename DT, typename MSpace> friend class CSR;
+    //Constructor used by copy
+    CSR(lid_t team_size) : ParticleStructure<DataTypes, MemSpace>(PS_CSR),
+                           policy(PolicyType(1000, team_size)) {}
   };
 
   /**
@@ -123,9 +176,8 @@ namespace pumipic {
                                 kkGidView element_gids,      // optional
                                 kkLidView particle_elements, // optional
                                 MTVs particle_info) :        // optional
-      ParticleStructure<DataTypes, MemSpace>(),
-      policy(p),
-      element_gid_to_lid(num_elements)
+      ParticleStructure<DataTypes, MemSpace>(PS_CSR),
+      policy(p)
   {
     num_elems = num_elements;
     num_rows  = num_elems;
@@ -134,14 +186,16 @@ namespace pumipic {
     always_realloc = false;
     minimize_size = 0.8;
     padding_amount = 1.05;
+    elem_padding = 0.1;
+    tryShuffling = true;
+    loop_strategy = CSR_LOOP_AUTO;
 
     construct(particles_per_element,element_gids,particle_elements,particle_info);
   }
 
   template <class DataTypes, typename MemSpace>
   CSR<DataTypes, MemSpace>::CSR(Input_T& input):
-    ParticleStructure<DataTypes,MemSpace>(input.name),policy(input.policy),
-    element_gid_to_lid(input.ne) {
+    ParticleStructure<DataTypes,MemSpace>(input.name, PS_CSR),policy(input.policy) {
 
     num_elems = input.ne;
     num_ptcls = input.np;
@@ -150,6 +204,9 @@ namespace pumipic {
     padding_amount = input.padding_amount;
     always_realloc = input.always_realloc;
     minimize_size = input.minimize_size;
+    elem_padding = input.elem_padding;
+    tryShuffling = true;
+    loop_strategy = input.loop_strategy;
 
     construct(input.ppe, input.e_gids, input.particle_elems, input.p_info);
 
@@ -162,8 +219,99 @@ namespace pumipic {
     destroyViews<DataTypes, memory_space>(ptcl_data_swap);
   }
 
+  /**
+   * Copy the structure to another memory space
+   *    The particle data, offsets and global id mapping are deep copied,
+   *    the structure is not reconstructed.
+   * @return new CSR in memory space MSpace
+  */
+  template <class DataTypes, typename MemSpace>
+  template <class MSpace>
+  typename CSR<DataTypes, MemSpace>::template Mirror<MSpace>* CSR<DataTypes, MemSpace>::copy() {
+    const auto team_size = maxChunk<MSpace>(policy.team_size());
+    Mirror<MSpace>* mirror_copy = new CSR<DataTypes, MSpace>(team_size);
+    //Call Particle structures copy
+    mirror_copy->copy(this);
+    //Copy constants
+    mirror_copy->swap_capacity_ = swap_capacity_;
+    mirror_copy->always_realloc = always_realloc;
+    mirror_copy->minimize_size = minimize_size;
+    mirror_copy->padding_amount = padding_amount;
+    mirror_copy->elem_padding = elem_padding;
+    mirror_copy->tryShuffling = tryShuffling;
+    mirror_copy->loop_strategy = loop_strategy;
+    mirror_copy->flat_loops = flat_loops;
+
+    //Create the swap space
+    mirror_copy->ptcl_data_swap = createMemberViews<DataTypes, MSpace>(swap_capacity_);
+    //Deep copy each view
+    mirror_copy->offsets = typename Mirror<MSpace>::kkLidView("mirror offsets", offsets.size());
+    Kokkos::deep_copy(mirror_copy->offsets, offsets);
+    mirror_copy->particle_mask = Kokkos::View<bool*, typename MSpace::device_type>(
+      "mirror particle_mask", particle_mask.size());
+    Kokkos::deep_copy(mirror_copy->particle_mask, particle_mask);
+    mirror_copy->element_to_gid = typename Mirror<MSpace>::kkGidView("mirror element_to_gid",
+                                                                     element_to_gid.size());
+    Kokkos::deep_copy(mirror_copy->element_to_gid, element_to_gid);
+    //Deep copy the gid mapping
+    mirror_copy->element_gid_to_lid.copy(element_gid_to_lid);
+    return mirror_copy;
+  }
+
+  template <class DataTypes, typename MemSpace>
+  void CSR<DataTypes, MemSpace>::packParticles(kkLidView particle_elements,
+                                               MTVs particle_info) {
+    kkLidView ptcl_index("ptcl_index", capacity_ + 1);
+    packParticleIndices(this, ptcl_index, particle_elements);
+    //Copy every active particle, ps_to_array never matches the rank
+    kkLidView ps_to_array("ps_to_array", capacity_);
+    Kokkos::deep_copy(ps_to_array, -1);
+    CopyParticlesToSend<CSR<DataTypes, MemSpace>, DataTypes>(this, particle_info, ptcl_data,
+                                                             ps_to_array, ptcl_index);
+  }
+
+  template <class DataTypes, typename MemSpace>
+  void CSR<DataTypes, MemSpace>::buildElementGroups(kkLidView& elm_offsets,
+                                                    kkLidView& ptcl_ids) {
+    //The slots of each element are contiguous between its offsets
+    auto mask_cpy = particle_mask;
+    auto slotPtcl = KOKKOS_LAMBDA(const lid_t& slot) -> lid_t {
+      return mask_cpy(slot) ? slot : -1;
+    };
+    packElementGroups(num_elems, offsets, slotPtcl, elm_offsets, ptcl_ids);
+  }
+
+  template <class DataTypes, typename MemSpace>
+  void CSR<DataTypes, MemSpace>::setLoopStrategy(CSRLoopStrategy strategy) {
+    loop_strategy = strategy;
+    if (loop_strategy != CSR_LOOP_AUTO)
+      flat_loops = loop_strategy == CSR_LOOP_FLAT;
+  }
+
+  /**
+   * Chooses the execution strategy of parallel_for from the particles per element
+   *    Teams idle on elements with fewer particles than the team size and straggle
+   *    on elements with many more particles than the average, so skewed or sparse
+   *    distributions use the flat range over the particles.
+   * @param[in] ptcls_per_elem view of the number of particles in each element
+  */
+  template <class DataTypes, typename MemSpace>
+  void CSR<DataTypes, MemSpace>::chooseLoopStrategy(kkLidView ptcls_per_elem) {
+    if (loop_strategy != CSR_LOOP_AUTO) {
+      flat_loops = loop_strategy == CSR_LOOP_FLAT;
+      return;
+    }
+    const double max_skew = 4;
+    const double max_empty_fraction = 0.5;
+    const DistributionStats stats =
+      distributionStats(Kokkos::subview(ptcls_per_elem, std::make_pair(0, num_elems)));
+    flat_loops = stats.skew > max_skew || stats.empty_fraction > max_empty_fraction ||
+                 stats.avg_ppe < policy.team_size();
+  }
+
   /**
    * a parallel for-loop that iterates through all particles
+   *    Runs one team per element or a flat range over the particles (see flatLoops)
    * @param[in] fn function of the form fn(elm, particle_id, mask), where
    *    elm is the element the particle is in
    *    particle_id is the overall index of the particle in the structure
@@ -182,11 +330,27 @@ namespace pumipic {
 #else
     fn_d = &fn;
 #endif
+    auto offsets_cpy = offsets;
+    auto mask_cpy = particle_mask;
+    if (flat_loops) {
+      //Each slot of an element finds its element in the offsets
+      const lid_t num_elems_cpy = num_elems;
+      Kokkos::parallel_for(name, Kokkos::RangePolicy<execution_space>(0, capacity_),
+          KOKKOS_LAMBDA(const lid_t& particle_id) {
+          if (particle_id >= offsets_cpy(num_elems_cpy))
+            return;
+          const lid_t elm = findSegment(offsets_cpy, num_elems_cpy, particle_id);
+          bool mask = mask_cpy(particle_id);
+          (*fn_d)(elm, particle_id, mask);
+      });
+#ifdef PP_USE_CUDA
+      cudaFree(fn_d);
+#endif
+      return;
+    }
     const lid_t league_size = num_elems;
     const lid_t team_size = policy.team_size();
     const PolicyType policy(league_size, team_size);
-    auto offsets_cpy = offsets;
-    lid_t num_ptcls_cpy = num_ptcls;
     Kokkos::parallel_for(name, policy,
         KOKKOS_LAMBDA(const typename PolicyType::member_type& thread) {
         const lid_t elm = thread.league_rank();
@@ -195,9 +359,7 @@ namespace pumipic {
         const lid_t numPtcls = end-start;
         Kokkos::parallel_for(Kokkos::TeamThreadRange(thread, numPtcls), [=] (lid_t& j) {
           const lid_t particle_id = start+j;
-          bool mask = true;
-          if (particle_id > num_ptcls_cpy)
-            mask = false;
+          bool mask = mask_cpy(particle_id);
           (*fn_d)(elm, particle_id, mask);
         });
     });
@@ -206,6 +368,43 @@ namespace pumipic {
 #endif
   }
 
+  /**
+   * a parallel reduction over all active particles
+   * @param[in] fn function of the form fn(elm, particle_id, update), where
+   *    elm is the element the particle is in
+   *    particle_id is the overall index of the particle in the structure
+   *    update is the partial result to add the particle's contribution to
+   * @param[in,out] result scalar or Kokkos reducer receiving the result
+   * @param[in] s string for labelling purposes
+  */
+  template <class DataTypes, typename MemSpace>
+  template <typename FunctionType, typename ReturnType>
+  void CSR<DataTypes, MemSpace>::parallel_reduce(FunctionType& fn, ReturnType&& result,
+                                                 std::string name) {
+    typedef typename ReduceValueType<typename std::decay<ReturnType>::type>::type ValueType;
+    FunctionType* fn_d;
+#ifdef PP_USE_CUDA
+    cudaMalloc(&fn_d, sizeof(FunctionType));
+    cudaMemcpy(fn_d,&fn, sizeof(FunctionType), cudaMemcpyHostToDevice);
+#else
+    fn_d = &fn;
+#endif
+    //Each active slot finds its element in the offsets
+    auto offsets_cpy = offsets;
+    auto mask_cpy = particle_mask;
+    const lid_t num_elems_cpy = num_elems;
+    Kokkos::parallel_reduce(name, Kokkos::RangePolicy<execution_space>(0, capacity_),
+        KOKKOS_LAMBDA(const lid_t& particle_id, ValueType& update) {
+        if (mask_cpy(particle_id)) {
+          const lid_t elm = findSegment(offsets_cpy, num_elems_cpy, particle_id);
+          (*fn_d)(elm, particle_id, update);
+        }
+    }, std::forward<ReturnType>(result));
+#ifdef PP_USE_CUDA
+    cudaFree(fn_d);
+#endif
+  }
+
   template <class DataTypes, typename MemSpace>
   void CSR<DataTypes, MemSpace>::printMetrics() const {
     int comm_rank;
@@ -227,6 +426,7 @@ namespace pumipic {
   void CSR<DataTypes, MemSpace>::printFormat(const char* prefix) const {
     kkGidHostMirror element_to_gid_host = deviceToHost(element_to_gid);
     kkLidHostMirror offsets_host = deviceToHost(offsets);
+    auto mask_host = Kokkos::create_mirror_view_and_copy(Kokkos::HostSpace(), particle_mask);
 
     std::stringstream ss;
     char buffer[1000];
@@ -249,7 +449,7 @@ namespace pumipic {
         ss << buffer;
 
         for (int j = offsets_host[i-1]; j < offsets_host[i]; j++) {
-          num_chars = sprintf(ptr," 1");
+          num_chars = sprintf(ptr," %d", mask_host(j) ? 1 : 0);
           buffer[num_chars] = '\0';
           ss << buffer;
         }
@@ -6,7 +6,7 @@ namespace pumipic {
    * helper function: copies element_gids and creates a map for converting in the opposite direction
    * @param[in] element_gids view of global ids for each element
    * @param[out] lid_to_gid view to copy elmGid to
-   * @param[out] gid_to_lid unordered map with elements global ids as keys and local ids as values
+   * @param[out] gid_to_lid mapping from element global ids to local ids
   */
   template<class DataTypes, typename MemSpace>
   void CSR<DataTypes, MemSpace>::createGlobalMapping(kkGidView element_gids, kkGidView& lid_to_gid, GID_Mapping& gid_to_lid) {
@@ -14,8 +14,8 @@ namespace pumipic {
     Kokkos::parallel_for(num_elems, KOKKOS_LAMBDA(const lid_t& i) {
       const gid_t gid = element_gids(i);
       lid_to_gid(i) = gid;
-      gid_to_lid.insert(gid, i);
     });
+    gid_to_lid.build(element_gids, num_elems);
   }
 
   /**
@@ -42,15 +42,65 @@ namespace pumipic {
 
     // atomic_fetch_add to increment from the beginning of each element
     // when filling (offset[element] is start of element)
-    auto fill_ptcl_indices = PS_LAMBDA(const lid_t& elm_id, const lid_t& ptcl_id, bool& mask){
+    Kokkos::parallel_for("fill_ptcl_indices", num_ptcls, KOKKOS_LAMBDA(const lid_t& ptcl_id) {
       particle_indices(ptcl_id) = Kokkos::atomic_fetch_add(&row_indices(particle_elements(ptcl_id)),1);
-    };
-    parallel_for(fill_ptcl_indices);
+    });
 
     // populate ptcl_data with input data and particle_indices mapping
     CopyViewsToViews<kkLidView, DataTypes>(ptcl_data, particle_info, particle_indices);
   }
 
+  /**
+   * helper function: offsets of the slots of each element
+   *    Each element gets elem_padding*ppe (rounded up, at least one if elem_padding > 0)
+   *    empty slots after its particles for rebuild to fill in place
+   * @param[in] ptcls_per_elem view of the number of particles in each element
+   * @return view of num_elems+1 offsets, the last entry is the number of slots
+  */
+  template<class DataTypes, typename MemSpace>
+  typename CSR<DataTypes, MemSpace>::kkLidView
+  CSR<DataTypes, MemSpace>::buildOffsets(kkLidView ptcls_per_elem) {
+    kkLidView slots_per_elem(Kokkos::ViewAllocateWithoutInitializing("slots_per_elem"), num_elems+1);
+    const lid_t ne = num_elems;
+    const double pad = elem_padding;
+    Kokkos::parallel_for("csr_slots_per_elem", num_elems+1, KOKKOS_LAMBDA(const lid_t& i) {
+      lid_t slots = 0;
+      if (i < ne) {
+        const lid_t ppe = ptcls_per_elem(i);
+        lid_t holes = 0;
+        if (pad > 0) {
+          holes = static_cast<lid_t>(ceil(ppe * pad));
+          if (holes < 1)
+            holes = 1;
+        }
+        slots = ppe + holes;
+      }
+      slots_per_elem(i) = slots;
+    });
+    kkLidView new_offsets(Kokkos::ViewAllocateWithoutInitializing("offsets"), num_elems+1);
+    exclusive_scan(slots_per_elem, new_offsets);
+    return new_offsets;
+  }
+
+  /**
+   * helper function: marks the first ptcls_per_elem(e) slots of each element active
+   *    and every other slot of the capacity empty
+   * @param[in] ptcls_per_elem view of the number of particles in each element
+  */
+  template<class DataTypes, typename MemSpace>
+  void CSR<DataTypes, MemSpace>::setMask(kkLidView ptcls_per_elem) {
+    if (particle_mask.size() != static_cast<std::size_t>(capacity_))
+      particle_mask = Kokkos::View<bool*, device_type>(
+        Kokkos::ViewAllocateWithoutInitializing("particle_mask"), capacity_);
+    auto mask = particle_mask;
+    auto offsets_cpy = offsets;
+    const lid_t ne = num_elems;
+    Kokkos::parallel_for("csr_set_mask", capacity_, KOKKOS_LAMBDA(const lid_t& slot) {
+      const lid_t elm = findSegment(offsets_cpy, ne, slot);
+      mask(slot) = slot < offsets_cpy(ne) && slot - offsets_cpy(elm) < ptcls_per_elem(elm);
+    });
+  }
+
   template<class DataTypes, typename MemSpace>
   void CSR<DataTypes,MemSpace>::construct(kkLidView ptcls_per_elem, kkGidView element_gids,
                                           kkLidView particle_elements, MTVs particle_info){
@@ -65,9 +115,9 @@ namespace pumipic {
     // SS1 allocate the offsets array and use an exclusive_scan (aka prefix sum)
     // to fill the entries of the offsets array.
     // see pumi-pic/support/SupportKK.h for the exclusive_scan helper function
-    offsets = kkLidView(Kokkos::ViewAllocateWithoutInitializing("offsets"), num_elems+1);
-    Kokkos::resize(ptcls_per_elem, ptcls_per_elem.size()+1);
-    exclusive_scan(ptcls_per_elem, offsets);
+    // Each element owns its particles followed by elem_padding empty slots
+    offsets = buildOffsets(ptcls_per_elem);
+    chooseLoopStrategy(ptcls_per_elem);
 
     // get global ids
     if (element_gids.size() > 0) {
@@ -81,6 +131,7 @@ namespace pumipic {
     CreateViews<device_type, DataTypes>(ptcl_data, capacity_);
     CreateViews<device_type, DataTypes>(ptcl_data_swap,capacity_);
     swap_capacity_ = capacity_;
+    setMask(ptcls_per_elem);
 
     // If particle info is provided then enter the information
     lid_t given_particles = particle_elements.size();
@@ -6,6 +6,17 @@ namespace pumipic{
   template<class DataTypes, typename MemSpace>
   class CSR;
 
+  /* Execution strategy of CSR::parallel_for
+     CSR_LOOP_AUTO - chosen from the particles per element on construction and rebuild
+     CSR_LOOP_TEAM - one team per element
+     CSR_LOOP_FLAT - flat range over the particles, each finds its element in the offsets
+  */
+  enum CSRLoopStrategy {
+    CSR_LOOP_AUTO,
+    CSR_LOOP_TEAM,
+    CSR_LOOP_FLAT
+  };
+
   template <class DataTypes, typename MemSpace = DefaultMemSpace>
   class CSR_Input{
   public:
@@ -26,6 +37,13 @@ namespace pumipic{
     //Amount of padding beyond the number of particles
     double padding_amount = 1.05; //1.05*num_ptcls
 
+    //Empty slots added to each element, as a fraction of its particles (at least one
+    //  slot if nonzero), that rebuild fills in place before falling back to a full rebuild
+    double elem_padding = 0.1;
+
+    //Execution strategy of parallel_for
+    CSRLoopStrategy loop_strategy = CSR_LOOP_AUTO;
+
     std::string name;
 
     friend class CSR<DataTypes, MemSpace>;
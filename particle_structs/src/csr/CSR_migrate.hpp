@@ -10,31 +10,63 @@ namespace pumipic {
    * @param[in] new_particle_elements view of ints representing new elements for new particles (-1 for removal)
    * @param[in] new_particle_info array of views filled with particle data
   */
-  template <class DataTypes, typename MemSpace>
+  template<class DataTypes, typename MemSpace>
   void CSR<DataTypes, MemSpace>::migrate(kkLidView new_element, kkLidView new_process,
                                          Distributor<MemSpace> dist,
                                          kkLidView new_particle_elements,
                                          MTVs new_particle_info) {
-    const auto btime = prebarrier();
-
     Kokkos::Profiling::pushRegion("csr_migrate");
+    MigrationHandle<DataTypes, MemSpace> handle;
+    migrateBegin(handle, new_element, new_process, dist, new_particle_elements,
+                 new_particle_info);
+    migrateEnd(handle);
+    Kokkos::Profiling::popRegion();
+  }
+
+  template<class DataTypes, typename MemSpace>
+  void CSR<DataTypes, MemSpace>::migrateBegin(MigrationHandle<DataTypes, MemSpace>& handle,
+                                              kkLidView new_element, kkLidView new_process,
+                                              Distributor<MemSpace> dist,
+                                              kkLidView new_particle_elements,
+                                              MTVs new_particle_info) {
+    if (handle.inFlight()) {
+      fprintf(stderr, "[ERROR] migrateBegin called with a handle that is already in flight\n");
+      throw 1;
+    }
+    if (migration_buffers.in_use) {
+      fprintf(stderr, "[ERROR] migrateBegin called while another migration of the structure is in flight\n");
+      throw 1;
+    }
+    const auto btime = prebarrier();
+    Kokkos::Profiling::pushRegion("csr_migrate_begin");
     Kokkos::Timer timer;
+    typedef MigrationBuffers<DataTypes, MemSpace> Buffers;
+    Buffers& buffers = migration_buffers;
 
     // Distributor size & rank for performing migration
     int comm_size = dist.num_ranks();
     int comm_rank;
     MPI_Comm_rank(dist.mpi_comm(), &comm_rank);
 
+    // Keep the arguments needed by migrateEnd
+    handle.btime = btime;
+    handle.comm_rank = comm_rank;
+    handle.new_element = new_element;
+    handle.new_process = new_process;
+    handle.new_particle_elements = new_particle_elements;
+    handle.new_particle_info = new_particle_info;
+    handle.exchange = false;
+    handle.start(&migration_buffers);
+
     // If serial, skip migration
     if (comm_size == 1) {
-      RecordTime("CSR particle migration", timer.seconds(), btime);
-      rebuild(new_element, new_particle_elements, new_particle_info);
+      handle.elapsed = timer.seconds();
       Kokkos::Profiling::popRegion();
       return;
     }
 
     // Count number of particles to send to each process
-    kkLidView num_send_particles("num_send_particles", comm_size + 1);
+    kkLidView num_send_particles = buffers.zeroedLids(Buffers::NUM_SEND, comm_size + 1);
     auto count_sending_particles = PS_LAMBDA(const lid_t& element_id, const lid_t& particle_id, const bool& mask) {
       const lid_t process = new_process(particle_id);
       if (mask && (process != comm_rank)) {
@@ -43,15 +75,15 @@ namespace pumipic {
       }
     };
     parallel_for(count_sending_particles);
-    
+
     //********* Send # of particles being sent to each process
-    kkLidView num_recv_particles("num_recv_particles", comm_size + 1);
+    kkLidView num_recv_particles = buffers.zeroedLids(Buffers::NUM_RECV, comm_size + 1);
     int num_send_ranks = dist.isWorld() ? 0 : comm_size - 1;
     MPI_Request* count_send_requests = NULL;
     if (num_send_ranks > 0)
-      count_send_requests = new MPI_Request[num_send_ranks];
+      count_send_requests = buffers.requests(Buffers::COUNT_SEND_REQUESTS, num_send_ranks);
     int num_recv_ranks = dist.isWorld() ? 1 : comm_size - 1;
-    MPI_Request* count_recv_requests = new MPI_Request[num_recv_ranks];
+    MPI_Request* count_recv_requests = buffers.requests(Buffers::COUNT_RECV_REQUESTS, num_recv_ranks);
     if (dist.isWorld())
       PS_Comm_Ialltoall(num_send_particles, 1, num_recv_particles, 1,
                         dist.mpi_comm(), count_recv_requests);
@@ -68,44 +100,51 @@ namespace pumipic {
         }
       }
     }
-    
+
     // Gather sending particle data
     // Perform an ex-sum on num_send_particles & num_recv_particles
-    kkLidView offset_send_particles("offset_send_particles", comm_size+1);
-    kkLidView offset_send_particles_temp(Kokkos::ViewAllocateWithoutInitializing("offset_send_particles_temp"), comm_size + 1);
+    kkLidView offset_send_particles = buffers.lids(Buffers::OFFSET_SEND, comm_size + 1);
     exclusive_scan(num_send_particles, offset_send_particles);
-    Kokkos::deep_copy(offset_send_particles_temp, offset_send_particles);
     kkLidHostMirror offset_send_particles_host = deviceToHost(offset_send_particles);
 
     // Create arrays for particles being sent
     lid_t np_send = offset_send_particles_host(comm_size);
-    kkLidView send_element(Kokkos::ViewAllocateWithoutInitializing("send_element"), np_send);
-    MTVs send_particle;
-    // Allocate views for each data type into send_particle[type]
-    CreateViews<device_type, DataTypes>(send_particle, np_send);
-    kkLidView send_index(Kokkos::ViewAllocateWithoutInitializing("send_particle_index"), capacity());
-    auto element_to_gid_local = element_to_gid;
-    auto gatherParticlesToSend = PS_LAMBDA(const lid_t& element_id, const lid_t& particle_id, const bool& mask) {
-      const lid_t process = new_process(particle_id);
-      const lid_t process_index = dist.index(process);
-      if (mask && process != comm_rank) {
-        send_index(particle_id) =
-          Kokkos::atomic_fetch_add(&(offset_send_particles_temp(process_index)),1);
-        const lid_t index = send_index(particle_id);
-        send_element(index) = element_to_gid_local(new_element(particle_id));
-      }
+    kkLidView send_element = buffers.lids(Buffers::SEND_ELEMENT, np_send);
+    // Views for each data type with at least np_send entries
+    MTVs send_particle = buffers.sendParticles(np_send);
+
+    // Order the sending particles by destination then new element so each
+    //   message is element grouped and the send order is reproducible
+    const lid_t cap = capacity();
+    kkLidView send_flag = buffers.zeroedLids(Buffers::SEND_FLAG, cap + 1);
+    auto flagParticlesToSend = PS_LAMBDA(const lid_t& element_id, const lid_t& particle_id, const bool& mask) {
+      send_flag(particle_id) = mask && new_process(particle_id) != comm_rank;
     };
-    parallel_for(gatherParticlesToSend);
+    parallel_for(flagParticlesToSend);
+    kkLidView send_index = buffers.lids(Buffers::SEND_INDEX, cap + 1);
+    exclusive_scan(send_flag, send_index);
+    kkLidView send_list = buffers.lids(Buffers::SEND_LIST, np_send);
+    kkLidView send_bins = buffers.lids(Buffers::SEND_BINS, np_send);
+    Kokkos::parallel_for("gather_send_list", cap, KOKKOS_LAMBDA(const lid_t& particle_id) {
+      if (send_flag(particle_id))
+        send_list(send_index(particle_id)) = particle_id;
+    });
+    sortSendList(send_list, send_bins, np_send, new_element, new_process, dist, num_elems);
+    auto element_to_gid_local = element_to_gid;
+    Kokkos::parallel_for("gather_send_elements", np_send, KOKKOS_LAMBDA(const lid_t& index) {
+      const lid_t particle_id = send_list(index);
+      send_index(particle_id) = index;
+      send_element(index) = element_to_gid_local(new_element(particle_id));
+    });
     // Copy the values from ptcl_data[type][particle_id] into send_particle[type](index) for each data type
     CopyParticlesToSend<CSR<DataTypes, MemSpace>, DataTypes>(this, send_particle,
                                                                     ptcl_data,
                                                                     new_process,
                                                                     send_index);
-    
+
     // Wait until all counts are received
     PS_Comm_Waitall<device_type>(num_recv_ranks, count_recv_requests, MPI_STATUSES_IGNORE);
-    delete [] count_recv_requests;
-    
+
     // Count the number of processes being sent to and recv from
     lid_t num_sending_to = 0, num_receiving_from = 0;
     Kokkos::parallel_reduce("sum_senders", comm_size,
@@ -121,37 +160,51 @@ namespace pumipic {
     if (count_send_requests) {
       PS_Comm_Waitall<device_type>(num_send_ranks, count_send_requests,
                                    MPI_STATUSES_IGNORE);
-      delete [] count_send_requests;
     }
 
-    // If no particles are being sent or received, perform rebuild
+    // If no particles are being sent or received, migrateEnd only rebuilds
     if (num_sending_to == 0 && num_receiving_from == 0) {
-      destroyViews<DataTypes, memory_space>(send_particle);
-      rebuild(new_element, new_particle_elements, new_particle_info);
-      RecordTime("CSR particle migration", timer.seconds(), btime);
+      handle.elapsed = timer.seconds();
       Kokkos::Profiling::popRegion();
       return;
     }
-    
+    handle.exchange = true;
+
     // Offset the recv particles
-    kkLidView offset_recv_particles("offset_recv_particles", comm_size+1);
+    kkLidView offset_recv_particles = buffers.lids(Buffers::OFFSET_RECV, comm_size + 1);
     exclusive_scan(num_recv_particles, offset_recv_particles);
     kkLidHostMirror offset_recv_particles_host = deviceToHost(offset_recv_particles);
-    int np_recv = offset_recv_particles_host(comm_size);
+    lid_t np_recv = offset_recv_particles_host(comm_size);
 
     // Create arrays for particles being received
     lid_t new_ptcls = new_particle_elements.size();
-    kkLidView recv_element(Kokkos::ViewAllocateWithoutInitializing("recv_element"), np_recv + new_ptcls);
-    MTVs recv_particle;
-    // Allocate views for each data type into recv_particle[type]
-    CreateViews<device_type, DataTypes>(recv_particle, np_recv + new_ptcls);
-    
-    // Get pointers to the data for MPI calls
+    kkLidView recv_element = buffers.lids(Buffers::RECV_ELEMENT, np_recv + new_ptcls);
+    // Views for each data type with at least np_recv + new_ptcls entries
+    MTVs recv_particle = buffers.recvParticles(np_recv + new_ptcls);
+    handle.np_recv = np_recv;
+    handle.new_ptcls = new_ptcls;
+    handle.recv_element = recv_element;
+    handle.recv_particle = recv_particle;
+
+    //********* Add new particles to the migrated particles
+    kkLidView new_ptcl_map = buffers.lids(Buffers::NEW_PTCL_MAP, new_ptcls);
+    Kokkos::parallel_for(new_ptcls, KOKKOS_LAMBDA(const lid_t& i) {
+        recv_element(np_recv + i) = new_particle_elements(i);
+        new_ptcl_map(i) = np_recv + i;
+    });
+    CopyViewsToViews<kkLidView, DataTypes>(recv_particle, new_particle_info, new_ptcl_map);
+
+    // Pack the particles to each neighbor into one message
+    const std::size_t entry_size = packedEntrySize<DataTypes>();
+    handle.send_buffer = buffers.sendBuffer(np_send * entry_size);
+    handle.recv_buffer = buffers.recvBuffer(np_recv * entry_size);
+    PackViews<device_type, DataTypes>(send_element, send_particle, np_send, handle.send_buffer);
+
     lid_t send_num = 0, recv_num = 0;
-    lid_t num_sends = num_sending_to * (num_types + 1);
-    lid_t num_recvs = num_receiving_from * (num_types + 1);
-    MPI_Request* send_requests = new MPI_Request[num_sends];
-    MPI_Request* recv_requests = new MPI_Request[num_recvs];
+    handle.send_requests = buffers.requests(Buffers::SEND_REQUESTS, num_sending_to);
+    handle.num_send_requests = num_sending_to;
+    handle.recv_requests = buffers.requests(Buffers::RECV_REQUESTS, num_receiving_from);
+    handle.num_recv_requests = num_receiving_from;
     // Send the particles to each neighbor
     for (lid_t i = 0; i < comm_size; ++i) {
       int rank = dist.rank_host(i);
@@ -162,38 +215,61 @@ namespace pumipic {
       lid_t num_send = offset_send_particles_host(i+1) - offset_send_particles_host(i);
       if (num_send > 0) {
         lid_t start_index = offset_send_particles_host(i);
-        PS_Comm_Isend(send_element, start_index, num_send, rank, 0, dist.mpi_comm(),
-                      send_requests +send_num);
+        PS_Comm_Isend(handle.send_buffer, start_index * entry_size, num_send * entry_size, rank, 0,
+                      dist.mpi_comm(), handle.send_requests + send_num);
         send_num++;
-        SendViews<device_type, DataTypes>(send_particle, start_index, num_send, rank, 1,
-                                          dist.mpi_comm(), send_requests + send_num);
-        send_num+=num_types;
       }
       // Receiving
       lid_t num_recv = offset_recv_particles_host(i+1) - offset_recv_particles_host(i);
       if (num_recv > 0) {
         lid_t start_index = offset_recv_particles_host(i);
-        PS_Comm_Irecv(recv_element, start_index, num_recv, rank, 0, dist.mpi_comm(),
-                      recv_requests + recv_num);
+        PS_Comm_Irecv(handle.recv_buffer, start_index * entry_size, num_recv * entry_size, rank, 0,
+                      dist.mpi_comm(), handle.recv_requests + recv_num);
         recv_num++;
-        RecvViews<device_type, DataTypes>(recv_particle,start_index, num_recv, rank, 1,
-                                          dist.mpi_comm(), recv_requests + recv_num);
-        recv_num+=num_types;
       }
     }
 
-    PS_Comm_Waitall<device_type>(num_recvs, recv_requests, MPI_STATUSES_IGNORE);
-    delete [] recv_requests;
-    
-    //********** Convert the received element from element gid to element lid
+    handle.elapsed = timer.seconds();
+    Kokkos::Profiling::popRegion();
+  }
+
+  template<class DataTypes, typename MemSpace>
+  void CSR<DataTypes, MemSpace>::migrateEnd(MigrationHandle<DataTypes, MemSpace>& handle) {
+    if (!handle.inFlight()) {
+      fprintf(stderr, "[ERROR] migrateEnd called without a matching migrateBegin\n");
+      throw 1;
+    }
+    Kokkos::Profiling::pushRegion("csr_migrate_end");
+    Kokkos::Timer timer;
+    kkLidView new_element = handle.new_element;
+
+    // Nothing was exchanged, only rebuild
+    if (!handle.exchange) {
+      Kokkos::Timer rebuild_subtract;
+      rebuild(new_element, handle.new_particle_elements, handle.new_particle_info);
+      const auto temp = rebuild_subtract.seconds();
+      RecordTime("CSR particle migration", handle.elapsed + timer.seconds() - temp, handle.btime);
+      handle.clear();
+      Kokkos::Profiling::popRegion();
+      return;
+    }
+
+    // Wait for the particles and unpack them
+    handle.finishRecvs();
+    const lid_t np_recv = handle.np_recv;
+    kkLidView recv_element = handle.recv_element;
+    UnpackViews<device_type, DataTypes>(handle.recv_buffer, np_recv, recv_element,
+                                        handle.recv_particle);
+
+    //********* Convert the received element from element gid to element lid
     auto element_gid_to_lid_local = element_gid_to_lid;
     Kokkos::parallel_for(np_recv, KOKKOS_LAMBDA(const lid_t& i) {
-        const gid_t gid = recv_element(i);
-        const lid_t index = element_gid_to_lid_local.find(gid);
-        recv_element(i) = element_gid_to_lid_local.value_at(index);
+        recv_element(i) = element_gid_to_lid_local.find(recv_element(i));
       });
 
-    //********** Set particles that were sent to non existent on this process
+    //********* Set particles that were sent to non existent on this process
+    kkLidView new_process = handle.new_process;
+    const int comm_rank = handle.comm_rank;
     auto removeSentParticles = PS_LAMBDA(const lid_t& element_id, const lid_t& particle_id, const bool& mask) {
       const bool sent = new_process(particle_id) != comm_rank;
       const lid_t elm = new_element(particle_id);
@@ -202,28 +278,17 @@ namespace pumipic {
     };
     parallel_for(removeSentParticles);
 
-    //********** Add new particles to the migrated particles
-    kkLidView new_ptcl_map(Kokkos::ViewAllocateWithoutInitializing("new_ptcl_map"), new_ptcls);
-    Kokkos::parallel_for(new_ptcls, KOKKOS_LAMBDA(const lid_t& i) {
-        recv_element(np_recv + i) = new_particle_elements(i);
-        new_ptcl_map(i) = np_recv + i;
-    });
-    CopyViewsToViews<kkLidView, DataTypes>(recv_particle, new_particle_info, new_ptcl_map);
-
-
-    //********** Combine and shift particles to their new destination
+    //********* Combine and shift particles to their new destination
     Kokkos::Timer rebuild_subtract;
-    rebuild(new_element, recv_element, recv_particle);
+    rebuild(new_element, recv_element, handle.recv_particle);
     const auto temp = rebuild_subtract.seconds();
 
     // Cleanup
-    PS_Comm_Waitall<device_type>(num_sends, send_requests, MPI_STATUSES_IGNORE);
-    delete [] send_requests;
-    destroyViews<DataTypes, memory_space>(send_particle);
-    destroyViews<DataTypes, memory_space>(recv_particle);
+    handle.finishSends();
+    handle.clear();
 
-    RecordTime("CSR particle migration", timer.seconds() - temp, btime);
+    RecordTime("CSR particle migration", handle.elapsed + timer.seconds() - temp, handle.btime);
 
     Kokkos::Profiling::popRegion();
   }
-}
\ No newline at end of file
+}
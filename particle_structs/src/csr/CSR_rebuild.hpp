@@ -2,8 +2,124 @@
 
 namespace pumipic {
 
+  /**
+   * Move the particles changing elements and the new particles into the empty
+   *     slots of their new element. The particles that stay are not copied.
+   *     Delete particles with new_element(ptcl) < 0
+   * @param[in] new_element view of ints with new elements for each particle
+   * @param[in] new_particle_elements view of ints, representing which elements
+   *    particle reside in
+   * @param[in] new_particles array of views filled with particle data
+   * @return false if an element does not have enough empty slots, the structure is unchanged
+  */
+  template<class DataTypes,typename MemSpace>
+  bool CSR<DataTypes,MemSpace>::reshuffle(kkLidView new_element,
+                                          kkLidView new_particle_elements,
+                                          MTVs new_particles) {
+    invalidateElementGroups();
+    const lid_t num_new_ptcls = new_particle_elements.size();
+    auto slot_mask = particle_mask;
+
+    // count the particles arriving in, the particles kept in and the empty slots of each element
+    kkLidView arrivals_d("arrivals_d", num_elems + 1);
+    kkLidView holes_d("holes_d", num_elems);
+    kkLidView particles_per_element("particlesPerElement", num_elems + 1);
+    kkLidView num_removed_d("num_removed_d", 1);
+    auto countArrivals = PS_LAMBDA(const lid_t& elm, const lid_t& ptcl, const bool& mask) {
+      const lid_t new_elm = new_element(ptcl);
+      if (mask && new_elm > -1) {
+        Kokkos::atomic_increment(&particles_per_element(new_elm));
+        if (new_elm != elm)
+          Kokkos::atomic_increment(&arrivals_d(new_elm));
+      }
+      if (!mask || new_elm < 0)
+        Kokkos::atomic_increment(&holes_d(elm));
+      if (mask && new_elm < 0)
+        Kokkos::atomic_increment(&num_removed_d(0));
+    };
+    parallel_for(countArrivals, "countArrivals");
+    Kokkos::parallel_for("count_new_ptcls", num_new_ptcls, KOKKOS_LAMBDA(const lid_t& i) {
+      Kokkos::atomic_increment(&arrivals_d(new_particle_elements(i)));
+      Kokkos::atomic_increment(&particles_per_element(new_particle_elements(i)));
+    });
+
+    // check if the particles fit in the current slots
+    kkLidView fail("fail", 1);
+    Kokkos::parallel_for("check_holes", num_elems, KOKKOS_LAMBDA(const lid_t& i) {
+      if (arrivals_d(i) > holes_d(i))
+        fail(0) = 1;
+    });
+    if (getLastValue<lid_t>(fail))
+      return false;
+    const lid_t num_removed = getLastValue<lid_t>(num_removed_d);
+
+    // offset the arriving particles by element
+    kkLidView offset_arrivals("offset_arrivals", num_elems + 1);
+    kkLidView counting_offset("counting_offset", num_elems + 1);
+    exclusive_scan(arrivals_d, offset_arrivals);
+    Kokkos::deep_copy(counting_offset, offset_arrivals);
+    const lid_t num_moving = getLastValue<lid_t>(offset_arrivals);
+
+    // gather the moving particles followed by the new particles of each element
+    kkLidView moving_ptcls(Kokkos::ViewAllocateWithoutInitializing("moving_ptcls"), num_moving);
+    kkLidView from_ps(Kokkos::ViewAllocateWithoutInitializing("from_ps"), num_moving);
+    auto gatherMoving = PS_LAMBDA(const lid_t& elm, const lid_t& ptcl, const bool& mask) {
+      const lid_t new_elm = new_element(ptcl);
+      if (mask && new_elm > -1 && new_elm != elm) {
+        const lid_t index = Kokkos::atomic_fetch_add(&counting_offset(new_elm), 1);
+        moving_ptcls(index) = ptcl;
+        from_ps(index) = 1;
+      }
+    };
+    parallel_for(gatherMoving, "gatherMoving");
+    Kokkos::parallel_for("gather_new_ptcls", num_new_ptcls, KOKKOS_LAMBDA(const lid_t& i) {
+      const lid_t index = Kokkos::atomic_fetch_add(&counting_offset(new_particle_elements(i)), 1);
+      moving_ptcls(index) = i;
+      from_ps(index) = 0;
+    });
+
+    // remove the deleted particles and assign an empty slot to each arriving particle
+    kkLidView holes(Kokkos::ViewAllocateWithoutInitializing("holes"), num_moving);
+    auto assignHoles = PS_LAMBDA(const lid_t& elm, const lid_t& ptcl, const bool& mask) {
+      const lid_t new_elm = new_element(ptcl);
+      if (!mask || new_elm < 0) {
+        slot_mask(ptcl) = false;
+        const lid_t index = Kokkos::atomic_fetch_add(&offset_arrivals(elm), 1);
+        if (index < counting_offset(elm))
+          holes(index) = ptcl;
+      }
+    };
+    parallel_for(assignHoles, "assignHoles");
+
+    // the slots are disjoint from the sources, so the particles are copied in place
+    kkLidView move_to("move_to", capacity_);
+    Kokkos::deep_copy(move_to, -1);
+    kkLidView new_particle_indices(Kokkos::ViewAllocateWithoutInitializing("new_particle_indices"),
+                                   num_new_ptcls);
+    Kokkos::parallel_for("assign_slots", num_moving, KOKKOS_LAMBDA(const lid_t& i) {
+      if (from_ps(i))
+        move_to(moving_ptcls(i)) = holes(i);
+      else
+        new_particle_indices(moving_ptcls(i)) = holes(i);
+    });
+    CopyPSToPS< CSR<DataTypes,MemSpace>, DataTypes >(this, ptcl_data, ptcl_data, move_to, move_to);
+    if (num_new_ptcls > 0 && new_particles != NULL) {
+      CopyViewsToViews<kkLidView,DataTypes>(ptcl_data, new_particles, new_particle_indices);
+    }
+    Kokkos::parallel_for("move_mask", num_moving, KOKKOS_LAMBDA(const lid_t& i) {
+      if (from_ps(i))
+        slot_mask(moving_ptcls(i)) = false;
+      slot_mask(holes(i)) = true;
+    });
+
+    num_ptcls = num_ptcls - num_removed + num_new_ptcls;
+    chooseLoopStrategy(particles_per_element);
+    return true;
+  }
+
   /**
    * Fully rebuild the structure by replacing the old one
+   *     Tries reshuffle first unless shuffling is turned off with setShuffling(false)
    *     Delete particles with new_element(ptcl) < 0
    * @param[in] new_element view of ints with new elements for each particle
    * @param[in] new_particle_elements view of ints, representing which elements
@@ -22,6 +138,14 @@ namespace pumipic {
     
     Kokkos::Profiling::pushRegion("CSR Rebuild");
     Kokkos::Timer timer;
+    invalidateElementGroups();
+
+    // try moving the particles into the empty slots of their new elements first
+    if (tryShuffling && reshuffle(new_element, new_particle_elements, new_particles)) {
+      RecordTime("CSR rebuild", timer.seconds(), btime);
+      Kokkos::Profiling::popRegion();
+      return;
+    }
 
     Kokkos::Timer time_ppe;
     // fresh filling of particles_per_element
@@ -29,6 +153,8 @@ namespace pumipic {
     kkLidView num_removed_d("num_removed_d",1);
     // Fill ptcls per elem for existing ptcls
     auto count_existing = PS_LAMBDA(const lid_t& elm_id, const lid_t& ptcl_id, const bool& mask) {
+      if (!mask)
+        return;
       if (new_element[ptcl_id] > -1)
         Kokkos::atomic_increment(&particles_per_element[new_element[ptcl_id]]);
       else
@@ -43,13 +169,13 @@ namespace pumipic {
           Kokkos::atomic_increment(&particles_per_element[new_particle_elements[i]]);
         });
     RecordTime("CSR calc ppe", time_ppe.seconds());
+    chooseLoopStrategy(particles_per_element);
 
     // time offsets and indices calc
     Kokkos::Timer time_off_ind;
-    // refill offset here
-    auto offsets_new = kkLidView("offsets", num_elems+1); // CopyPSToPS uses orig offsets
-    Kokkos::deep_copy(offsets_new, offsets);
-    exclusive_scan(particles_per_element, offsets_new);
+    // refill offset here, with elem_padding empty slots after each element's particles
+    auto offsets_new = buildOffsets(particles_per_element); // CopyPSToPS uses orig offsets
+    const lid_t num_slots = getLastValue(offsets_new);
 
     // Determine new_indices for all of the existing particles
     kkLidView row_indices(Kokkos::ViewAllocateWithoutInitializing("row indices"), num_elems+1);
@@ -58,7 +184,7 @@ namespace pumipic {
 
     auto existing_ptcl_new_indices = PS_LAMBDA(const lid_t& elm_id, const lid_t& ptcl_id, const bool& mask) {
       const lid_t new_elem = new_element[ptcl_id];
-      if (new_elem != -1)
+      if (mask && new_elem != -1)
         new_indices[ptcl_id] = Kokkos::atomic_fetch_add(&row_indices(new_elem),1);
       else
         new_indices[ptcl_id] = -1;
@@ -70,15 +196,15 @@ namespace pumipic {
     lid_t particles_on_process = num_ptcls - num_removed + num_new_ptcls;
 
     //Determine if realloc appropriate based on variables
-    if (always_realloc || particles_on_process > swap_capacity_) {
+    if (always_realloc || num_slots > swap_capacity_) {
       destroyViews<DataTypes>(ptcl_data_swap);
-      CreateViews<device_type,DataTypes>(ptcl_data_swap, padding_amount*particles_on_process);
-      swap_capacity_ = padding_amount*particles_on_process;
+      CreateViews<device_type,DataTypes>(ptcl_data_swap, padding_amount*num_slots);
+      swap_capacity_ = padding_amount*num_slots;
     }
-    else if (particles_on_process < minimize_size*swap_capacity_){
+    else if (num_slots < minimize_size*swap_capacity_){
       destroyViews<DataTypes>(ptcl_data_swap);
-      CreateViews<device_type,DataTypes>(ptcl_data_swap, padding_amount*particles_on_process);
-      swap_capacity_ = padding_amount*particles_on_process;
+      CreateViews<device_type,DataTypes>(ptcl_data_swap, padding_amount*num_slots);
+      swap_capacity_ = padding_amount*num_slots;
     }
     
     Kokkos::Timer time_pstops;
@@ -112,6 +238,7 @@ namespace pumipic {
 
     num_ptcls = particles_on_process;
     offsets   = offsets_new;
+    setMask(particles_per_element);
 
     RecordTime("CSR rebuild", timer.seconds(), btime);
     Kokkos::Profiling::popRegion();
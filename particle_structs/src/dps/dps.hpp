@@ -27,8 +27,9 @@ namespace pumipic {
 
     using host_space = Kokkos::HostSpace;
     typedef Kokkos::TeamPolicy<execution_space> PolicyType;
-    typedef Kokkos::UnorderedMap<gid_t, lid_t, device_type> GID_Mapping;
+    typedef GidMapping<device_type> GID_Mapping;
     typedef DPS_Input<DataTypes, MemSpace> Input_T;
+    template <typename MSpace> using Mirror = DPS<DataTypes, MSpace>;
 
     using DPS_DT = PS_DTBool<DataTypes>;
     using AoSoA_t = Cabana::AoSoA<DPS_DT,device_type>;
@@ -46,6 +47,9 @@ namespace pumipic {
     DPS(DPS_Input<DataTypes, MemSpace>&);
     ~DPS();
 
+    template <class MSpace>
+    Mirror<MSpace>* copy();
+
     //Functions from ParticleStructure
     using ParticleStructure<DataTypes, MemSpace>::nElems;
     using ParticleStructure<DataTypes, MemSpace>::nPtcls;
@@ -59,15 +63,27 @@ namespace pumipic {
                  Distributor<MemSpace> dist = Distributor<MemSpace>(),
                  kkLidView new_particle_elements = kkLidView(),
                  MTVs new_particle_info = NULL);
+    void migrateBegin(MigrationHandle<DataTypes, MemSpace>& handle,
+                      kkLidView new_element, kkLidView new_process,
+                      Distributor<MemSpace> dist = Distributor<MemSpace>(),
+                      kkLidView new_particle_elements = kkLidView(),
+                      MTVs new_particle_info = NULL);
+    void migrateEnd(MigrationHandle<DataTypes, MemSpace>& handle);
 
     void rebuild(kkLidView new_element, kkLidView new_particle_elements = kkLidView(),
                  MTVs new_particles = NULL);
 
     template <typename FunctionType>
     void parallel_for(FunctionType& fn, std::string s="");
+    template <typename FunctionType, typename ReturnType>
+    void parallel_reduce(FunctionType& fn, ReturnType&& result, std::string s="");
 
     void printMetrics() const;
     void printFormat(const char* prefix) const;
+    //Copies the active particles into packed arrays, see ParticleStructure::packParticles
+    void packParticles(kkLidView particle_elements, MTVs particle_info);
+    //Groups the active particles by element with a counting sort, see ps::groupByElement
+    void buildElementGroups(kkLidView& elm_offsets, kkLidView& ptcl_ids);
 
     // Do not call these functions:
     AoSoA_t* makeAoSoA(const lid_t capacity, const lid_t num_soa);
@@ -87,6 +103,8 @@ namespace pumipic {
     using ParticleStructure<DataTypes, MemSpace>::capacity_;
     using ParticleStructure<DataTypes, MemSpace>::num_rows;
     using ParticleStructure<DataTypes, MemSpace>::ptcl_data;
+    using ParticleStructure<DataTypes, MemSpace>::migration_buffers;
+    using ParticleStructure<DataTypes, MemSpace>::invalidateElementGroups;
     using ParticleStructure<DataTypes, MemSpace>::num_types;
   
     // mappings from row to element gid and back to row
@@ -100,6 +118,11 @@ namespace pumipic {
     kkLidView parentElms_;
     // particle data
     AoSoA_t* aosoa_;
+
+    template <typename DT, typename MSpace> friend class DPS;
+    // constructor used by copy
+    DPS(lid_t team_size) : ParticleStructure<DataTypes, MemSpace>(PS_DPS),
+                           policy(PolicyType(1000, team_size)), aosoa_(NULL) {}
   };
 
   /**
@@ -124,9 +147,8 @@ namespace pumipic {
                                    kkGidView element_gids,
                                    kkLidView particle_elements, // optional
                                    MTVs particle_info) :        // optional
-    ParticleStructure<DataTypes, MemSpace>(),
+    ParticleStructure<DataTypes, MemSpace>(PS_DPS),
     policy(p),
-    element_gid_to_lid(num_elements),
     extra_padding(0.05) // default extra padding at 5%
   {
     assert(num_elements == particles_per_element.size());
@@ -160,9 +182,8 @@ namespace pumipic {
 
   template <class DataTypes, typename MemSpace>
   DPS<DataTypes, MemSpace>::DPS(Input_T& input) :        // optional
-    ParticleStructure<DataTypes, MemSpace>(input.name),
-    policy(input.policy),
-    element_gid_to_lid(input.ne)
+    ParticleStructure<DataTypes, MemSpace>(input.name, PS_DPS),
+    policy(input.policy)
   {
     num_elems = input.ne;
     num_rows = num_elems;
@@ -199,6 +220,91 @@ namespace pumipic {
   template <class DataTypes, typename MemSpace>
   DPS<DataTypes, MemSpace>::~DPS() { delete aosoa_; }
 
+  /**
+   * Copy the structure to another memory space
+   *    The AoSoA, parent elements and global id mapping are deep copied,
+   *    the structure is not reconstructed.
+   * @return new DPS in memory space MSpace
+  */
+  template <class DataTypes, typename MemSpace>
+  template <class MSpace>
+  typename DPS<DataTypes, MemSpace>::template Mirror<MSpace>* DPS<DataTypes, MemSpace>::copy() {
+    typedef typename Mirror<MSpace>::AoSoA_t MirrorAoSoA;
+    const auto team_size = maxChunk<MSpace>(policy.team_size());
+    Mirror<MSpace>* mirror_copy = new DPS<DataTypes, MSpace>(team_size);
+    mirror_copy->copySizes(this);
+    //Copy constants
+    mirror_copy->extra_padding = extra_padding;
+    //Deep copy each view
+    mirror_copy->element_to_gid = typename Mirror<MSpace>::kkGidView("mirror element_to_gid",
+                                                                     element_to_gid.size());
+    Kokkos::deep_copy(mirror_copy->element_to_gid, element_to_gid);
+    mirror_copy->element_gid_to_lid.copy(element_gid_to_lid);
+    mirror_copy->parentElms_ = typename Mirror<MSpace>::kkLidView("mirror parentElms",
+                                                                  parentElms_.size());
+    Kokkos::deep_copy(mirror_copy->parentElms_, parentElms_);
+    //Particles keep their index so only the number of SoAs changes with the SoA length
+    const lid_t mirror_soa_len = MirrorAoSoA::vector_length;
+    mirror_copy->num_soa_ = (capacity_ + mirror_soa_len - 1) / mirror_soa_len;
+    mirror_copy->aosoa_ = mirror_copy->makeAoSoA(capacity_, mirror_copy->num_soa_);
+    Cabana::deep_copy(*(mirror_copy->aosoa_), *aosoa_);
+    return mirror_copy;
+  }
+
+  template <class DataTypes, typename MemSpace>
+  void DPS<DataTypes, MemSpace>::packParticles(kkLidView particle_elements,
+                                               MTVs particle_info) {
+    kkLidView ptcl_index("ptcl_index", capacity_ + 1);
+    packParticleIndices(this, ptcl_index, particle_elements);
+    //Copy every active particle, ps_to_array never matches the rank
+    kkLidView ps_to_array("ps_to_array", capacity_);
+    Kokkos::deep_copy(ps_to_array, -1);
+    CopyParticlesToSendFromAoSoA<DPS<DataTypes, MemSpace>, DataTypes>(this, particle_info,
+                                                                      *aosoa_, ps_to_array,
+                                                                      ptcl_index);
+  }
+
+  template <class DataTypes, typename MemSpace>
+  void DPS<DataTypes, MemSpace>::buildElementGroups(kkLidView& elm_offsets,
+                                                    kkLidView& ptcl_ids) {
+    //Particles are not stored by element, so the active particles are packed in
+    //  index order and sorted by their parent element
+    const auto soa_len = AoSoA_t::vector_length;
+    const auto activeSliceIdx = aosoa_->number_of_members-1;
+    const auto mask = Cabana::slice<activeSliceIdx>(*aosoa_);
+    const lid_t cap = capacity_;
+    const lid_t ne = num_elems;
+    kkLidView index(Kokkos::ViewAllocateWithoutInitializing("group_index"), cap + 1);
+    Kokkos::parallel_scan("group_index", cap + 1,
+                          KOKKOS_LAMBDA(const lid_t& i, lid_t& cur, const bool final) {
+      if (final)
+        index(i) = cur;
+      if (i < cap)
+        cur += mask.access(i / soa_len, i % soa_len);
+    });
+    const lid_t n = getLastValue<lid_t>(index);
+    kkLidView keys(Kokkos::ViewAllocateWithoutInitializing("group_keys"), n);
+    ptcl_ids = kkLidView(Kokkos::ViewAllocateWithoutInitializing("element_particles"), n);
+    kkLidView ids = ptcl_ids;
+    kkLidView parentElms_cpy = parentElms_;
+    Kokkos::parallel_for("group_pack", cap, KOKKOS_LAMBDA(const lid_t& i) {
+      if (mask.access(i / soa_len, i % soa_len)) {
+        keys(index(i)) = parentElms_cpy(i);
+        ids(index(i)) = i;
+      }
+    });
+    stable_counting_sort(keys, ids, n, ne);
+    //Element e starts at the first sorted particle with an element of at least e
+    elm_offsets = kkLidView(Kokkos::ViewAllocateWithoutInitializing("element_offsets"), ne + 1);
+    kkLidView offs = elm_offsets;
+    Kokkos::parallel_for("group_offsets", n + 1, KOKKOS_LAMBDA(const lid_t& i) {
+      const lid_t prev = i > 0 ? keys(i - 1) : -1;
+      const lid_t next = i < n ? keys(i) : ne;
+      for (lid_t e = prev + 1; e <= next; ++e)
+        offs(e) = i;
+    });
+  }
+
   /**
    * a parallel for-loop that iterates through all particles
    * @param[in] fn function of the form fn(elm, particle_id, mask), where
@@ -234,6 +340,46 @@ namespace pumipic {
       }, "parallel_for");
   }
 
+  /**
+   * a parallel reduction over all active particles
+   * @param[in] fn function of the form fn(elm, particle_id, update), where
+   *    elm is the element the particle is in
+   *    particle_id is the overall index of the particle in the structure
+   *    update is the partial result to add the particle's contribution to
+   * @param[in,out] result scalar or Kokkos reducer receiving the result
+   * @param[in] s string for labelling purposes
+  */
+  template <class DataTypes, typename MemSpace>
+  template <typename FunctionType, typename ReturnType>
+  void DPS<DataTypes, MemSpace>::parallel_reduce(FunctionType& fn, ReturnType&& result,
+                                                 std::string s) {
+    typedef typename ReduceValueType<typename std::decay<ReturnType>::type>::type ValueType;
+    // move function pointer to GPU (if needed)
+    FunctionType* fn_d;
+    #ifdef PP_USE_CUDA
+        cudaMalloc(&fn_d, sizeof(FunctionType));
+        cudaMemcpy(fn_d,&fn, sizeof(FunctionType), cudaMemcpyHostToDevice);
+    #else
+        fn_d = &fn;
+    #endif
+    kkLidView parentElms_cpy = parentElms_;
+    const auto soa_len = AoSoA_t::vector_length;
+    const auto activeSliceIdx = aosoa_->number_of_members-1;
+    const auto mask = Cabana::slice<activeSliceIdx>(*aosoa_); // get active mask
+    Kokkos::parallel_reduce(s, Kokkos::RangePolicy<execution_space>(0, capacity_),
+      KOKKOS_LAMBDA(const lid_t& particle_id, ValueType& update) {
+        const lid_t soa = particle_id / soa_len;
+        const lid_t ptcl = particle_id % soa_len;
+        if (mask.access(soa,ptcl)) {
+          const lid_t elm = parentElms_cpy(particle_id); // calculate element
+          (*fn_d)(elm, particle_id, update);
+        }
+      }, std::forward<ReturnType>(result));
+    #ifdef PP_USE_CUDA
+        cudaFree(fn_d);
+    #endif
+  }
+
   template <class DataTypes, typename MemSpace>
   void DPS<DataTypes, MemSpace>::printMetrics() const {
     // Sum number of empty cells
@@ -295,7 +441,8 @@ namespace pumipic {
 
     using host_space = Kokkos::HostSpace;
     typedef Kokkos::TeamPolicy<execution_space> PolicyType;
-    typedef Kokkos::UnorderedMap<gid_t, lid_t, device_type> GID_Mapping;
+    typedef GidMapping<device_type> GID_Mapping;
+    template <typename MSpace> using Mirror = DPS<DataTypes, MSpace>;
 
     DPS() = delete;
     DPS(const DPS&) = delete;
@@ -306,9 +453,13 @@ namespace pumipic {
           kkLidView particles_per_element,
           kkGidView element_gids,
           kkLidView particle_elements = kkLidView(),
-          MTVs particle_info = NULL) {reportError();}
+          MTVs particle_info = NULL) :
+      ParticleStructure<DataTypes, MemSpace>(PS_DPS) {reportError();}
     ~DPS() {}
 
+    template <class MSpace>
+    Mirror<MSpace>* copy() {reportError(); return NULL;}
+
     //Functions from ParticleStructure
     using ParticleStructure<DataTypes, MemSpace>::nElems;
     using ParticleStructure<DataTypes, MemSpace>::nPtcls;
@@ -322,15 +473,25 @@ namespace pumipic {
                  Distributor<MemSpace> dist = Distributor<MemSpace>(),
                  kkLidView new_particle_elements = kkLidView(),
                  MTVs new_particle_info = NULL) {reportError();}
+    void migrateBegin(MigrationHandle<DataTypes, MemSpace>& handle,
+                      kkLidView new_element, kkLidView new_process,
+                      Distributor<MemSpace> dist = Distributor<MemSpace>(),
+                      kkLidView new_particle_elements = kkLidView(),
+                      MTVs new_particle_info = NULL) {reportError();}
+    void migrateEnd(MigrationHandle<DataTypes, MemSpace>& handle) {reportError();}
 
     void rebuild(kkLidView new_element, kkLidView new_particle_elements = kkLidView(),
                  MTVs new_particles = NULL) {reportError();}
 
     template <typename FunctionType>
     void parallel_for(FunctionType& fn, std::string s="") {reportError();}
+    template <typename FunctionType, typename ReturnType>
+    void parallel_reduce(FunctionType& fn, ReturnType&& result, std::string s="") {reportError();}
 
     void printMetrics() const {reportError();}
     void printFormat(const char* prefix) const {reportError();}
+    void packParticles(kkLidView particle_elements, MTVs particle_info) {reportError();}
+    void buildElementGroups(kkLidView& elm_offsets, kkLidView& ptcl_ids) {reportError();}
 
   private:
     void reportError() const {fprintf(stderr, "[ERROR] pumi-pic was built "
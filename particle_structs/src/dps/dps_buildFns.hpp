@@ -45,7 +45,7 @@ namespace pumipic {
    * helper function: copies element_gids and creates a map for converting in the opposite direction
    * @param[in] element_gids view of global ids for each element
    * @param[out] lid_to_gid view to copy elmGid to
-   * @param[out] gid_to_lid unordered map with elements global ids as keys and local ids as values
+   * @param[out] gid_to_lid mapping from element global ids to local ids
   */
   template<class DataTypes, typename MemSpace>
   void DPS<DataTypes, MemSpace>::createGlobalMapping(const kkGidView element_gids, kkGidView& lid_to_gid, GID_Mapping& gid_to_lid) {
@@ -53,8 +53,8 @@ namespace pumipic {
     Kokkos::parallel_for(num_elems, KOKKOS_LAMBDA(const lid_t& i) {
       const gid_t gid = element_gids(i);
       lid_to_gid(i) = gid; // deep copy
-      gid_to_lid.insert(gid, i);
     });
+    gid_to_lid.build(element_gids, num_elems);
   }
 
   /**
@@ -23,6 +23,7 @@ namespace pumipic {
 
     Kokkos::Profiling::pushRegion("DPS Rebuild");
     Kokkos::Timer overall_timer; // timer for rebuild
+    invalidateElementGroups();
 
     const auto num_new_ptcls = new_particle_elements.size();
     const auto soa_len = AoSoA_t::vector_length;
@@ -5,4 +5,5 @@
 #include <CSR.hpp>
 #include <cabm.hpp>
 #include <dps.hpp>
+#include "ps_select.hpp"
 #include "psMemberType.h"
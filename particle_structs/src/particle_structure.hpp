@@ -3,6 +3,9 @@
 #include <Segment.h>
 #include <MemberTypeLibraries.h>
 #include <psDistributor.hpp>
+#include <psMigration.hpp>
+#include <psGidMapping.hpp>
+#include <SupportKK.h>
 #ifdef PP_ENABLE_CAB
 #include "psMemberTypeCabana.h"
 #endif
@@ -15,6 +18,85 @@ namespace pumipic {
   template <class DataTypes, typename Space>
   class DPS;
 
+  /* Tag identifying the concrete particle structure
+
+     Each structure sets its tag on construction so free functions (parallel_for, copy, get)
+       can resolve the structure with a static_cast rather than a chain of dynamic_casts.
+  */
+  enum StructureType {
+    PS_UNKNOWN = 0,
+    PS_SCS,
+    PS_CSR,
+    PS_CABM,
+    PS_DPS
+  };
+
+  /* Statistics of a particle distribution used to select a particle structure
+
+     Usage:
+       auto stats = distributionStats(particles_per_element, move_rate);
+       StructureType type = selectStructure(stats);
+  */
+  struct DistributionStats {
+    lid_t num_elems;
+    lid_t num_ptcls;
+    //Largest number of particles in an element
+    lid_t max_ppe;
+    //Average number of particles in the elements with particles
+    double avg_ppe;
+    //max_ppe / avg_ppe, 1 for a uniform distribution
+    double skew;
+    //Fraction of the elements without particles
+    double empty_fraction;
+    //Fraction of the particles changing elements between rebuilds (given by the caller)
+    double move_rate;
+  };
+
+  //Computes the statistics of particles_per_element
+  template <typename ViewT>
+  DistributionStats distributionStats(ViewT particles_per_element, double move_rate = 0) {
+    DistributionStats stats;
+    stats.num_elems = particles_per_element.size();
+    stats.move_rate = move_rate;
+    lid_t num_ptcls = 0, max_ppe = 0, num_nonempty = 0;
+    Kokkos::parallel_reduce("distribution_sum", stats.num_elems,
+                            KOKKOS_LAMBDA(const lid_t& i, lid_t& sum) {
+      sum += particles_per_element(i);
+    }, num_ptcls);
+    Kokkos::parallel_reduce("distribution_max", stats.num_elems,
+                            KOKKOS_LAMBDA(const lid_t& i, lid_t& max) {
+      if (particles_per_element(i) > max)
+        max = particles_per_element(i);
+    }, Kokkos::Max<lid_t>(max_ppe));
+    Kokkos::parallel_reduce("distribution_nonempty", stats.num_elems,
+                            KOKKOS_LAMBDA(const lid_t& i, lid_t& sum) {
+      sum += particles_per_element(i) > 0;
+    }, num_nonempty);
+    stats.num_ptcls = num_ptcls;
+    stats.max_ppe = max_ppe;
+    stats.avg_ppe = num_nonempty > 0 ? num_ptcls / (double)num_nonempty : 0;
+    stats.skew = stats.avg_ppe > 0 ? max_ppe / stats.avg_ppe : 1;
+    stats.empty_fraction = stats.num_elems > 0 ?
+      (stats.num_elems - num_nonempty) / (double)stats.num_elems : 0;
+    return stats;
+  }
+
+  /* The active particles of one element given to parallel_for_elements
+
+     ptcls(i) for i in [0, ptcls.size()) is the index of the i-th particle of the element
+       in the particle structure, in index order.
+  */
+  template <typename Device>
+  struct ElementParticles {
+    PP_INLINE ElementParticles(Kokkos::View<lid_t*, Device> particle_ids, lid_t first,
+                               lid_t last) : ids(particle_ids), start(first), end(last) {}
+    PP_INLINE lid_t size() const {return end - start;}
+    PP_INLINE lid_t operator()(const lid_t i) const {return ids(start + i);}
+
+    Kokkos::View<lid_t*, Device> ids;
+    lid_t start, end;
+  };
+
   template <class DataTypes, typename Space = DefaultMemSpace>
   class ParticleStructure {
   public:
@@ -35,6 +117,9 @@ namespace pumipic {
     template <std::size_t N> using DataType =
       typename MemberTypeAtIndex<N, DataTypes>::type;
     typedef MemberTypeViews MTVs;
+    //Arguments of the functors passed to parallel_for_elements
+    typedef typename Kokkos::TeamPolicy<execution_space>::member_type TeamMember;
+    typedef ElementParticles<device_type> ElementPtcls;
     template <std::size_t N> using MTV = MemberTypeView<DataType<N>, device_type>;
 #ifdef PP_ENABLE_CAB
     //Cabana Values for defining generic slice
@@ -58,9 +143,12 @@ namespace pumipic {
 
     ParticleStructure();
     ParticleStructure(const std::string& name_);
+    ParticleStructure(StructureType type_);
+    ParticleStructure(const std::string& name_, StructureType type_);
     virtual ~ParticleStructure() {}
 
     const std::string& getName() const {return name;}
+    StructureType structureType() const {return structure_type;}
     lid_t nElems() const {return num_elems;}
     lid_t nPtcls() const {return num_ptcls;}
     lid_t capacity() const {return capacity_;}
@@ -77,10 +165,10 @@ namespace pumipic {
       if (num_ptcls == 0)
         return Slice<N>();
 #ifdef PP_ENABLE_CAB
-      if (dynamic_cast<CabM<DataTypes, Space>*>(this) != NULL)
-        return dynamic_cast<CabM<DataTypes, Space>*>(this)->template get<N>();
-      if (dynamic_cast<DPS<DataTypes, Space>*>(this) != NULL)
-        return dynamic_cast<DPS<DataTypes, Space>*>(this)->template get<N>();
+      if (structure_type == PS_CABM)
+        return static_cast<CabM<DataTypes, Space>*>(this)->template get<N>();
+      if (structure_type == PS_DPS)
+        return static_cast<DPS<DataTypes, Space>*>(this)->template get<N>();
 #endif
       MTV<N>* view = static_cast<MTV<N>*>(ptcl_data[N]);
       return Slice<N>(*view);
@@ -93,10 +181,60 @@ namespace pumipic {
                          Distributor<Space> dist = Distributor<Space>(),
                          kkLidView new_particle_elements = kkLidView(),
                          MTVs new_particle_info = NULL) = 0;
+    /* Split-phase migration
+
+       migrateBegin counts, packs and posts the particle messages and returns without
+         waiting for them. migrateEnd waits for the messages and rebuilds the structure.
+         Between the two calls the structure may be read but not modified.
+       migrate(...) is equivalent to migrateBegin(handle, ...) followed by migrateEnd(handle).
+    */
+    virtual void migrateBegin(MigrationHandle<DataTypes, Space>& handle,
+                              kkLidView new_element, kkLidView new_process,
+                              Distributor<Space> dist = Distributor<Space>(),
+                              kkLidView new_particle_elements = kkLidView(),
+                              MTVs new_particle_info = NULL) = 0;
+    virtual void migrateEnd(MigrationHandle<DataTypes, Space>& handle) = 0;
+    //Releases the arrays kept between migrations, see MigrationBuffers
+    void freeMigrationBuffers() {migration_buffers.free();}
     virtual void printMetrics() const = 0;
+
+    /* Copies the elements and data of the active particles into packed arrays
+
+       The particles are packed in parallel_for order. Used to move the particles to
+         another particle structure in bulk.
+       particle_elements - sized nPtcls(), filled with the element of each particle
+       particle_info - member views sized at least nPtcls(), filled with the particle data
+    */
+    virtual void packParticles(kkLidView particle_elements, MTVs particle_info) = 0;
+
+    /* Groups the active particles by element, see ps::groupByElement
+
+       The grouping is built from the layout of the structure on the first call and
+         reused until the next rebuild. The returned views are shared by every caller and
+         must not be modified.
+    */
+    void groupByElement(kkLidView& elm_offsets, kkLidView& ptcl_ids) {
+      if (!groups_valid) {
+        buildElementGroups(group_offsets, group_ptcls);
+        groups_valid = true;
+      }
+      elm_offsets = group_offsets;
+      ptcl_ids = group_ptcls;
+    }
+    //Builds the grouping returned by groupByElement, do not call directly
+    virtual void buildElementGroups(kkLidView& elm_offsets, kkLidView& ptcl_ids) = 0;
   protected:
+    //Releases the grouping by element, called when the particles are rebuilt
+    void invalidateElementGroups() {
+      groups_valid = false;
+      group_offsets = kkLidView();
+      group_ptcls = kkLidView();
+    }
+
     //String to identify the particle structure
     std::string name;
+    //Concrete type of the particle structure
+    StructureType structure_type;
     //Element and particle Counts/capacities
     lid_t num_elems;
     lid_t num_ptcls;
@@ -106,41 +244,123 @@ namespace pumipic {
     //Particle information
     MTVs ptcl_data;
 
+    //Arrays reused across migrations
+    MigrationBuffers<DataTypes, Space> migration_buffers;
+
+    //Grouping of the active particles by element kept between rebuilds
+    bool groups_valid;
+    kkLidView group_offsets;
+    kkLidView group_ptcls;
+
     //Number of Data types
     static constexpr std::size_t num_types = DataTypes::size;
 
     /*
       Copy a particle structure to another memory space
-      Note: if the same memory space is used then a the data is not duplicated
+      Note: the particle data is always duplicated, even within the same memory space
     */
     template <class Space2>
     void copy(Mirror<Space2>* old) {
+      copySizes(old);
+      typedef typename Mirror<Space2>::template MTV<0> OldMTV;
+      auto first_data_view = static_cast<OldMTV*>(old->ptcl_data[0]);
+      int s = first_data_view->size() / BaseType<DataType<0> >::size;
+      ptcl_data = createMemberViews<DataTypes, Space>(s);
+      CopyMemSpaceToMemSpace<Space, Space2, DataTypes>(ptcl_data, old->ptcl_data);
+    }
+    //Copy the name, type and sizes of a particle structure in another memory space
+    template <class Space2>
+    void copySizes(Mirror<Space2>* old) {
       name = old->name;
+      structure_type = old->structure_type;
       num_elems = old->num_elems;
       num_ptcls = old->num_ptcls;
       capacity_ = old->capacity_;
       num_rows = old->num_rows;
-      if (std::is_same<memory_space, typename Space2::memory_space>::value) {
-        ptcl_data = old->ptcl_data;
-      }
-      else {
-        auto first_data_view = static_cast<MTV<0>*>(old->ptcl_data[0]);
-        int s = first_data_view->size() / BaseType<DataType<0> >::size;
-        ptcl_data = createMemberViews<DataTypes, Space>(s);
-        CopyMemSpaceToMemSpace<Space, Space2, DataTypes>(ptcl_data, old->ptcl_data);
-      }
     }
     template <typename DT, typename Space2> friend class ParticleStructure;
   };
 
+  /* Computes the packed index of each active particle in parallel_for order
+     ptcl_index - sized capacity()+1, set to the packed index of each particle
+     particle_elements - sized nPtcls(), set to the element of each particle
+     Used by the structures to implement packParticles
+  */
+  template <class PS>
+  void packParticleIndices(PS* ptcls, typename PS::kkLidView ptcl_index,
+                           typename PS::kkLidView particle_elements) {
+    typename PS::kkLidView ptcl_flag("ptcl_flag", ptcls->capacity() + 1);
+    auto flagPtcls = PS_LAMBDA(const lid_t& e, const lid_t& p, const bool& mask) {
+      ptcl_flag(p) = mask;
+    };
+    ptcls->parallel_for(flagPtcls, "flagPtcls");
+    exclusive_scan(ptcl_flag, ptcl_index);
+    auto packElements = PS_LAMBDA(const lid_t& e, const lid_t& p, const bool& mask) {
+      if (mask)
+        particle_elements(ptcl_index(p)) = e;
+    };
+    ptcls->parallel_for(packElements, "packElements");
+  }
+
+  /* Groups the active particles by element from a layout that stores the slots of each
+       element together (see ps::groupByElement for elm_offsets and ptcl_ids)
+
+     The slots of element e are slot_offsets(e) to slot_offsets(e+1)-1 in index order.
+       slotPtcl(slot) returns the particle index of the slot or -1 if the slot is inactive.
+     Used by the structures to group their particles without sorting
+  */
+  template <typename ViewT, typename SlotFn>
+  void packElementGroups(lid_t ne, ViewT slot_offsets, SlotFn slotPtcl,
+                         ViewT& elm_offsets, ViewT& ptcl_ids) {
+    const lid_t nslots = getLastValue<lid_t>(slot_offsets);
+    ViewT index(Kokkos::ViewAllocateWithoutInitializing("group_index"), nslots + 1);
+    Kokkos::parallel_scan("group_index", nslots + 1,
+                          KOKKOS_LAMBDA(const lid_t& i, lid_t& cur, const bool final) {
+      if (final)
+        index(i) = cur;
+      if (i < nslots)
+        cur += slotPtcl(i) >= 0;
+    });
+    elm_offsets = ViewT(Kokkos::ViewAllocateWithoutInitializing("element_offsets"), ne + 1);
+    ViewT offs = elm_offsets;
+    Kokkos::parallel_for("group_offsets", ne + 1, KOKKOS_LAMBDA(const lid_t& e) {
+      offs(e) = index(slot_offsets(e));
+    });
+    const lid_t n = getLastValue<lid_t>(index);
+    ptcl_ids = ViewT(Kokkos::ViewAllocateWithoutInitializing("element_particles"), n);
+    ViewT ids = ptcl_ids;
+    Kokkos::parallel_for("group_pack", nslots, KOKKOS_LAMBDA(const lid_t& i) {
+      const lid_t p = slotPtcl(i);
+      if (p >= 0)
+        ids(index(i)) = p;
+    });
+  }
+
+  template <class DataTypes, typename Space>
+  ParticleStructure<DataTypes, Space>::ParticleStructure() : name("ptcls"), structure_type(PS_UNKNOWN),
+                                                             num_elems(0), num_ptcls(0),
+                                                             capacity_(0), num_rows(0),
+                                                             groups_valid(false) {
+  }
+
+  template <class DataTypes, typename Space>
+  ParticleStructure<DataTypes, Space>::ParticleStructure(const std::string& name_) : name(name_), structure_type(PS_UNKNOWN),
+                                                             num_elems(0), num_ptcls(0),
+                                                             capacity_(0), num_rows(0),
+                                                             groups_valid(false) {
+  }
+
   template <class DataTypes, typename Space>
-  ParticleStructure<DataTypes, Space>::ParticleStructure() : name("ptcls"), num_elems(0), num_ptcls(0),
-                                                             capacity_(0), num_rows(0) {
+  ParticleStructure<DataTypes, Space>::ParticleStructure(StructureType type_) : name("ptcls"), structure_type(type_),
+                                                             num_elems(0), num_ptcls(0),
+                                                             capacity_(0), num_rows(0),
+                                                             groups_valid(false) {
   }
 
   template <class DataTypes, typename Space>
-  ParticleStructure<DataTypes, Space>::ParticleStructure(const std::string& name_) : name(name_), num_elems(0), num_ptcls(0),
-                                                             capacity_(0), num_rows(0) {
+  ParticleStructure<DataTypes, Space>::ParticleStructure(const std::string& name_, StructureType type_) :
+    name(name_), structure_type(type_), num_elems(0), num_ptcls(0), capacity_(0), num_rows(0),
+    groups_valid(false) {
   }
 
 }
@@ -2,9 +2,57 @@
 
 #include <particle_structs.hpp>
 namespace pumipic {
+
+  /* Statically dispatched parallel for loops
+
+     When the concrete structure is known at compile time these overloads launch the
+       kernel directly without any runtime type resolution.
+  */
+  template <typename FunctionType, typename DataTypes, typename MemSpace>
+  void parallel_for(SellCSigma<DataTypes, MemSpace>* scs, FunctionType& fn,
+                    std::string s) {
+    scs->parallel_for(fn, s);
+  }
+  template <typename FunctionType, typename DataTypes, typename MemSpace>
+  void parallel_for(CSR<DataTypes, MemSpace>* csr, FunctionType& fn,
+                    std::string s) {
+    csr->parallel_for(fn, s);
+  }
+  template <typename FunctionType, typename DataTypes, typename MemSpace>
+  void parallel_for(CabM<DataTypes, MemSpace>* cabm, FunctionType& fn,
+                    std::string s) {
+    cabm->parallel_for(fn, s);
+  }
+  template <typename FunctionType, typename DataTypes, typename MemSpace>
+  void parallel_for(DPS<DataTypes, MemSpace>* dps, FunctionType& fn,
+                    std::string s) {
+    dps->parallel_for(fn, s);
+  }
+
+  /* Polymorphic parallel for loop
+
+     The concrete structure is resolved from the structure tag with a static_cast.
+       Structures without a tag fall back to resolving the type with dynamic_cast.
+  */
   template <typename FunctionType, typename DataTypes, typename MemSpace>
   void parallel_for(ParticleStructure<DataTypes, MemSpace>* ps, FunctionType& fn,
                     std::string s) {
+    switch (ps->structureType()) {
+    case PS_SCS:
+      static_cast<SellCSigma<DataTypes, MemSpace>*>(ps)->parallel_for(fn, s);
+      return;
+    case PS_CSR:
+      static_cast<CSR<DataTypes, MemSpace>*>(ps)->parallel_for(fn, s);
+      return;
+    case PS_CABM:
+      static_cast<CabM<DataTypes, MemSpace>*>(ps)->parallel_for(fn, s);
+      return;
+    case PS_DPS:
+      static_cast<DPS<DataTypes, MemSpace>*>(ps)->parallel_for(fn, s);
+      return;
+    default:
+      break;
+    }
     SellCSigma<DataTypes, MemSpace>* scs = dynamic_cast<SellCSigma<DataTypes, MemSpace>*>(ps);
     if (scs) {
       scs->parallel_for(fn, s);
@@ -30,15 +78,244 @@ namespace pumipic {
     throw 1;
   }
 
+  /* Statically dispatched parallel reductions
+
+     fn(elm, ptcl, update) is called for the active particles only and adds the
+       particle's contribution to update. result is a scalar or a Kokkos reducer.
+     Example usage:
+       double total;
+       auto sumWeights = PS_LAMBDA(const lid_t& e, const lid_t& p, double& update) {
+         update += weights(p);
+       };
+       ps::parallel_reduce(ptcls, sumWeights, total, "sumWeights");
+       lid_t max_elm;
+       auto maxElm = PS_LAMBDA(const lid_t& e, const lid_t& p, lid_t& update) {
+         if (e > update) update = e;
+       };
+       ps::parallel_reduce(ptcls, maxElm, Kokkos::Max<lid_t>(max_elm), "maxElm");
+  */
+  template <typename FunctionType, typename ReturnType, typename DataTypes, typename MemSpace>
+  void parallel_reduce(SellCSigma<DataTypes, MemSpace>* scs, FunctionType& fn,
+                       ReturnType&& result, std::string s) {
+    scs->parallel_reduce(fn, std::forward<ReturnType>(result), s);
+  }
+  template <typename FunctionType, typename ReturnType, typename DataTypes, typename MemSpace>
+  void parallel_reduce(CSR<DataTypes, MemSpace>* csr, FunctionType& fn,
+                       ReturnType&& result, std::string s) {
+    csr->parallel_reduce(fn, std::forward<ReturnType>(result), s);
+  }
+  template <typename FunctionType, typename ReturnType, typename DataTypes, typename MemSpace>
+  void parallel_reduce(CabM<DataTypes, MemSpace>* cabm, FunctionType& fn,
+                       ReturnType&& result, std::string s) {
+    cabm->parallel_reduce(fn, std::forward<ReturnType>(result), s);
+  }
+  template <typename FunctionType, typename ReturnType, typename DataTypes, typename MemSpace>
+  void parallel_reduce(DPS<DataTypes, MemSpace>* dps, FunctionType& fn,
+                       ReturnType&& result, std::string s) {
+    dps->parallel_reduce(fn, std::forward<ReturnType>(result), s);
+  }
+
+  /* Polymorphic parallel reduction
+
+     The concrete structure is resolved the same way as the polymorphic parallel for.
+  */
+  template <typename FunctionType, typename ReturnType, typename DataTypes, typename MemSpace>
+  void parallel_reduce(ParticleStructure<DataTypes, MemSpace>* ps, FunctionType& fn,
+                       ReturnType&& result, std::string s) {
+    switch (ps->structureType()) {
+    case PS_SCS:
+      static_cast<SellCSigma<DataTypes, MemSpace>*>(ps)->
+        parallel_reduce(fn, std::forward<ReturnType>(result), s);
+      return;
+    case PS_CSR:
+      static_cast<CSR<DataTypes, MemSpace>*>(ps)->
+        parallel_reduce(fn, std::forward<ReturnType>(result), s);
+      return;
+    case PS_CABM:
+      static_cast<CabM<DataTypes, MemSpace>*>(ps)->
+        parallel_reduce(fn, std::forward<ReturnType>(result), s);
+      return;
+    case PS_DPS:
+      static_cast<DPS<DataTypes, MemSpace>*>(ps)->
+        parallel_reduce(fn, std::forward<ReturnType>(result), s);
+      return;
+    default:
+      break;
+    }
+    SellCSigma<DataTypes, MemSpace>* scs = dynamic_cast<SellCSigma<DataTypes, MemSpace>*>(ps);
+    if (scs) {
+      scs->parallel_reduce(fn, std::forward<ReturnType>(result), s);
+      return;
+    }
+    CSR<DataTypes, MemSpace>* csr = dynamic_cast<CSR<DataTypes, MemSpace>*>(ps);
+    if (csr) {
+      csr->parallel_reduce(fn, std::forward<ReturnType>(result), s);
+      return;
+    }
+    CabM<DataTypes, MemSpace>* cabm = dynamic_cast<CabM<DataTypes, MemSpace>*>(ps);
+    if (cabm) {
+      cabm->parallel_reduce(fn, std::forward<ReturnType>(result), s);
+      return;
+    }
+    DPS<DataTypes, MemSpace>* dps = dynamic_cast<DPS<DataTypes, MemSpace>*>(ps);
+    if (dps) {
+      dps->parallel_reduce(fn, std::forward<ReturnType>(result), s);
+      return;
+    }
+    fprintf(stderr, "[ERROR] Structure does not support parallel reduce used on kernel %s\n",
+            s.c_str());
+    throw 1;
+  }
+
+  /* Groups the active particles by element
+
+     The particles of element e are ptcl_ids(elm_offsets(e)) to
+       ptcl_ids(elm_offsets(e+1)-1) in index order.
+     elm_offsets - set to a view sized nElems()+1
+     ptcl_ids - set to a view sized nPtcls()
+     Each structure builds the grouping from its own layout: CSR and CabM from their
+       element offsets and SCS from the slices of each row's chunk. DPS does not store
+       particles by element and is counting sorted. The grouping is kept by the structure
+       until its next rebuild, so the views are shared and must not be modified.
+  */
+  template <typename DataTypes, typename MemSpace>
+  void groupByElement(ParticleStructure<DataTypes, MemSpace>* ps,
+                      typename ParticleStructure<DataTypes, MemSpace>::kkLidView& elm_offsets,
+                      typename ParticleStructure<DataTypes, MemSpace>::kkLidView& ptcl_ids) {
+    ps->groupByElement(elm_offsets, ptcl_ids);
+  }
+
+  /* Element segmented exclusive scan over the active particles
+
+     fn(elm, ptcl, value) adds the particle's value to value (which starts at zero).
+       result(ptcl) is set to the sum of the values of the particles before ptcl in
+       the same element, visiting each element's particles in index order. Inactive
+       slots are set to zero. element_totals, if given (sized nElems()), is set to the
+       sum of the values in each element.
+     result - view sized capacity()
+
+     The active particles are grouped by element (see groupByElement), scanned with a
+       single flat scan and each element's base is subtracted.
+  */
+  template <typename FunctionType, typename DataTypes, typename MemSpace, typename ViewT>
+  void parallel_scan(ParticleStructure<DataTypes, MemSpace>* ps, FunctionType& fn,
+                     ViewT result, std::string s, ViewT element_totals = ViewT()) {
+    typedef typename ParticleStructure<DataTypes, MemSpace>::kkLidView kkLidView;
+    typedef typename ViewT::non_const_value_type T;
+    typedef Kokkos::View<T*, typename ParticleStructure<DataTypes, MemSpace>::device_type> TView;
+    Kokkos::Profiling::pushRegion(s);
+    const lid_t ne = ps->nElems();
+    kkLidView elm_offsets, ptcl_ids;
+    groupByElement(ps, elm_offsets, ptcl_ids);
+    const lid_t n = ptcl_ids.size();
+
+    //Evaluate each particle
+    TView slot_values("scan_slot_values", ps->capacity());
+    Kokkos::deep_copy(result, 0);
+    auto evaluate = PS_LAMBDA(const lid_t& e, const lid_t& p, const bool& mask) {
+      if (mask) {
+        T value = 0;
+        fn(e, p, value);
+        slot_values(p) = value;
+      }
+    };
+    parallel_for(ps, evaluate, s);
+
+    //Scan the grouped values and subtract the scan at the start of each element
+    TView scan(Kokkos::ViewAllocateWithoutInitializing("scan_values"), n + 1);
+    Kokkos::parallel_scan("scan_values", n + 1,
+                          KOKKOS_LAMBDA(const lid_t& i, T& cur, const bool final) {
+      if (final)
+        scan(i) = cur;
+      if (i < n)
+        cur += slot_values(ptcl_ids(i));
+    });
+    Kokkos::parallel_for("scan_result", n, KOKKOS_LAMBDA(const lid_t& i) {
+      const lid_t elm = findSegment(elm_offsets, ne, i);
+      result(ptcl_ids(i)) = scan(i) - scan(elm_offsets(elm));
+    });
+    if (element_totals.size() > 0) {
+      Kokkos::parallel_for("scan_totals", ne, KOKKOS_LAMBDA(const lid_t& e) {
+        element_totals(e) = scan(elm_offsets(e + 1)) - scan(elm_offsets(e));
+      });
+    }
+    Kokkos::Profiling::popRegion();
+  }
+
+  /* Team per element parallel for loop
+
+     fn(team, elm, ptcls) is called by one team of threads for every element, where
+       ptcls are the active particles of the element (see ElementParticles). The team
+       shares scratch_bytes of level 0 scratch memory through team.team_scratch(0).
+     Example usage computing the charge of each element without atomics:
+       auto deposit = PS_LAMBDA(const PS::TeamMember& team, const lid_t& elm,
+                                const PS::ElementPtcls& ptcls) {
+         double charge = 0;
+         Kokkos::parallel_reduce(Kokkos::TeamThreadRange(team, ptcls.size()),
+                                 [&](const lid_t& i, double& sum) {
+           sum += weights(ptcls(i));
+         }, charge);
+         Kokkos::single(Kokkos::PerTeam(team), [&]() {elm_charge(elm) = charge;});
+       };
+       ps::parallel_for_elements(ptcls, deposit, 0, "deposit");
+     The particles are grouped by element before the launch, see groupByElement. The
+       grouping is reused by the following launches until the structure is rebuilt.
+  */
+  template <typename FunctionType, typename DataTypes, typename MemSpace>
+  void parallel_for_elements(ParticleStructure<DataTypes, MemSpace>* ps, FunctionType& fn,
+                             std::size_t scratch_bytes, std::string s) {
+    typedef ParticleStructure<DataTypes, MemSpace> PS;
+    typedef typename PS::kkLidView kkLidView;
+    typedef typename PS::ElementPtcls ElementPtcls;
+    typedef Kokkos::TeamPolicy<typename PS::execution_space> PolicyType;
+    if (ps->nElems() == 0)
+      return;
+    Kokkos::Profiling::pushRegion(s);
+    kkLidView elm_offsets, ptcl_ids;
+    groupByElement(ps, elm_offsets, ptcl_ids);
+    PolicyType policy(ps->nElems(), Kokkos::AUTO);
+    policy.set_scratch_size(0, Kokkos::PerTeam(scratch_bytes));
+    Kokkos::parallel_for(s, policy, KOKKOS_LAMBDA(const typename PolicyType::member_type& team) {
+      const lid_t elm = team.league_rank();
+      const ElementPtcls ptcls(ptcl_ids, elm_offsets(elm), elm_offsets(elm + 1));
+      fn(team, elm, ptcls);
+    });
+    Kokkos::Profiling::popRegion();
+  }
+
+  /* Copy a particle structure to another memory space
+
+     The concrete structure is resolved the same way as the polymorphic parallel for.
+  */
   template <typename MSpace, typename DataTypes, typename MemSpace>
   ParticleStructure<DataTypes, MSpace>* copy(ParticleStructure<DataTypes, MemSpace>* old) {
+    switch (old->structureType()) {
+    case PS_SCS:
+      return static_cast<SellCSigma<DataTypes, MemSpace>*>(old)->template copy<MSpace>();
+    case PS_CSR:
+      return static_cast<CSR<DataTypes, MemSpace>*>(old)->template copy<MSpace>();
+    case PS_CABM:
+      return static_cast<CabM<DataTypes, MemSpace>*>(old)->template copy<MSpace>();
+    case PS_DPS:
+      return static_cast<DPS<DataTypes, MemSpace>*>(old)->template copy<MSpace>();
+    default:
+      break;
+    }
     SellCSigma<DataTypes, MemSpace>* scs = dynamic_cast<SellCSigma<DataTypes, MemSpace>*>(old);
     if (scs) {
       return scs->template copy<MSpace>();
     }
     CSR<DataTypes, MemSpace>* csr = dynamic_cast<CSR<DataTypes, MemSpace>*>(old);
     if (csr) {
-      //return csr->template copy<MSpace>();
+      return csr->template copy<MSpace>();
+    }
+    CabM<DataTypes, MemSpace>* cabm = dynamic_cast<CabM<DataTypes, MemSpace>*>(old);
+    if (cabm) {
+      return cabm->template copy<MSpace>();
+    }
+    DPS<DataTypes, MemSpace>* dps = dynamic_cast<DPS<DataTypes, MemSpace>*>(old);
+    if (dps) {
+      return dps->template copy<MSpace>();
     }
     fprintf(stderr, "[ERROR] Structure does not support copy\n");
     throw 1;
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <particle_structs.hpp>
+namespace pumipic {
+
+  /* Picks the structure expected to be fastest for the distribution
+
+     - Particles changing elements often: DPS, its rebuild only updates parent elements
+     - Strongly peaked distributions: SCS, sorting and vertical slicing balance the rows
+     - Few particles per element: CSR, each element reserves elem_padding extra slots
+       (at least one, also for empty elements) instead of CabM's partially filled SoAs
+     - Few particles over the whole mesh: SCS, sorting moves the empty rows into chunks
+       without slots while CSR reserves a padding slot for every element
+     - Many particles per element: CabM, each element fills whole SoAs
+     Without Cabana DPS and CabM are replaced by SCS.
+  */
+  inline StructureType selectStructure(const DistributionStats& stats) {
+    const double high_move_rate = 0.5;
+    const double high_skew = 4;
+    //At 32 particles CSR reserves about 4 extra slots per element, still below a
+    //partially filled SoA, so the per element padding does not move this threshold
+    const double low_avg_ppe = 32;
+    //Particles per element over all elements, below 2 the padding slots of the
+    //elements are more than a third of CSR's storage
+    const double low_mesh_ppe = 2;
+#ifdef PP_ENABLE_CAB
+    if (stats.move_rate > high_move_rate)
+      return PS_DPS;
+#endif
+    if (stats.skew > high_skew)
+      return PS_SCS;
+    if (stats.avg_ppe < low_avg_ppe) {
+      if (stats.num_ptcls < low_mesh_ppe * stats.num_elems)
+        return PS_SCS;
+      return PS_CSR;
+    }
+#ifdef PP_ENABLE_CAB
+    return PS_CABM;
+#else
+    return PS_SCS;
+#endif
+  }
+
+  /* Constructs a particle structure of the given type
+     SCS is constructed with its C, sigma and V autotuned.
+     name - string identification given to the structure
+  */
+  template <class DataTypes, typename MemSpace>
+  ParticleStructure<DataTypes, MemSpace>* createParticleStructure(
+      StructureType type, Kokkos::TeamPolicy<typename MemSpace::execution_space>& policy,
+      lid_t num_elems, lid_t num_ptcls,
+      typename ParticleStructure<DataTypes, MemSpace>::kkLidView particles_per_element,
+      typename ParticleStructure<DataTypes, MemSpace>::kkGidView element_gids,
+      typename ParticleStructure<DataTypes, MemSpace>::kkLidView particle_elements =
+        typename ParticleStructure<DataTypes, MemSpace>::kkLidView(),
+      typename ParticleStructure<DataTypes, MemSpace>::MTVs particle_info = NULL,
+      std::string name = "ptcls") {
+    switch (type) {
+    case PS_SCS: {
+      SCS_Input<DataTypes, MemSpace> input(policy, INT_MAX, 32, num_elems, num_ptcls,
+                                           particles_per_element, element_gids,
+                                           particle_elements, particle_info);
+      input.autotune = true;
+      input.name = name;
+      return new SellCSigma<DataTypes, MemSpace>(input);
+    }
+    case PS_CSR: {
+      CSR_Input<DataTypes, MemSpace> input(policy, num_elems, num_ptcls, particles_per_element,
+                                           element_gids, particle_elements, particle_info);
+      input.name = name;
+      return new CSR<DataTypes, MemSpace>(input);
+    }
+#ifdef PP_ENABLE_CAB
+    case PS_CABM: {
+      CabM_Input<DataTypes, MemSpace> input(policy, num_elems, num_ptcls, particles_per_element,
+                                            element_gids, particle_elements, particle_info);
+      input.name = name;
+      return new CabM<DataTypes, MemSpace>(input);
+    }
+    case PS_DPS: {
+      DPS_Input<DataTypes, MemSpace> input(policy, num_elems, num_ptcls, particles_per_element,
+                                           element_gids, particle_elements, particle_info);
+      input.name = name;
+      return new DPS<DataTypes, MemSpace>(input);
+    }
+#endif
+    default:
+      break;
+    }
+    fprintf(stderr, "[ERROR] Structure type %d can not be constructed\n", type);
+    throw 1;
+    return NULL;
+  }
+
+  /* Constructs the particle structure selected for particles_per_element
+     move_rate - expected fraction of particles changing elements between rebuilds
+     name - string identification given to the structure
+  */
+  template <class DataTypes, typename MemSpace>
+  ParticleStructure<DataTypes, MemSpace>* createAdaptiveStructure(
+      Kokkos::TeamPolicy<typename MemSpace::execution_space>& policy,
+      lid_t num_elems, lid_t num_ptcls,
+      typename ParticleStructure<DataTypes, MemSpace>::kkLidView particles_per_element,
+      typename ParticleStructure<DataTypes, MemSpace>::kkGidView element_gids,
+      typename ParticleStructure<DataTypes, MemSpace>::kkLidView particle_elements =
+        typename ParticleStructure<DataTypes, MemSpace>::kkLidView(),
+      typename ParticleStructure<DataTypes, MemSpace>::MTVs particle_info = NULL,
+      double move_rate = 0, std::string name = "ptcls") {
+    const StructureType type = selectStructure(distributionStats(particles_per_element,
+                                                                 move_rate));
+    return createParticleStructure<DataTypes, MemSpace>(type, policy, num_elems, num_ptcls,
+                                                        particles_per_element, element_gids,
+                                                        particle_elements, particle_info, name);
+  }
+
+  /* Moves the particles of ptcls into a new structure of the given type
+
+     The particles are packed once and the new structure is constructed from them.
+       ptcls is deleted and the new structure, keeping the name of ptcls, is returned.
+     element_gids - the global ids of the elements ptcls was constructed with
+  */
+  template <class DataTypes, typename MemSpace>
+  ParticleStructure<DataTypes, MemSpace>* switchStructure(
+      ParticleStructure<DataTypes, MemSpace>* ptcls, StructureType type,
+      Kokkos::TeamPolicy<typename MemSpace::execution_space>& policy,
+      typename ParticleStructure<DataTypes, MemSpace>::kkGidView element_gids) {
+    typedef typename ParticleStructure<DataTypes, MemSpace>::kkLidView kkLidView;
+    if (ptcls->structureType() == type)
+      return ptcls;
+    Kokkos::Profiling::pushRegion("switch_structure");
+    const lid_t num_elems = ptcls->nElems();
+    const lid_t num_ptcls = ptcls->nPtcls();
+    kkLidView particle_elements("particle_elements", num_ptcls);
+    MemberTypeViews particle_info = createMemberViews<DataTypes, MemSpace>(num_ptcls);
+    ptcls->packParticles(particle_elements, particle_info);
+    kkLidView particles_per_element("particles_per_element", num_elems);
+    Kokkos::parallel_for("count_ppe", num_ptcls, KOKKOS_LAMBDA(const lid_t& i) {
+      Kokkos::atomic_increment(&particles_per_element(particle_elements(i)));
+    });
+    const std::string name = ptcls->getName();
+    delete ptcls;
+    ParticleStructure<DataTypes, MemSpace>* new_ptcls =
+      createParticleStructure<DataTypes, MemSpace>(type, policy, num_elems, num_ptcls,
+                                                   particles_per_element, element_gids,
+                                                   particle_elements, particle_info, name);
+    destroyViews<DataTypes, MemSpace>(particle_info);
+    Kokkos::Profiling::popRegion();
+    return new_ptcls;
+  }
+
+  /* Switches ptcls to the structure selected for its current distribution
+
+     Meant to be called after a rebuild or migrate. Returns ptcls if the selected
+       structure is the current one, otherwise see switchStructure.
+     move_rate - fraction of particles that changed elements in the last rebuild
+  */
+  template <class DataTypes, typename MemSpace>
+  ParticleStructure<DataTypes, MemSpace>* adaptStructure(
+      ParticleStructure<DataTypes, MemSpace>* ptcls,
+      Kokkos::TeamPolicy<typename MemSpace::execution_space>& policy,
+      typename ParticleStructure<DataTypes, MemSpace>::kkGidView element_gids,
+      double move_rate = 0) {
+    typename ParticleStructure<DataTypes, MemSpace>::kkLidView
+      particles_per_element("particles_per_element", ptcls->nElems());
+    auto countPtcls = PS_LAMBDA(const lid_t& e, const lid_t& p, const bool& mask) {
+      if (mask)
+        Kokkos::atomic_increment(&particles_per_element(e));
+    };
+    parallel_for(ptcls, countPtcls, "countPtcls");
+    const StructureType type = selectStructure(distributionStats(particles_per_element,
+                                                                 move_rate));
+    return switchStructure(ptcls, type, policy, element_gids);
+  }
+}
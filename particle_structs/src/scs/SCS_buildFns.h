@@ -100,8 +100,8 @@ namespace pumipic {
     Kokkos::parallel_for(num_elems, KOKKOS_LAMBDA(const lid_t& i) {
       const gid_t gid = elmGid(i);
       elm2Gid(i) = gid;
-      elmGid2Lid.insert(gid, i);
     });
+    elmGid2Lid.build(elmGid, num_elems);
     Kokkos::parallel_for(Kokkos::RangePolicy<>(num_elems, numRows()), KOKKOS_LAMBDA(const lid_t& i) {
       elm2Gid(i) = -1;
     });
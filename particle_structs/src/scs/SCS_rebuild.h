@@ -4,6 +4,7 @@ namespace pumipic {
     bool SellCSigma<DataTypes,MemSpace>::reshuffle(kkLidView new_element,
                                                    kkLidView new_particle_elements,
                                                    MTVs new_particles) {
+    invalidateElementGroups();
     //Count current/new particles per row
     kkLidView new_particles_per_row("new_particles_per_row", numRows()+1);
     kkLidView num_holes_per_row("num_holes_per_row", numRows());
@@ -125,6 +126,7 @@ namespace pumipic {
                                                  MTVs new_particles) {
     const auto btime = prebarrier();
     Kokkos::Profiling::pushRegion("scs_rebuild");
+    invalidateElementGroups();
     int comm_rank, comm_size;
     MPI_Comm_rank(MPI_COMM_WORLD, &comm_rank);
     MPI_Comm_size(MPI_COMM_WORLD, &comm_size);
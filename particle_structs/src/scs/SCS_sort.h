@@ -8,8 +8,8 @@ namespace pumipic {
     //Make temporary copy of the particle counts for sorting
     ptcl_pairs = PairView("ptcl_pairs", num_elems);
     if (sigma > 1) {
-      lid_t i;
 #ifdef PP_USE_CUDA
+      lid_t i;
       Kokkos::View<lid_t*, typename MemSpace::device_type> elem_ids("elem_ids", num_elems);
       Kokkos::View<lid_t*, typename MemSpace::device_type> temp_ppe("temp_ppe", num_elems);
       Kokkos::parallel_for(num_elems, KOKKOS_LAMBDA(const lid_t& i) {
@@ -31,13 +31,43 @@ namespace pumipic {
         ptcl_pairs(i).first = ptcls_per_elem(i);
         ptcl_pairs(i).second = i;
       });
-      typename PairView::HostMirror ptcl_pairs_host = deviceToHost(ptcl_pairs);
+      //Sort the sigma sized chunks in parallel on the host, the pairs are only
+      //  copied if they are not accessible from the host
+      typedef Kokkos::DefaultHostExecutionSpace HostExecSpace;
+      Kokkos::fence();
+      auto ptcl_pairs_host = Kokkos::create_mirror_view_and_copy(Kokkos::HostSpace(), ptcl_pairs);
       MyPair* ptcl_pair_data = ptcl_pairs_host.data();
-      for (i = 0; i < num_elems - sigma; i+=sigma) {
-        std::sort(ptcl_pair_data + i, ptcl_pair_data + i + sigma);
+      const lid_t num_chunks = num_elems / sigma + (num_elems % sigma != 0);
+      const lid_t chunk_size = std::min(sigma, num_elems);
+      const lid_t per_thread = num_elems / HostExecSpace().concurrency() + 1;
+      if (chunk_size >= 2048 && chunk_size > 4 * per_thread) {
+        //Few chunks much larger than the share of a thread (a single chunk for full
+        //  sorting), each chunk is sorted by all threads with the chunk sort and merge
+        std::vector<MyPair> buffer(chunk_size);
+        auto byCount = [](const MyPair& a, const MyPair& b) {return a < b;};
+        for (lid_t chunk = 0; chunk < num_chunks; ++chunk) {
+          MyPair* start = ptcl_pair_data + chunk * sigma;
+          const lid_t n = std::min(sigma, num_elems - chunk * sigma);
+          MyPair* sorted = host_chunk_sort(start, buffer.data(), n, byCount);
+          if (sorted != start) {
+            Kokkos::parallel_for("sigma_sort_copy", Kokkos::RangePolicy<HostExecSpace>(0, n),
+                                 [=](const lid_t& i) {
+              start[i] = sorted[i];
+            });
+            HostExecSpace().fence();
+          }
+        }
+      }
+      else {
+        Kokkos::parallel_for("sigma_sort", Kokkos::RangePolicy<HostExecSpace>(0, num_chunks),
+                             [=](const lid_t& chunk) {
+          const lid_t start = chunk * sigma;
+          const lid_t end = std::min(start + sigma, num_elems);
+          std::sort(ptcl_pair_data + start, ptcl_pair_data + end);
+        });
+        HostExecSpace().fence();
       }
-      std::sort(ptcl_pair_data + i, ptcl_pair_data + num_elems);
-      hostToDevice(ptcl_pairs,  ptcl_pair_data);
+      Kokkos::deep_copy(ptcl_pairs, ptcl_pairs_host);
 #endif
     }
     else {
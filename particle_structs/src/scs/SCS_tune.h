@@ -0,0 +1,105 @@
+#pragma once
+namespace pumipic {
+  /* Chooses C, sigma and V for the particles per element
+
+     Every candidate configuration is laid out (sorting, chunking and offsets only) and
+       scored by the best of a few timed runs of a kernel that visits every slot of the
+       layout the same way parallel_for does. Layouts whose capacity is more than
+       tune_max_padding times the smallest capacity are not considered.
+     The chosen configuration replaces C_max, sigma and V_ so rebuilds reuse it.
+  */
+  template<class DataTypes, typename MemSpace>
+  void SellCSigma<DataTypes, MemSpace>::autotune(kkLidView ptcls_per_elem) {
+    Kokkos::Profiling::pushRegion("scs_autotune");
+    const double tune_max_padding = 1.5;
+    const int tune_runs = 3;
+    struct Candidate {
+      lid_t C, sigma, V, capacity;
+      double time;
+    };
+    std::vector<Candidate> candidates;
+
+    //Halve the policy's chunk height down to a quarter of it
+    std::vector<lid_t> c_values;
+    for (lid_t c = policy.team_size(); c >= 1 && c_values.size() < 3; c /= 2) {
+      const lid_t C = chooseChunkHeight(c, ptcls_per_elem);
+      if (c_values.empty() || c_values.back() != C)
+        c_values.push_back(C);
+    }
+    const lid_t v_values[] = {16, 32, 64, 128};
+    const lid_t num_v_values = sizeof(v_values) / sizeof(lid_t);
+
+    for (std::size_t i = 0; i < c_values.size(); ++i) {
+      C_ = c_values[i];
+      //No sorting, sorting windows of a few chunks and full sorting
+      std::vector<lid_t> sigma_values(1, 1);
+      if (16 * C_ < num_elems)
+        sigma_values.push_back(16 * C_);
+      sigma_values.push_back(INT_MAX);
+      for (std::size_t j = 0; j < sigma_values.size(); ++j) {
+        PairView ptcls;
+        sigmaSort(ptcls, num_elems, ptcls_per_elem, sigma_values[j]);
+        lid_t nchunks;
+        kkLidView chunk_widths, row_element, element_row;
+        constructChunks(ptcls, nchunks, chunk_widths, row_element, element_row);
+        for (lid_t k = 0; k < num_v_values; ++k) {
+          V_ = v_values[k];
+          lid_t nslices, cap;
+          kkLidView offs, s2c;
+          constructOffsets(nchunks, nslices, chunk_widths, offs, s2c, cap);
+
+          //Time a kernel over every slot of the layout
+          Kokkos::View<double*, device_type> slots("tune_slots", cap);
+          const lid_t team_size = C_;
+          const PolicyType tune_policy(nslices, team_size);
+          double best_time = -1;
+          for (int run = 0; run <= tune_runs; ++run) {
+            Kokkos::fence();
+            Kokkos::Timer timer;
+            Kokkos::parallel_for("tune_slots", tune_policy,
+                                 KOKKOS_LAMBDA(const typename PolicyType::member_type& thread) {
+              const lid_t slice = thread.league_rank();
+              const lid_t slice_row = thread.team_rank();
+              const lid_t rowLen = (offs(slice+1)-offs(slice))/team_size;
+              const lid_t start = offs(slice) + slice_row;
+              Kokkos::parallel_for(Kokkos::ThreadVectorRange(thread, rowLen), [=] (lid_t& p) {
+                slots(start + p * team_size) += 1.0;
+              });
+            });
+            Kokkos::fence();
+            const double time = timer.seconds();
+            //The first run warms up the kernel
+            if (run > 0 && (best_time < 0 || time < best_time))
+              best_time = time;
+          }
+          Candidate cand = {C_, sigma_values[j], V_, cap, best_time};
+          candidates.push_back(cand);
+        }
+      }
+    }
+
+    lid_t min_capacity = candidates[0].capacity;
+    for (std::size_t i = 1; i < candidates.size(); ++i)
+      min_capacity = std::min(min_capacity, candidates[i].capacity);
+    std::size_t best = 0;
+    bool found = false;
+    for (std::size_t i = 0; i < candidates.size(); ++i) {
+      if (candidates[i].capacity > tune_max_padding * min_capacity)
+        continue;
+      if (!found || candidates[i].time < candidates[best].time)
+        best = i;
+      found = true;
+    }
+    C_max = candidates[best].C;
+    sigma = candidates[best].sigma;
+    V_ = candidates[best].V;
+
+    int comm_rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &comm_rank);
+    if (!comm_rank)
+      fprintf(stderr, "Autotuned SCS from %d configurations to C: %d sigma: %d V: %d "
+              "(capacity %d, %.3e s)\n", (int)candidates.size(), C_max, sigma, V_,
+              candidates[best].capacity, candidates[best].time);
+    Kokkos::Profiling::popRegion();
+  }
+}
@@ -8,7 +8,6 @@
 #include <unordered_map>
 #include <climits>
 #include <ppAssert.h>
-#include <Kokkos_UnorderedMap.hpp>
 #include <Kokkos_Pair.hpp>
 #include <Kokkos_Sort.hpp>
 #include "SCSPair.h"
@@ -50,7 +49,7 @@ template <std::size_t N> using Slice = Segment<DataType<N>, device_type>;
 #endif
   typedef Kokkos::TeamPolicy<execution_space> PolicyType;
   typedef Kokkos::View<MyPair*, device_type> PairView;
-  typedef Kokkos::UnorderedMap<gid_t, lid_t, device_type> GID_Mapping;
+  typedef GidMapping<device_type> GID_Mapping;
   typedef SCS_Input<DataTypes, MemSpace> Input_T;
 
   SellCSigma() = delete;
@@ -104,6 +103,16 @@ template <std::size_t N> using Slice = Segment<DataType<N>, device_type>;
                kkLidView new_particle_elements = kkLidView(),
                MTVs new_particle_info = NULL);
 
+  /* Split-phase migrate, see ParticleStructure::migrateBegin
+     The SCS must not be modified until migrateEnd is called with the same handle
+  */
+  void migrateBegin(MigrationHandle<DataTypes, MemSpace>& handle,
+                    kkLidView new_element, kkLidView new_process,
+                    Distributor<MemSpace> dist = Distributor<MemSpace>(),
+                    kkLidView new_particle_elements = kkLidView(),
+                    MTVs new_particle_info = NULL);
+  void migrateEnd(MigrationHandle<DataTypes, MemSpace>& handle);
+
   /*
     Reshuffles the scs values to the element in new_element[i]
     Calls rebuild if there is not enough space for the shuffle
@@ -139,14 +148,35 @@ template <std::size_t N> using Slice = Segment<DataType<N>, device_type>;
   template <typename FunctionType, class U = MemSpace>
   typename std::enable_if<!std::is_same<typename U::execution_space, Kokkos::Serial>::value>::type parallel_for(FunctionType& fn, std::string s="");
 
+  /*
+    Performs a parallel reduction over the active particles in the SCS
+    The passed in functor/lambda should take in 3 arguments (int elm_id, int ptcl_id, T& update)
+      and is only called for active particles
+    result - a scalar of type T or a Kokkos reducer (Kokkos::Sum, Kokkos::Max, ...)
+    Example usage with lambda:
+    auto lamb = PS_LAMBDA(const int& elm_id, const int& ptcl_id, double& update) {
+      update += weight(ptcl_id);
+    };
+    ps::parallel_reduce(scs, lamb, total, name);
+  */
+  template <typename FunctionType, typename ReturnType>
+  void parallel_reduce(FunctionType& fn, ReturnType&& result, std::string s="");
+
   //Prints the format of the SCS labeled by prefix
   void printFormat(const char* prefix = "") const;
 
   //Prints metrics of the SCS
   void printMetrics() const;
 
+  //Copies the active particles into packed arrays, see ParticleStructure::packParticles
+  void packParticles(kkLidView particle_elements, MTVs particle_info);
+
+  //Groups the active particles by element from the rows, see ps::groupByElement
+  void buildElementGroups(kkLidView& elm_offsets, kkLidView& ptcl_ids);
+
   //Do not call these functions:
   int chooseChunkHeight(int maxC, kkLidView ptcls_per_elem);
+  void autotune(kkLidView ptcls_per_elem);
   void sigmaSort(PairView& ptcl_pairs, lid_t num_elems,
                  kkLidView ptcls_per_elem, lid_t sigma);
   void constructChunks(PairView ptcls, lid_t& nchunks,
@@ -170,13 +200,15 @@ template <std::size_t N> using Slice = Segment<DataType<N>, device_type>;
   using ParticleStructure<DataTypes, MemSpace>::capacity_;
   using ParticleStructure<DataTypes, MemSpace>::num_rows;
   using ParticleStructure<DataTypes, MemSpace>::ptcl_data;
+  using ParticleStructure<DataTypes, MemSpace>::migration_buffers;
+  using ParticleStructure<DataTypes, MemSpace>::invalidateElementGroups;
   using ParticleStructure<DataTypes, MemSpace>::num_types;
 
   //The User defined kokkos policy
   PolicyType policy;
   //Chunk size
   lid_t C_;
-  //Max Chunk size from policy
+  //Max Chunk size from policy (or the autotuned chunk size)
   lid_t C_max;
   //Vertical slice size
   lid_t V_;
@@ -216,6 +248,8 @@ template <std::size_t N> using Slice = Segment<DataType<N>, device_type>;
   bool always_realloc;
   //True - try shuffling every rebuild, false - only rebuild
   bool tryShuffling;
+  //True - choose C, sigma and V on construction
+  bool autotuning;
   //Metric Info
   lid_t num_empty_elements;
 
@@ -226,7 +260,7 @@ template <std::size_t N> using Slice = Segment<DataType<N>, device_type>;
                  MTVs particle_info);
   void destroy();
 
-  SellCSigma(lid_t Cmax) : ParticleStructure<DataTypes, MemSpace>(), policy(PolicyType(1000,Cmax)) {};
+  SellCSigma(lid_t Cmax) : ParticleStructure<DataTypes, MemSpace>(PS_SCS), policy(PolicyType(1000,Cmax)) {};
 
 };
 
@@ -243,6 +277,8 @@ void SellCSigma<DataTypes, MemSpace>::construct(kkLidView ptcls_per_elem,
   MPI_Comm_rank(MPI_COMM_WORLD, &comm_rank);
 
   C_max = policy.team_size();
+  if (autotuning)
+    autotune(ptcls_per_elem);
   C_ = chooseChunkHeight(C_max, ptcls_per_elem);
 
   if(!comm_rank)
@@ -292,7 +328,7 @@ SellCSigma<DataTypes, MemSpace>::SellCSigma(PolicyType& p, lid_t sig, lid_t v, l
                                             kkGidView element_gids,
                                             kkLidView particle_elements,
                                             MTVs particle_info) :
-  ParticleStructure<DataTypes, MemSpace>(), policy(p), element_gid_to_lid(ne) {
+  ParticleStructure<DataTypes, MemSpace>(PS_SCS), policy(p) {
   //Set variables
   sigma = sig;
   V_ = v;
@@ -303,13 +339,13 @@ SellCSigma<DataTypes, MemSpace>::SellCSigma(PolicyType& p, lid_t sig, lid_t v, l
   minimize_size = 0.8;
   always_realloc = false;
   pad_strat = PAD_EVENLY;
+  autotuning = false;
   construct(ptcls_per_elem, element_gids, particle_elements, particle_info);
 }
 
 template<class DataTypes, typename MemSpace>
 SellCSigma<DataTypes, MemSpace>::SellCSigma(Input_T& input) :
-    ParticleStructure<DataTypes, MemSpace>(input.name), policy(input.policy),
-    element_gid_to_lid(input.ne) {
+    ParticleStructure<DataTypes, MemSpace>(input.name, PS_SCS), policy(input.policy) {
   sigma = input.sig;
   V_ = input.V;
   num_elems = input.ne;
@@ -319,6 +355,7 @@ SellCSigma<DataTypes, MemSpace>::SellCSigma(Input_T& input) :
   minimize_size = input.minimize_size;
   pad_strat = input.padding_strat;
   always_realloc = input.always_realloc;
+  autotuning = input.autotune;
   construct(input.ppe, input.e_gids, input.particle_elms, input.p_info);
 }
 
@@ -355,10 +392,11 @@ SellCSigma<DataTypes, MemSpace>::Mirror<MSpace>* SellCSigma<DataTypes, MemSpace>
   mirror_copy->minimize_size = minimize_size;
   mirror_copy->always_realloc = always_realloc;
   mirror_copy->tryShuffling = tryShuffling;
+  mirror_copy->autotuning = autotuning;
   mirror_copy->num_empty_elements = num_empty_elements;
 
   //Create the swap space
-  mirror_copy->scs_data_swap = createMemberViews<DataTypes, memory_space>(swap_size);
+  mirror_copy->scs_data_swap = createMemberViews<DataTypes, MSpace>(swap_size);
   //Deep copy each view
   mirror_copy->slice_to_chunk = typename Mirror<MSpace>::kkLidView("mirror slice_to_chunk",
                                                                    slice_to_chunk.size());
@@ -378,10 +416,61 @@ SellCSigma<DataTypes, MemSpace>::Mirror<MSpace>* SellCSigma<DataTypes, MemSpace>
                                                                    element_to_gid.size());
   Kokkos::deep_copy(mirror_copy->element_to_gid, element_to_gid);
   //Deep copy the gid mapping
-  mirror_copy->element_gid_to_lid.create_copy_view(element_gid_to_lid);
+  mirror_copy->element_gid_to_lid.copy(element_gid_to_lid);
   return mirror_copy;
 }
 
+template<class DataTypes, typename MemSpace>
+void SellCSigma<DataTypes, MemSpace>::packParticles(kkLidView particle_elements,
+                                                    MTVs particle_info) {
+  kkLidView ptcl_index("ptcl_index", capacity_ + 1);
+  packParticleIndices(this, ptcl_index, particle_elements);
+  //Copy every active particle, ps_to_array never matches the rank
+  kkLidView ps_to_array("ps_to_array", capacity_);
+  Kokkos::deep_copy(ps_to_array, -1);
+  CopyParticlesToSend<SellCSigma<DataTypes, MemSpace>, DataTypes>(this, particle_info,
+                                                                  ptcl_data, ps_to_array,
+                                                                  ptcl_index);
+}
+
+template<class DataTypes, typename MemSpace>
+void SellCSigma<DataTypes, MemSpace>::buildElementGroups(kkLidView& elm_offsets,
+                                                         kkLidView& ptcl_ids) {
+  //The slices of a chunk are contiguous, so the slots of a row are strided by C
+  //  from the start of its chunk to the end of the chunk's last slice
+  kkLidView chunk_begin("chunk_begin", num_chunks);
+  kkLidView chunk_end("chunk_end", num_chunks);
+  auto offsets_cpy = offsets;
+  auto slice_to_chunk_cpy = slice_to_chunk;
+  const lid_t nslices = num_slices;
+  Kokkos::parallel_for("group_chunk_bounds", nslices, KOKKOS_LAMBDA(const lid_t& slice) {
+    const lid_t chunk = slice_to_chunk_cpy(slice);
+    if (slice == 0 || slice_to_chunk_cpy(slice - 1) != chunk)
+      chunk_begin(chunk) = offsets_cpy(slice);
+    if (slice == nslices - 1 || slice_to_chunk_cpy(slice + 1) != chunk)
+      chunk_end(chunk) = offsets_cpy(slice + 1);
+  });
+  const lid_t team_size = C_;
+  const lid_t ne = num_elems;
+  auto element_to_row_cpy = element_to_row;
+  kkLidView row_slots("row_slots", ne + 1);
+  Kokkos::parallel_for("group_row_slots", ne, KOKKOS_LAMBDA(const lid_t& elm) {
+    const lid_t chunk = element_to_row_cpy(elm) / team_size;
+    row_slots(elm) = (chunk_end(chunk) - chunk_begin(chunk)) / team_size;
+  });
+  kkLidView slot_offsets("slot_offsets", ne + 1);
+  exclusive_scan(row_slots, slot_offsets);
+  auto particle_mask_cpy = particle_mask;
+  auto slotPtcl = KOKKOS_LAMBDA(const lid_t& slot) -> lid_t {
+    const lid_t elm = findSegment(slot_offsets, ne, slot);
+    const lid_t row = element_to_row_cpy(elm);
+    const lid_t particle_id = chunk_begin(row / team_size) + row % team_size +
+      (slot - slot_offsets(elm)) * team_size;
+    return particle_mask_cpy(particle_id) ? particle_id : -1;
+  };
+  packElementGroups(ne, slot_offsets, slotPtcl, elm_offsets, ptcl_ids);
+}
+
 
 template<class DataTypes, typename MemSpace>
 void SellCSigma<DataTypes, MemSpace>::destroy() {
@@ -580,10 +669,44 @@ SellCSigma<DataTypes, MemSpace>::parallel_for(FunctionType& fn, std::string name
   }
 }
 
+template <class DataTypes, typename MemSpace>
+template <typename FunctionType, typename ReturnType>
+void SellCSigma<DataTypes, MemSpace>::parallel_reduce(FunctionType& fn, ReturnType&& result,
+                                                      std::string name) {
+  typedef typename ReduceValueType<typename std::decay<ReturnType>::type>::type ValueType;
+  FunctionType* fn_d;
+#ifdef PP_USE_CUDA
+  cudaMalloc(&fn_d, sizeof(FunctionType));
+  cudaMemcpy(fn_d,&fn, sizeof(FunctionType), cudaMemcpyHostToDevice);
+#else
+  fn_d = &fn;
+#endif
+  //Each slot finds its slice and row so padding is skipped without a team per slice
+  const lid_t team_size = C_;
+  const lid_t nslices = num_slices;
+  auto offsets_cpy = offsets;
+  auto slice_to_chunk_cpy = slice_to_chunk;
+  auto row_to_element_cpy = row_to_element;
+  auto particle_mask_cpy = particle_mask;
+  Kokkos::parallel_reduce(name, Kokkos::RangePolicy<execution_space>(0, capacity_),
+                          KOKKOS_LAMBDA(const lid_t& particle_id, ValueType& update) {
+    if (particle_mask_cpy(particle_id)) {
+      const lid_t slice = findSegment(offsets_cpy, nslices, particle_id);
+      const lid_t slice_row = (particle_id - offsets_cpy(slice)) % team_size;
+      const lid_t row = slice_to_chunk_cpy(slice) * team_size + slice_row;
+      (*fn_d)(row_to_element_cpy(row), particle_id, update);
+    }
+  }, std::forward<ReturnType>(result));
+#ifdef PP_USE_CUDA
+  cudaFree(fn_d);
+#endif
+}
+
 } // end namespace pumipic
 
 //Seperate files with SCS member function implementations
 #include "SCS_sort.h"
+#include "SCS_tune.h"
 #include "SCS_buildFns.h"
 #include "SCS_rebuild.h"
 #include "SCS_migrate.h"
@@ -35,6 +35,10 @@ namespace pumipic {
     //Padding strategy
     PaddingStrategy padding_strat = PAD_EVENLY;
 
+    //True - choose C (up to the policy's team size), sigma and V by timing candidate
+    //  layouts of the structure, the given sigma and V are ignored [default = false]
+    bool autotune = false;
+
     //String identification for the particle structure
     std::string name;
 
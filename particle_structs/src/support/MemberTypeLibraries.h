@@ -77,6 +77,19 @@ namespace pumipic {
                                              MPI_Comm, ArrayOfRequests);
    */
   template <typename Device, typename... Types> struct RecvViews;
+  /* PackViews<Device, DataTypes> - packs an element view and member views into one byte
+                                    buffer with all values of an entry stored contiguously
+       Usage: PackViews<Device, MemberTypes>(ElementView, MemberTypeViews, numberOfEntries,
+                                             ByteBuffer);
+       Note: Entry i starts at byte i * packedEntrySize<MemberTypes>()
+   */
+  template <typename Device, typename... Types> struct PackViews;
+  /* UnpackViews<Device, DataTypes> - unpacks a buffer filled by PackViews into an element
+                                      view and member views
+       Usage: UnpackViews<Device, MemberTypes>(ByteBuffer, numberOfEntries, ElementView,
+                                               MemberTypeViews);
+   */
+  template <typename Device, typename... Types> struct UnpackViews;
   /* CopyMemSpaceToMemSpace<DestinationMemSpace, SourceMemSpace, DataTypes> -
            Copies Member type views from one memory space to another memory space
       Usage: CopyMSpaceToMSpace<DestinationMemSpace, SourceMemSpace, MemberTypes>(DestinationMTV,
@@ -297,6 +310,101 @@ namespace pumipic {
     }
   };
 
+  //Number of bytes of one entry in a buffer filled by PackViews
+  template <typename DataTypes>
+  constexpr std::size_t packedEntrySize() {return sizeof(lid_t) + DataTypes::memsize;}
+
+  //Byte copies for values at unaligned positions of a packed buffer
+  template <typename T>
+  PP_INLINE void packBytes(char* dst, const T& val) {
+    const char* src = reinterpret_cast<const char*>(&val);
+    for (std::size_t b = 0; b < sizeof(T); ++b)
+      dst[b] = src[b];
+  }
+  template <typename T>
+  PP_INLINE void unpackBytes(T& val, const char* src) {
+    char* dst = reinterpret_cast<char*>(&val);
+    for (std::size_t b = 0; b < sizeof(T); ++b)
+      dst[b] = src[b];
+  }
+
+  //Pack Views Templated Struct
+  //  Member views are LayoutLeft, component c of entry i is at data()[i + extent(0) * c]
+  template <typename Device, typename... Types> struct PackViewsImpl;
+  template <typename Device> struct PackViewsImpl<Device> {
+    PackViewsImpl(MemberTypeViewsConst, int, Kokkos::View<char*, Device>,
+                  std::size_t, std::size_t) {}
+  };
+  template <typename Device, typename T, typename... Types> struct PackViewsImpl<Device, T, Types...> {
+    PackViewsImpl(MemberTypeViewsConst views, int size, Kokkos::View<char*, Device> buffer,
+                  std::size_t entry_size, std::size_t offset) {
+      enclose(views, size, buffer, entry_size, offset);
+    }
+    void enclose(MemberTypeViewsConst views, int size, Kokkos::View<char*, Device> buffer,
+                 std::size_t entry_size, std::size_t offset) {
+      typedef typename BaseType<T>::type BT;
+      const int ncomp = BaseType<T>::size;
+      MemberTypeView<T, Device> src = *static_cast<MemberTypeView<T, Device> const*>(views[0]);
+      const BT* data = src.view().data();
+      const lid_t stride = src.extent(0);
+      Kokkos::parallel_for(size, KOKKOS_LAMBDA(const int& i) {
+        char* entry = buffer.data() + i * entry_size + offset;
+        for (int c = 0; c < ncomp; ++c)
+          packBytes<BT>(entry + c * sizeof(BT), data[i + stride * c]);
+      });
+      PackViewsImpl<Device, Types...>(views + 1, size, buffer, entry_size, offset + sizeof(T));
+    }
+  };
+
+  template <typename Device, typename... Types> struct PackViews<Device, MemberTypes<Types...> > {
+    PackViews(Kokkos::View<lid_t*, Device> elements, MemberTypeViewsConst views, int size,
+              Kokkos::View<char*, Device> buffer) {
+      const std::size_t entry_size = packedEntrySize<MemberTypes<Types...> >();
+      Kokkos::parallel_for(size, KOKKOS_LAMBDA(const int& i) {
+        packBytes<lid_t>(buffer.data() + i * entry_size, elements(i));
+      });
+      PackViewsImpl<Device, Types...>(views, size, buffer, entry_size, sizeof(lid_t));
+    }
+  };
+
+  //Unpack Views Templated Struct
+  template <typename Device, typename... Types> struct UnpackViewsImpl;
+  template <typename Device> struct UnpackViewsImpl<Device> {
+    UnpackViewsImpl(Kokkos::View<char*, Device>, int, MemberTypeViewsConst,
+                    std::size_t, std::size_t) {}
+  };
+  template <typename Device, typename T, typename... Types> struct UnpackViewsImpl<Device, T, Types...> {
+    UnpackViewsImpl(Kokkos::View<char*, Device> buffer, int size, MemberTypeViewsConst views,
+                    std::size_t entry_size, std::size_t offset) {
+      enclose(buffer, size, views, entry_size, offset);
+    }
+    void enclose(Kokkos::View<char*, Device> buffer, int size, MemberTypeViewsConst views,
+                 std::size_t entry_size, std::size_t offset) {
+      typedef typename BaseType<T>::type BT;
+      const int ncomp = BaseType<T>::size;
+      MemberTypeView<T, Device> dst = *static_cast<MemberTypeView<T, Device> const*>(views[0]);
+      BT* data = dst.view().data();
+      const lid_t stride = dst.extent(0);
+      Kokkos::parallel_for(size, KOKKOS_LAMBDA(const int& i) {
+        const char* entry = buffer.data() + i * entry_size + offset;
+        for (int c = 0; c < ncomp; ++c)
+          unpackBytes<BT>(data[i + stride * c], entry + c * sizeof(BT));
+      });
+      UnpackViewsImpl<Device, Types...>(buffer, size, views + 1, entry_size, offset + sizeof(T));
+    }
+  };
+
+  template <typename Device, typename... Types> struct UnpackViews<Device, MemberTypes<Types...> > {
+    UnpackViews(Kokkos::View<char*, Device> buffer, int size,
+                Kokkos::View<lid_t*, Device> elements, MemberTypeViewsConst views) {
+      const std::size_t entry_size = packedEntrySize<MemberTypes<Types...> >();
+      Kokkos::parallel_for(size, KOKKOS_LAMBDA(const int& i) {
+        unpackBytes<lid_t>(elements(i), buffer.data() + i * entry_size);
+      });
+      UnpackViewsImpl<Device, Types...>(buffer, size, views, entry_size, sizeof(lid_t));
+    }
+  };
+
   //Implementation to deallocate views of different types
   template <typename Device, typename... Types> struct DestroyViewsImpl;
   template <typename Device> struct DestroyViewsImpl<Device> {
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <ppTypes.h>
+#include <ppMacros.h>
+#include <SupportKK.h>
+#include <Kokkos_Core.hpp>
+
+namespace pumipic {
+
+  /* Mapping from element global ids to local ids
+
+     The global ids of a picpart are made of a few contiguous ranges (one per owning
+       process), so the mapping is stored as the ranges of consecutive global ids in
+       sorted order and the local id of each sorted position. A lookup is a binary
+       search over the ranges followed by a dense read, and the mapping takes
+       one lid per element plus two values per range.
+
+     Usage:
+       GidMapping<Device> map;
+       map.build(element_gids, num_elems);
+       ...
+       lid_t lid = map.find(gid); //-1 if gid is not in the mapping
+  */
+  template <typename Device>
+  class GidMapping {
+  public:
+    typedef Kokkos::View<lid_t*, Device> kkLidView;
+    typedef Kokkos::View<gid_t*, Device> kkGidView;
+
+    GidMapping() : num_ranges(0) {}
+
+    //Build the mapping from the first n entries of gids, gids(i) maps to i
+    void build(kkGidView gids, lid_t n);
+
+    //Copy a mapping from another memory space
+    template <typename Device2>
+    void copy(const GidMapping<Device2>& old);
+
+    //Returns the number of global ids in the mapping
+    lid_t size() const {return sorted_lids.size();}
+    //Returns the number of ranges of consecutive global ids
+    lid_t numRanges() const {return num_ranges;}
+
+    //Returns the local id of gid or -1 if gid is not in the mapping
+    PP_INLINE lid_t find(const gid_t gid) const {
+      if (num_ranges == 0 || gid < range_gids(0))
+        return -1;
+      //Find the last range starting at or before gid
+      lid_t low = 0, high = num_ranges;
+      while (high - low > 1) {
+        const lid_t mid = (low + high) / 2;
+        if (range_gids(mid) <= gid)
+          low = mid;
+        else
+          high = mid;
+      }
+      const gid_t pos = range_offsets(low) + (gid - range_gids(low));
+      if (pos >= range_offsets(low + 1))
+        return -1;
+      return sorted_lids(pos);
+    }
+
+    template <typename D2> friend class GidMapping;
+  private:
+    lid_t num_ranges;
+    //First global id of each range
+    kkGidView range_gids;
+    //Position of the first global id of each range in sorted order, sized num_ranges + 1
+    kkLidView range_offsets;
+    //Local id of each global id in sorted order
+    kkLidView sorted_lids;
+  };
+
+  template <typename Device>
+  void GidMapping<Device>::build(kkGidView gids, lid_t n) {
+    kkGidView sorted_gids(Kokkos::ViewAllocateWithoutInitializing("sorted_gids"), n);
+    sorted_lids = kkLidView(Kokkos::ViewAllocateWithoutInitializing("gid_mapping_lids"), n);
+    kkLidView lids = sorted_lids;
+    Kokkos::parallel_for("gid_mapping_init", n, KOKKOS_LAMBDA(const lid_t& i) {
+      sorted_gids(i) = gids(i);
+      lids(i) = i;
+    });
+    stable_sort_by_key(sorted_gids, lids, n);
+
+    //Mark the start of each range of consecutive global ids
+    kkLidView range_starts("range_starts", n + 1);
+    Kokkos::parallel_for("gid_mapping_mark", n, KOKKOS_LAMBDA(const lid_t& i) {
+      range_starts(i) = (i == 0 || sorted_gids(i) != sorted_gids(i - 1) + 1);
+    });
+    kkLidView range_index("range_index", n + 1);
+    exclusive_scan(range_starts, range_index);
+    num_ranges = getLastValue<lid_t>(range_index);
+
+    range_gids = kkGidView(Kokkos::ViewAllocateWithoutInitializing("gid_mapping_range_gids"),
+                           num_ranges);
+    range_offsets = kkLidView(Kokkos::ViewAllocateWithoutInitializing("gid_mapping_range_offsets"),
+                              num_ranges + 1);
+    kkGidView r_gids = range_gids;
+    kkLidView r_offsets = range_offsets;
+    Kokkos::parallel_for("gid_mapping_ranges", n, KOKKOS_LAMBDA(const lid_t& i) {
+      if (range_starts(i)) {
+        const lid_t r = range_index(i);
+        r_gids(r) = sorted_gids(i);
+        r_offsets(r) = i;
+      }
+    });
+    const lid_t nr = num_ranges;
+    Kokkos::parallel_for("gid_mapping_end", 1, KOKKOS_LAMBDA(const lid_t&) {
+      r_offsets(nr) = n;
+    });
+  }
+
+  template <typename Device>
+  template <typename Device2>
+  void GidMapping<Device>::copy(const GidMapping<Device2>& old) {
+    num_ranges = old.num_ranges;
+    range_gids = kkGidView("gid_mapping_range_gids", old.range_gids.size());
+    Kokkos::deep_copy(range_gids, old.range_gids);
+    range_offsets = kkLidView("gid_mapping_range_offsets", old.range_offsets.size());
+    Kokkos::deep_copy(range_offsets, old.range_offsets);
+    sorted_lids = kkLidView("gid_mapping_lids", old.sorted_lids.size());
+    Kokkos::deep_copy(sorted_lids, old.sorted_lids);
+  }
+}
@@ -0,0 +1,267 @@
+#pragma once
+
+#include <vector>
+#include <utility>
+#include <mpi.h>
+#include <ppTypes.h>
+#include <ViewComm.h>
+#include <MemberTypeLibraries.h>
+
+namespace pumipic {
+
+  /* Grow-only pool of the arrays used by migrate
+
+     Each particle structure owns one pool. The arrays are sized by the largest
+       migration seen so far and reused by the following migrations instead of being
+       allocated (and first touched) on every call. Returned arrays are uninitialized
+       unless noted otherwise and are only valid until the next migration.
+     Only one migration per structure may be in flight at a time.
+  */
+  template <class DataTypes, typename Space = DefaultMemSpace>
+  class MigrationBuffers {
+  public:
+    typedef typename Space::device_type device_type;
+    typedef Kokkos::View<lid_t*, device_type> kkLidView;
+    typedef Kokkos::View<gid_t*, device_type> kkGidView;
+    typedef Kokkos::View<char*, device_type> BufferView;
+
+    //Index arrays used by migrate
+    enum LidArray {
+      NUM_SEND,
+      NUM_RECV,
+      OFFSET_SEND,
+      OFFSET_RECV,
+      SEND_FLAG,
+      SEND_INDEX,
+      SEND_LIST,
+      SEND_BINS,
+      SEND_ELEMENT,
+      RECV_ELEMENT,
+      NEW_PTCL_MAP,
+      NUM_LID_ARRAYS
+    };
+    //MPI request arrays used by migrate
+    enum RequestArray {
+      COUNT_SEND_REQUESTS,
+      COUNT_RECV_REQUESTS,
+      SEND_REQUESTS,
+      RECV_REQUESTS,
+      NUM_REQUEST_ARRAYS
+    };
+
+    MigrationBuffers() : in_use(false), send_particle(NULL), send_capacity(0),
+                         recv_particle(NULL), recv_capacity(0) {}
+    MigrationBuffers(const MigrationBuffers&) = delete;
+    MigrationBuffers& operator=(const MigrationBuffers&) = delete;
+    ~MigrationBuffers() {free();}
+
+    //Returns the first size entries of the index array
+    kkLidView lids(LidArray a, lid_t size) {
+      if (lid_arrays[a].size() < static_cast<std::size_t>(size))
+        lid_arrays[a] = kkLidView(Kokkos::ViewAllocateWithoutInitializing(lidName(a)), size);
+      return Kokkos::subview(lid_arrays[a], std::make_pair(0, size));
+    }
+    //Returns the first size entries of the index array set to zero
+    kkLidView zeroedLids(LidArray a, lid_t size) {
+      kkLidView view = lids(a, size);
+      Kokkos::deep_copy(view, 0);
+      return view;
+    }
+    //Returns member views with at least size entries
+    MemberTypeViews sendParticles(lid_t size) {
+      grow(send_particle, send_capacity, size);
+      return send_particle;
+    }
+    MemberTypeViews recvParticles(lid_t size) {
+      grow(recv_particle, recv_capacity, size);
+      return recv_particle;
+    }
+    //Returns byte buffers with at least bytes entries
+    BufferView sendBuffer(std::size_t bytes) {return growBuffer(send_buffer, "send_buffer", bytes);}
+    BufferView recvBuffer(std::size_t bytes) {return growBuffer(recv_buffer, "recv_buffer", bytes);}
+    //Returns an array of at least n requests
+    MPI_Request* requests(RequestArray r, int n) {
+      if (request_arrays[r].size() < static_cast<std::size_t>(n))
+        request_arrays[r].resize(n);
+      return request_arrays[r].data();
+    }
+
+    //Releases the memory of the pool, the next migration reallocates it
+    void free() {
+      if (send_particle)
+        destroyViews<DataTypes, Space>(send_particle);
+      if (recv_particle)
+        destroyViews<DataTypes, Space>(recv_particle);
+      send_particle = recv_particle = NULL;
+      send_capacity = recv_capacity = 0;
+      for (int i = 0; i < NUM_LID_ARRAYS; ++i)
+        lid_arrays[i] = kkLidView();
+      for (int i = 0; i < NUM_REQUEST_ARRAYS; ++i)
+        std::vector<MPI_Request>().swap(request_arrays[i]);
+      send_buffer = BufferView();
+      recv_buffer = BufferView();
+    }
+
+    //Set while a migration using the pool is in flight
+    bool in_use;
+
+  private:
+    static const char* lidName(LidArray a) {
+      static const char* names[NUM_LID_ARRAYS] = {
+        "num_send_particles", "num_recv_particles", "offset_send_particles",
+        "offset_recv_particles", "send_flag", "send_particle_index", "send_list",
+        "send_bins", "send_element", "recv_element", "new_ptcl_map"};
+      return names[a];
+    }
+    void grow(MemberTypeViews& views, lid_t& cap, lid_t size) {
+      if (views && cap >= size)
+        return;
+      if (views)
+        destroyViews<DataTypes, Space>(views);
+      views = NULL;
+      CreateViews<device_type, DataTypes>(views, size);
+      cap = size;
+    }
+    BufferView growBuffer(BufferView& buffer, const char* label, std::size_t bytes) {
+      if (buffer.size() < bytes)
+        buffer = BufferView(Kokkos::ViewAllocateWithoutInitializing(label), bytes);
+      return buffer;
+    }
+
+    kkLidView lid_arrays[NUM_LID_ARRAYS];
+    std::vector<MPI_Request> request_arrays[NUM_REQUEST_ARRAYS];
+    MemberTypeViews send_particle;
+    lid_t send_capacity;
+    MemberTypeViews recv_particle;
+    lid_t recv_capacity;
+    BufferView send_buffer;
+    BufferView recv_buffer;
+  };
+
+  /* Orders the sending particles by destination then new element
+
+     send_list holds the first np_send sending particles in index order. It is
+       reordered so each message is element grouped and the particles of an element
+       keep their index order. The reordering is two stable counting sort passes, by
+       new element then by destination, so the bins are nelems and dist.num_ranks()
+       instead of their product.
+     send_bins - scratch array with at least np_send entries
+  */
+  template <typename ViewT, typename Dist>
+  void sortSendList(ViewT send_list, ViewT send_bins, lid_t np_send, ViewT new_element,
+                    ViewT new_process, const Dist& dist, lid_t nelems) {
+    Kokkos::parallel_for("send_element_bins", np_send, KOKKOS_LAMBDA(const lid_t& index) {
+      send_bins(index) = new_element(send_list(index));
+    });
+    stable_counting_sort(send_bins, send_list, np_send, nelems);
+    Kokkos::parallel_for("send_process_bins", np_send, KOKKOS_LAMBDA(const lid_t& index) {
+      send_bins(index) = dist.index(new_process(send_list(index)));
+    });
+    stable_counting_sort(send_bins, send_list, np_send, dist.num_ranks());
+  }
+
+  /* State of a split-phase migration
+
+     Filled by migrateBegin on a particle structure and consumed by migrateEnd.
+       Between the two calls the particle messages are in flight and the particle
+       structure may be read (for example to deposit the particles that stay) but not
+       modified. The arrays passed to migrateBegin must not be modified either.
+     The arrays held by the handle belong to the MigrationBuffers of the structure.
+
+     Usage:
+       MigrationHandle<DataTypes, MemSpace> handle;
+       ptcls->migrateBegin(handle, new_element, new_process, dist);
+       //work independent of the migrating particles
+       ptcls->migrateEnd(handle);
+  */
+  template <class DataTypes, typename Space = DefaultMemSpace>
+  class MigrationHandle {
+  public:
+    typedef typename Space::device_type device_type;
+    typedef Kokkos::View<lid_t*, device_type> kkLidView;
+    typedef Kokkos::View<char*, device_type> BufferView;
+
+    MigrationHandle() : in_flight(false), exchange(false), comm_rank(0),
+                        buffers(NULL), new_particle_info(NULL), np_recv(0), new_ptcls(0),
+                        recv_particle(NULL), send_requests(NULL), num_send_requests(0),
+                        recv_requests(NULL), num_recv_requests(0), elapsed(0), btime(0) {}
+    MigrationHandle(const MigrationHandle&) = delete;
+    MigrationHandle& operator=(const MigrationHandle&) = delete;
+    ~MigrationHandle() {
+      if (in_flight) {
+        fprintf(stderr, "[WARNING] Migration handle destroyed before migrateEnd was called\n");
+        finishSends();
+        finishRecvs();
+        clear();
+      }
+    }
+
+    //Returns true between migrateBegin and migrateEnd
+    bool inFlight() const {return in_flight;}
+
+    //The following are meant to be used by the particle structures only
+    void start(MigrationBuffers<DataTypes, Space>* pool) {
+      buffers = pool;
+      buffers->in_use = true;
+      in_flight = true;
+    }
+    void finishSends() {
+      if (num_send_requests)
+        PS_Comm_Waitall<device_type>(num_send_requests, send_requests, MPI_STATUSES_IGNORE);
+      num_send_requests = 0;
+    }
+    void finishRecvs() {
+      if (num_recv_requests)
+        PS_Comm_Waitall<device_type>(num_recv_requests, recv_requests, MPI_STATUSES_IGNORE);
+      num_recv_requests = 0;
+    }
+    void clear() {
+      if (buffers)
+        buffers->in_use = false;
+      buffers = NULL;
+      recv_particle = NULL;
+      send_requests = recv_requests = NULL;
+      num_send_requests = num_recv_requests = 0;
+      recv_buffer = BufferView();
+      send_buffer = BufferView();
+      recv_element = kkLidView();
+      new_element = kkLidView();
+      new_process = kkLidView();
+      new_particle_elements = kkLidView();
+      new_particle_info = NULL;
+      in_flight = false;
+      exchange = false;
+    }
+
+    bool in_flight;
+    //False if no particles are exchanged and migrateEnd only rebuilds
+    bool exchange;
+    int comm_rank;
+    //Pool of the structure the migration was started on
+    MigrationBuffers<DataTypes, Space>* buffers;
+
+    //Arguments of migrateBegin
+    kkLidView new_element;
+    kkLidView new_process;
+    kkLidView new_particle_elements;
+    MemberTypeViews new_particle_info;
+
+    //Received particles followed by the new particles
+    lid_t np_recv;
+    lid_t new_ptcls;
+    kkLidView recv_element;
+    MemberTypeViews recv_particle;
+
+    //Packed messages and their requests
+    BufferView send_buffer;
+    BufferView recv_buffer;
+    MPI_Request* send_requests;
+    int num_send_requests;
+    MPI_Request* recv_requests;
+    int num_recv_requests;
+
+    //Time spent in migrateBegin and its prebarrier time
+    double elapsed;
+    double btime;
+  };
+}
@@ -157,6 +157,69 @@ int migrateSendToOne(const char* name, PS* structure) {
 }
 
 
+int migrateSplitPhase(const char* name, PS* structure) {
+  printf("migrateSplitPhase %s, rank %d\n", name, comm_rank);
+  int fails = 0;
+
+  kkLidView new_element("new_element", structure->capacity());
+  kkLidView new_process("new_process", structure->capacity());
+  kkLidView num_sending("num_sending", 1);
+
+  //Send the particles of the last element one process to the right
+  int local_rank = comm_rank;
+  int local_csize = comm_size;
+  int num_elems = structure->nElems();
+  auto sendRight = PS_LAMBDA(const lid_t& e, const lid_t& p, const bool& mask) {
+    new_element(p) = e;
+    new_process(p) = local_rank;
+    if (mask && e == num_elems - 1) {
+      new_process(p) = (local_rank + 1) % local_csize;
+      Kokkos::atomic_increment(&num_sending(0));
+    }
+  };
+  ps::parallel_for(structure, sendRight, "sendRight");
+  const int np = structure->nPtcls();
+  const int sending = ps::getLastValue<lid_t>(num_sending);
+  long int total_before = np, total_after = 0;
+  MPI_Allreduce(MPI_IN_PLACE, &total_before, 1, MPI_LONG, MPI_SUM, MPI_COMM_WORLD);
+
+  //Read the structure while the particles are in flight
+  ps::MigrationHandle<Types, MemSpace> handle;
+  structure->migrateBegin(handle, new_element, new_process);
+  if (!handle.inFlight()) {
+    fprintf(stderr, "[ERROR] %s Migration handle is not in flight after migrateBegin\n", name);
+    fails++;
+  }
+  kkLidView num_staying("num_staying", 1);
+  auto countStaying = PS_LAMBDA(const lid_t& e, const lid_t& p, const bool& mask) {
+    if (mask && new_process(p) == local_rank)
+      Kokkos::atomic_increment(&num_staying(0));
+  };
+  ps::parallel_for(structure, countStaying, "countStaying");
+  structure->migrateEnd(handle);
+  if (handle.inFlight()) {
+    fprintf(stderr, "[ERROR] %s Migration handle is in flight after migrateEnd\n", name);
+    fails++;
+  }
+
+  const int staying = ps::getLastValue<lid_t>(num_staying);
+  const int expected_staying = comm_size > 1 ? np - sending : np;
+  if (staying != expected_staying) {
+    fprintf(stderr, "[ERROR] %s Rank %d counted %d staying particles (%d expected)\n",
+            name, comm_rank, staying, expected_staying);
+    fails++;
+  }
+  total_after = structure->nPtcls();
+  MPI_Allreduce(MPI_IN_PLACE, &total_after, 1, MPI_LONG, MPI_SUM, MPI_COMM_WORLD);
+  if (total_after != total_before) {
+    fprintf(stderr, "[ERROR] %s Split-phase migration changed the number of particles "
+            "(%ld != %ld)\n", name, total_after, total_before);
+    fails++;
+  }
+  return fails;
+}
+
+
 int migrateToEmptyAndRefill(const char* name, PS* structure) {
   printf("migrateToEmptyAndRefill %s, rank %d\n", name, comm_rank);
 
@@ -226,7 +289,8 @@ int migrateToEmptyAndRefill(const char* name, PS* structure) {
     ps::parallel_for(structure, checkPtcls, "checkPtcls");
   }
 
-  //Send Particles back to original process
+  //Send Particles back to original process with the migration buffers reallocated
+  structure->freeMigrationBuffers();
   rnks = structure->get<3>();
   new_element = kkLidView("new_element", structure->capacity());
   new_process = kkLidView("new_process", structure->capacity());
@@ -333,4 +333,149 @@ int rebuildNewAndDestroyed(const char* name, PS* structure) {
 
   ps::destroyViews<Types>(new_particles);
   return fails;
-}
\ No newline at end of file
+}
+//Reshuffle test: replacing removed particles fits in the empty slots of each element,
+//  more new particles than the capacity make reshuffle fail and rebuild fall back
+template <class Structure>
+int reshuffleStructure(const char* name, Structure* structure) {
+  int fails = 0;
+  const int ne = structure->nElems();
+  if (ne == 0)
+    return 0;
+  const int np = structure->nPtcls();
+
+  //Remove every 7th particle and add a new particle in its element
+  auto pID = structure->template get<0>();
+  kkLidView new_element("new_element", structure->capacity());
+  kkLidView removed_per_elem("removed_per_elem", ne + 1);
+  auto removeSome = PS_LAMBDA(const lid_t& e, const lid_t& p, const bool& mask) {
+    new_element(p) = -1;
+    if (mask) {
+      pID(p) = p;
+      if (p % 7 == 0)
+        Kokkos::atomic_increment(&removed_per_elem(e));
+      else
+        new_element(p) = e;
+    }
+  };
+  structure->parallel_for(removeSome, "removeSome");
+  kkLidView removed_offsets("removed_offsets", ne + 1);
+  ps::exclusive_scan(removed_per_elem, removed_offsets);
+  const int nnp = ps::getLastValue<lid_t>(removed_offsets);
+  kkLidView new_particle_elements("new_particle_elements", nnp);
+  Kokkos::parallel_for("replaced_elements", ne, KOKKOS_LAMBDA(const int& e) {
+    for (int i = removed_offsets(e); i < removed_offsets(e + 1); ++i)
+      new_particle_elements(i) = e;
+  });
+  auto new_particles = ps::createMemberViews<Types>(nnp);
+  auto new_ids = ps::getMemberView<Types, 0>(new_particles);
+  Kokkos::parallel_for("new_ids", nnp, KOKKOS_LAMBDA(const int& i) {
+    new_ids(i) = -1;
+  });
+  if (!structure->reshuffle(new_element, new_particle_elements, new_particles)) {
+    fprintf(stderr, "[ERROR] %s reshuffle did not replace the removed particles in place\n",
+            name);
+    ++fails;
+  }
+  ps::destroyViews<Types>(new_particles);
+  if (structure->nPtcls() != np) {
+    fprintf(stderr, "[ERROR] %s does not have the correct number of particles after "
+            "reshuffle %d (should be %d)\n", name, structure->nPtcls(), np);
+    ++fails;
+  }
+  pID = structure->template get<0>();
+  kkLidView num_replaced("num_replaced", 1);
+  kkLidView failed("failed", 1);
+  auto checkReplaced = PS_LAMBDA(const lid_t& e, const lid_t& p, const bool& mask) {
+    if (mask) {
+      const lid_t id = pID(p);
+      if (id < 0)
+        Kokkos::atomic_increment(&num_replaced(0));
+      else if (new_element(id) != e) {
+        printf("[ERROR] Particle %d was moved to incorrect element %d on %s "
+               "(should be in element %d)\n", id, e, name, new_element(id));
+        failed(0) = 1;
+      }
+    }
+  };
+  structure->parallel_for(checkReplaced, "checkReplaced");
+  fails += ps::getLastValue<lid_t>(failed);
+  if (ps::getLastValue<lid_t>(num_replaced) != nnp) {
+    fprintf(stderr, "[ERROR] %s has %d new particles after reshuffle (should be %d)\n",
+            name, ps::getLastValue<lid_t>(num_replaced), nnp);
+    ++fails;
+  }
+
+  //Add more particles to element 0 than there are slots
+  const int nnp2 = structure->capacity() + 1;
+  new_element = kkLidView("new_element", structure->capacity());
+  auto keepAll = PS_LAMBDA(const lid_t& e, const lid_t& p, const bool& mask) {
+    new_element(p) = mask ? e : -1;
+  };
+  structure->parallel_for(keepAll, "keepAll");
+  kkLidView crowded_elements("crowded_elements", nnp2);
+  auto crowded_particles = ps::createMemberViews<Types>(nnp2);
+  auto crowded_ids = ps::getMemberView<Types, 0>(crowded_particles);
+  Kokkos::parallel_for("crowded_ids", nnp2, KOKKOS_LAMBDA(const int& i) {
+    crowded_ids(i) = -2;
+  });
+  if (structure->reshuffle(new_element, crowded_elements, crowded_particles)) {
+    fprintf(stderr, "[ERROR] %s reshuffle added more particles than empty slots\n", name);
+    ++fails;
+  }
+  if (structure->nPtcls() != np) {
+    fprintf(stderr, "[ERROR] %s failed reshuffle changed the number of particles %d "
+            "(should be %d)\n", name, structure->nPtcls(), np);
+    ++fails;
+  }
+  structure->rebuild(new_element, crowded_elements, crowded_particles);
+  ps::destroyViews<Types>(crowded_particles);
+  if (structure->nPtcls() != np + nnp2) {
+    fprintf(stderr, "[ERROR] %s does not have the correct number of particles after "
+            "the fallback rebuild %d (should be %d)\n", name, structure->nPtcls(), np + nnp2);
+    ++fails;
+  }
+  pID = structure->template get<0>();
+  kkLidView num_crowded("num_crowded", 1);
+  failed = kkLidView("failed", 1);
+  auto checkCrowded = PS_LAMBDA(const lid_t& e, const lid_t& p, const bool& mask) {
+    if (mask && pID(p) == -2) {
+      Kokkos::atomic_increment(&num_crowded(0));
+      if (e != 0)
+        failed(0) = 1;
+    }
+  };
+  structure->parallel_for(checkCrowded, "checkCrowded");
+  if (ps::getLastValue<lid_t>(failed) || ps::getLastValue<lid_t>(num_crowded) != nnp2) {
+    fprintf(stderr, "[ERROR] %s fallback rebuild did not add %d particles to element 0\n",
+            name, nnp2);
+    ++fails;
+  }
+
+  //Remove the added particles again
+  new_element = kkLidView("new_element", structure->capacity());
+  auto removeCrowded = PS_LAMBDA(const lid_t& e, const lid_t& p, const bool& mask) {
+    new_element(p) = (mask && pID(p) != -2) ? e : -1;
+  };
+  structure->parallel_for(removeCrowded, "removeCrowded");
+  structure->rebuild(new_element);
+  if (structure->nPtcls() != np) {
+    fprintf(stderr, "[ERROR] %s does not have the correct number of particles after "
+            "removing the added particles %d (should be %d)\n", name, structure->nPtcls(), np);
+    ++fails;
+  }
+  return fails;
+}
+
+int rebuildReshuffle(const char* name, PS* structure) {
+  printf("rebuildReshuffle %s, rank %d\n", name, comm_rank);
+  ps::CSR<Types, MemSpace>* csr = dynamic_cast<ps::CSR<Types, MemSpace>*>(structure);
+  if (csr)
+    return reshuffleStructure(name, csr);
+#ifdef PP_ENABLE_CAB
+  ps::CabM<Types, MemSpace>* cabm = dynamic_cast<ps::CabM<Types, MemSpace>*>(structure);
+  if (cabm)
+    return reshuffleStructure(name, cabm);
+#endif
+  return 0;
+}
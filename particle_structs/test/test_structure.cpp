@@ -41,14 +41,21 @@ int rebuildNewElems(const char* name, PS* structure);
 int rebuildNewPtcls(const char* name, PS* structure);
 int rebuildPtclsDestroyed(const char* name, PS* structure);
 int rebuildNewAndDestroyed(const char* name, PS* structure);
+int rebuildReshuffle(const char* name, PS* structure);
 
 int testMigration(const char* name, PS* structure);
 int migrateSendRight(const char* name, PS* structure);
 int migrateSendToOne(const char* name, PS* structure);
+int migrateSplitPhase(const char* name, PS* structure);
 
 int testMetrics(const char* name, PS* structure);
 int testCopy(const char* name, PS* structure);
 int testSegmentComp(const char* name, PS* structure);
+int testStaticDispatch(const char* name, PS* structure);
+int testReduceScan(const char* name, PS* structure);
+int testElementLoop(const char* name, PS* structure);
+int testElementGroups(const char* name, PS* structure);
+int testSwitchStructure(const char* name, PS*& structure, kkGidView element_gids);
 
 //Edge Case tests
 int migrateToEmptyAndRefill(const char* name, PS* structure);
@@ -113,9 +120,14 @@ int main(int argc, char* argv[]) {
       fails += testMetrics(names[i].c_str(), structures[i]);
       fails += testRebuild(names[i].c_str(), structures[i]);
       fails += testMigration(names[i].c_str(), structures[i]);
-      //fails += testCopy(names[i].c_str(), structures[i]);
+      fails += testCopy(names[i].c_str(), structures[i]);
       fails += testSegmentComp(names[i].c_str(), structures[i]);
+      fails += testStaticDispatch(names[i].c_str(), structures[i]);
+      fails += testReduceScan(names[i].c_str(), structures[i]);
+      fails += testElementLoop(names[i].c_str(), structures[i]);
+      fails += testElementGroups(names[i].c_str(), structures[i]);
       fails += migrateToEmptyAndRefill(names[i].c_str(), structures[i]);
+      fails += testSwitchStructure(names[i].c_str(), structures[i], element_gids);
     }
 
     //Cleanup
@@ -159,6 +171,21 @@ int addSCSs(std::vector<PS*>& structures, std::vector<std::string>& names,
             comm_rank);
     ++fails;
   }
+  //Build SCS with C, sigma and V chosen by the autotuner
+  try {
+    lid_t maxC = 32;
+    Kokkos::TeamPolicy<ExeSpace> policy(4, maxC);
+    ps::SCS_Input<Types, MemSpace> input(policy, 1, 1, num_elems, num_ptcls, ppe,
+                                         element_gids, particle_elements, particle_info);
+    input.autotune = true;
+    PS* s = new ps::SellCSigma<Types, MemSpace>(input);
+    structures.push_back(s);
+    names.push_back("scs_autotune");
+  }
+  catch(...) {
+    fprintf(stderr, "[ERROR] Construction of autotuned SCS failed on rank %d\n", comm_rank);
+    ++fails;
+  }
   return fails;
   //Build SCS with C = 32, sigma = 1, V = 10
   try {
@@ -194,6 +221,25 @@ int addCSRs(std::vector<PS*>& structures, std::vector<std::string>& names,
     fprintf(stderr, "[ERROR] Construction of CSR failed on rank %d\n", comm_rank);
     ++fails;
   }
+  //Build CSR with each parallel_for strategy regardless of the distribution
+  try {
+    Kokkos::TeamPolicy<ExeSpace> policy(num_elems,32);
+    ps::CSR_Input<Types, MemSpace> input(policy, num_elems, num_ptcls, ppe, element_gids,
+                                         particle_elements, particle_info);
+    input.loop_strategy = ps::CSR_LOOP_TEAM;
+    PS* s = new ps::CSR<Types, MemSpace>(input);
+    structures.push_back(s);
+    names.push_back("csr_team");
+    input.loop_strategy = ps::CSR_LOOP_FLAT;
+    s = new ps::CSR<Types, MemSpace>(input);
+    structures.push_back(s);
+    names.push_back("csr_flat");
+  }
+  catch(...) {
+    fprintf(stderr, "[ERROR] Construction of CSR with a fixed loop strategy failed on "
+            "rank %d\n", comm_rank);
+    ++fails;
+  }
   return fails;
 }
 
@@ -244,6 +290,7 @@ int testRebuild(const char* name, PS* structure) {
   fails += rebuildNewPtcls(name, structure);
   fails += rebuildPtclsDestroyed(name, structure);
   fails += rebuildNewAndDestroyed(name, structure);
+  fails += rebuildReshuffle(name, structure);
 
   return fails;
 }
@@ -254,6 +301,7 @@ int testMigration(const char* name, PS* structure) {
   int fails = 0;
   fails += migrateSendRight(name, structure);
   fails += migrateSendToOne(name, structure);
+  fails += migrateSplitPhase(name, structure);
 
   return fails;
 }
@@ -327,11 +375,27 @@ int testCopy(const char* name, PS* structure) {
   auto ids2 = device_structure->get<0>();
   auto dbls1 = structure->get<1>();
   auto dbls2 = device_structure->get<1>();
+  auto shorts1 = structure->get<2>();
+  auto shorts2 = device_structure->get<2>();
+  auto ints1 = structure->get<3>();
+  auto ints2 = device_structure->get<3>();
   double EPSILON = .00001;
   kkLidView failure("failure", 1);
+  kkLidView elems1("elems1", structure->capacity());
+  Kokkos::deep_copy(elems1, -1);
   int local_rank = comm_rank;
+  auto recordElems = PS_LAMBDA(const int& eid, const int& pid, const bool& mask) {
+    if (mask)
+      elems1(pid) = eid;
+  };
+  ps::parallel_for(structure, recordElems, "record elements of original structure");
   auto testTypes = PS_LAMBDA(const int& eid, const int& pid, const bool& mask) {
     if (mask) {
+      if (elems1(pid) != eid) {
+        printf("[ERROR] Particle %d is in a different element "
+               "[(old) %d != %d (copy)] on rank %d\n", pid, elems1(pid), eid, local_rank);
+        failure(0) = 1;
+      }
       if (ids1(pid) != ids2(pid)) {
         printf("[ERROR] Particle ids do not match for particle %d "
                "[(old) %d != %d (copy)] on rank %d\n", pid, ids1(pid),
@@ -345,19 +409,44 @@ int testCopy(const char* name, PS* structure) {
                  dbls2(pid,i), local_rank);
           failure(0) = 1;
       }
+      if (shorts1(pid) != shorts2(pid)) {
+        printf("[ERROR] Particle shorts do not match for particle %d "
+               "[(old) %d != %d (copy)] on rank %d\n", pid, shorts1(pid),
+               shorts2(pid), local_rank);
+        failure(0) = 1;
+      }
+      if (ints1(pid) != ints2(pid)) {
+        printf("[ERROR] Particle ints do not match for particle %d "
+               "[(old) %d != %d (copy)] on rank %d\n", pid, ints1(pid),
+               ints2(pid), local_rank);
+        failure(0) = 1;
+      }
     }
   };
-  ps::parallel_for(structure, testTypes, "testTypes on original structure");
+  ps::parallel_for(device_structure, testTypes, "testTypes on copy of structure");
   if (ps::getLastValue<lid_t>(failure)) {
-    fprintf(stderr, "[ERROR] Test %s: Parallel for on original structure had failures\n",
+    fprintf(stderr, "[ERROR] Test %s: Parallel for on device structure had failures\n",
             name);
     ++fails;
   }
 
+  //The copy must own its data, writing to it can not change the original
+  auto changeCopy = PS_LAMBDA(const int& eid, const int& pid, const bool& mask) {
+    if (mask)
+      ints2(pid) = ints1(pid) + 1;
+  };
+  ps::parallel_for(device_structure, changeCopy, "change the copy of structure");
   Kokkos::parallel_for(1, KOKKOS_LAMBDA(const int& i) {failure(i) = 0;});
-  ps::parallel_for(device_structure, testTypes, "testTypes on copy of structure");
+  auto testOwnership = PS_LAMBDA(const int& eid, const int& pid, const bool& mask) {
+    if (mask && ints2(pid) == ints1(pid)) {
+      printf("[ERROR] Particle %d shares its data with the copy on rank %d\n",
+             pid, local_rank);
+      failure(0) = 1;
+    }
+  };
+  ps::parallel_for(structure, testOwnership, "testOwnership of original structure");
   if (ps::getLastValue<lid_t>(failure)) {
-    fprintf(stderr, "[ERROR] Test %s: Parallel for on device structure had failures\n",
+    fprintf(stderr, "[ERROR] Test %s: Copy of structure aliases the original data\n",
             name);
     ++fails;
   }
@@ -396,7 +485,287 @@ int testSegmentComp(const char* name, PS* structure) {
   return fails;
 }
 
+int testStaticDispatch(const char* name, PS* structure) {
+  printf("testStaticDispatch %s, rank %d\n", name, comm_rank);
+
+  int fails = 0;
+  if (structure->structureType() == ps::PS_UNKNOWN) {
+    fprintf(stderr, "[ERROR] Test %s: Structure type was not set on rank %d\n",
+            name, comm_rank);
+    return 1;
+  }
+  kkLidView count("count", 1);
+  auto countPtcls = PS_LAMBDA(const lid_t& e, const lid_t& p, const bool& mask) {
+    if (mask)
+      Kokkos::atomic_add(&(count[0]), 1);
+  };
+  //Dispatch to the concrete structure directly
+  switch (structure->structureType()) {
+  case ps::PS_SCS:
+    ps::parallel_for(static_cast<ps::SellCSigma<Types, MemSpace>*>(structure), countPtcls,
+                     "countPtcls");
+    break;
+  case ps::PS_CSR:
+    ps::parallel_for(static_cast<ps::CSR<Types, MemSpace>*>(structure), countPtcls,
+                     "countPtcls");
+    break;
+  case ps::PS_CABM:
+    ps::parallel_for(static_cast<ps::CabM<Types, MemSpace>*>(structure), countPtcls,
+                     "countPtcls");
+    break;
+  case ps::PS_DPS:
+    ps::parallel_for(static_cast<ps::DPS<Types, MemSpace>*>(structure), countPtcls,
+                     "countPtcls");
+    break;
+  default:
+    break;
+  }
+  lid_t num_counted = ps::getLastValue<lid_t>(count);
+  if (num_counted != structure->nPtcls()) {
+    fprintf(stderr, "[ERROR] Test %s: Statically dispatched loop counted %d particles "
+            "instead of %d on rank %d\n", name, num_counted, structure->nPtcls(), comm_rank);
+    ++fails;
+  }
+  return fails;
+}
+
 #include "test_constructor.cpp"
 #include "test_rebuild.cpp"
 #include "test_migrate.cpp"
 
+int testReduceScan(const char* name, PS* structure) {
+  printf("testReduceScan %s, rank %d\n", name, comm_rank);
+  int fails = 0;
+
+  //Count the particles and find the largest element with particles
+  lid_t num_counted = 0;
+  auto countPtcls = PS_LAMBDA(const lid_t& e, const lid_t& p, lid_t& update) {
+    update += 1;
+  };
+  ps::parallel_reduce(structure, countPtcls, num_counted, "countPtcls");
+  if (num_counted != structure->nPtcls()) {
+    fprintf(stderr, "[ERROR] Test %s: Reduction counted %d particles instead of %d "
+            "on rank %d\n", name, num_counted, structure->nPtcls(), comm_rank);
+    ++fails;
+  }
+  lid_t max_elm = -1;
+  auto maxElm = PS_LAMBDA(const lid_t& e, const lid_t& p, lid_t& update) {
+    if (e > update)
+      update = e;
+  };
+  ps::parallel_reduce(structure, maxElm, Kokkos::Max<lid_t>(max_elm), "maxElm");
+  kkLidView max_check("max_check", 1);
+  auto checkMax = PS_LAMBDA(const lid_t& e, const lid_t& p, const bool& mask) {
+    if (mask)
+      Kokkos::atomic_max(&max_check(0), e);
+  };
+  ps::parallel_for(structure, checkMax, "checkMax");
+  if (structure->nPtcls() > 0 && max_elm != ps::getLastValue<lid_t>(max_check)) {
+    fprintf(stderr, "[ERROR] Test %s: Max reduction found element %d instead of %d "
+            "on rank %d\n", name, max_elm, ps::getLastValue<lid_t>(max_check), comm_rank);
+    ++fails;
+  }
+
+  //Number the particles in each element with a segmented scan of ones
+  kkLidView ptcl_rank("ptcl_rank", structure->capacity());
+  kkLidView elm_totals("elm_totals", structure->nElems());
+  auto one = PS_LAMBDA(const lid_t& e, const lid_t& p, lid_t& value) {
+    value += 1;
+  };
+  ps::parallel_scan(structure, one, ptcl_rank, "numberPtcls", elm_totals);
+  kkLidView ppe("ppe", structure->nElems());
+  kkLidView rank_sums("rank_sums", structure->nElems());
+  auto countRanks = PS_LAMBDA(const lid_t& e, const lid_t& p, const bool& mask) {
+    if (mask) {
+      Kokkos::atomic_add(&ppe(e), 1);
+      Kokkos::atomic_add(&rank_sums(e), ptcl_rank(p));
+    }
+  };
+  ps::parallel_for(structure, countRanks, "countRanks");
+  //Each element's ranks are 0 to ppe-1
+  kkLidView failures("failures", 1);
+  Kokkos::parallel_for("checkScan", structure->nElems(), KOKKOS_LAMBDA(const lid_t& e) {
+    if (elm_totals(e) != ppe(e) || rank_sums(e) != ppe(e) * (ppe(e) - 1) / 2)
+      failures(0) = 1;
+  });
+  if (ps::getLastValue<lid_t>(failures)) {
+    fprintf(stderr, "[ERROR] Test %s: Segmented scan did not number the particles of "
+            "each element on rank %d\n", name, comm_rank);
+    ++fails;
+  }
+  return fails;
+}
+
+int testElementLoop(const char* name, PS* structure) {
+  printf("testElementLoop %s, rank %d\n", name, comm_rank);
+  int fails = 0;
+  typedef Kokkos::View<lid_t*, ExeSpace::scratch_memory_space,
+                       Kokkos::MemoryTraits<Kokkos::Unmanaged> > ScratchView;
+
+  //Count each element's particles in team scratch and record the element of each particle
+  kkLidView team_counts("team_counts", structure->nElems());
+  kkLidView ptcl_elms("ptcl_elms", structure->capacity());
+  auto countElm = PS_LAMBDA(const PS::TeamMember& team, const lid_t& elm,
+                            const PS::ElementPtcls& ptcls) {
+    ScratchView count(team.team_scratch(0), 1);
+    Kokkos::single(Kokkos::PerTeam(team), [&]() {count(0) = 0;});
+    team.team_barrier();
+    Kokkos::parallel_for(Kokkos::TeamThreadRange(team, ptcls.size()), [&](const lid_t& i) {
+      ptcl_elms(ptcls(i)) = elm;
+      Kokkos::atomic_add(&count(0), 1);
+    });
+    team.team_barrier();
+    Kokkos::single(Kokkos::PerTeam(team), [&]() {team_counts(elm) = count(0);});
+  };
+  ps::parallel_for_elements(structure, countElm, ScratchView::shmem_size(1), "countElm");
+
+  kkLidView ppe("ppe", structure->nElems());
+  kkLidView failures("failures", 1);
+  auto checkPtcls = PS_LAMBDA(const lid_t& e, const lid_t& p, const bool& mask) {
+    if (mask) {
+      Kokkos::atomic_add(&ppe(e), 1);
+      if (ptcl_elms(p) != e)
+        failures(0) = 1;
+    }
+  };
+  ps::parallel_for(structure, checkPtcls, "checkPtcls");
+  Kokkos::parallel_for("checkCounts", structure->nElems(), KOKKOS_LAMBDA(const lid_t& e) {
+    if (team_counts(e) != ppe(e))
+      failures(0) = 1;
+  });
+  if (ps::getLastValue<lid_t>(failures)) {
+    fprintf(stderr, "[ERROR] Test %s: Element loop did not visit the particles of each "
+            "element on rank %d\n", name, comm_rank);
+    ++fails;
+  }
+  return fails;
+}
+
+//Checks the grouping of groupByElement against the elements given by parallel_for
+int checkElementGroups(const char* name, PS* structure, kkLidView elm_offsets,
+                       kkLidView ptcl_ids) {
+  int fails = 0;
+  const lid_t ne = structure->nElems();
+  if (ps::getLastValue<lid_t>(elm_offsets) != structure->nPtcls()) {
+    fprintf(stderr, "[ERROR] Test %s: Grouping has %d particles [expected %d] on rank %d\n",
+            name, ps::getLastValue<lid_t>(elm_offsets), structure->nPtcls(), comm_rank);
+    ++fails;
+  }
+  kkLidView ptcl_elms("ptcl_elms", structure->capacity());
+  Kokkos::deep_copy(ptcl_elms, -1);
+  auto recordElms = PS_LAMBDA(const lid_t& e, const lid_t& p, const bool& mask) {
+    if (mask)
+      ptcl_elms(p) = e;
+  };
+  ps::parallel_for(structure, recordElms, "recordElms");
+  kkLidView failures("failures", 1);
+  Kokkos::parallel_for("checkGroups", ne, KOKKOS_LAMBDA(const lid_t& e) {
+    for (lid_t i = elm_offsets(e); i < elm_offsets(e + 1); ++i) {
+      if (ptcl_elms(ptcl_ids(i)) != e)
+        failures(0) = 1;
+      if (i > elm_offsets(e) && ptcl_ids(i - 1) >= ptcl_ids(i))
+        failures(0) = 1;
+    }
+  });
+  if (ps::getLastValue<lid_t>(failures)) {
+    fprintf(stderr, "[ERROR] Test %s: Particles are not grouped by element in index order "
+            "on rank %d\n", name, comm_rank);
+    ++fails;
+  }
+  return fails;
+}
+
+int testElementGroups(const char* name, PS* structure) {
+  printf("testElementGroups %s, rank %d\n", name, comm_rank);
+  int fails = 0;
+  const lid_t ne = structure->nElems();
+  if (ne == 0)
+    return fails;
+
+  kkLidView elm_offsets, ptcl_ids;
+  ps::groupByElement(structure, elm_offsets, ptcl_ids);
+  fails += checkElementGroups(name, structure, elm_offsets, ptcl_ids);
+
+  //The grouping is kept until the next rebuild
+  kkLidView cached_offsets, cached_ids;
+  ps::groupByElement(structure, cached_offsets, cached_ids);
+  if (cached_offsets.data() != elm_offsets.data() || cached_ids.data() != ptcl_ids.data()) {
+    fprintf(stderr, "[ERROR] Test %s: Grouping was rebuilt without a rebuild on rank %d\n",
+            name, comm_rank);
+    ++fails;
+  }
+
+  //Move every particle to the next element and back, regrouping after each rebuild
+  for (int shift = 1; shift >= -1; shift -= 2) {
+    kkLidView new_element("new_element", structure->capacity());
+    auto shiftElms = PS_LAMBDA(const lid_t& e, const lid_t& p, const bool& mask) {
+      if (mask)
+        new_element(p) = (e + shift + ne) % ne;
+      else
+        new_element(p) = -1;
+    };
+    ps::parallel_for(structure, shiftElms, "shiftElms");
+    structure->rebuild(new_element);
+    ps::groupByElement(structure, elm_offsets, ptcl_ids);
+    fails += checkElementGroups(name, structure, elm_offsets, ptcl_ids);
+  }
+  return fails;
+}
+
+int testSwitchStructure(const char* name, PS*& structure, kkGidView element_gids) {
+  printf("testSwitchStructure %s, rank %d\n", name, comm_rank);
+  int fails = 0;
+  const lid_t num_elems = structure->nElems();
+  const lid_t num_ptcls = structure->nPtcls();
+  const std::string ps_name = structure->getName();
+
+  //Sum the particle ids and elements to compare after switching
+  kkLidView sums("sums", 2);
+  auto ids = structure->get<0>();
+  auto sumPtcls = PS_LAMBDA(const lid_t& e, const lid_t& p, const bool& mask) {
+    if (mask) {
+      Kokkos::atomic_add(&sums(0), ids(p));
+      Kokkos::atomic_add(&sums(1), e);
+    }
+  };
+  ps::parallel_for(structure, sumPtcls, "sumPtcls");
+  kkLidHost sums_host = ps::deviceToHost(sums);
+
+  const ps::StructureType type = structure->structureType() == ps::PS_CSR ?
+    ps::PS_SCS : ps::PS_CSR;
+  Kokkos::TeamPolicy<ExeSpace> policy(4, 32);
+  structure = ps::switchStructure(structure, type, policy, element_gids);
+  if (structure->structureType() != type) {
+    fprintf(stderr, "[ERROR] Test %s: Structure was not switched on rank %d\n",
+            name, comm_rank);
+    ++fails;
+  }
+  if (structure->nElems() != num_elems || structure->nPtcls() != num_ptcls) {
+    fprintf(stderr, "[ERROR] Test %s: Switched structure has %d elements and %d particles "
+            "[expected %d and %d] on rank %d\n", name, structure->nElems(),
+            structure->nPtcls(), num_elems, num_ptcls, comm_rank);
+    ++fails;
+  }
+  if (structure->getName() != ps_name) {
+    fprintf(stderr, "[ERROR] Test %s: Switched structure is named %s [expected %s] "
+            "on rank %d\n", name, structure->getName().c_str(), ps_name.c_str(), comm_rank);
+    ++fails;
+  }
+
+  kkLidView new_sums("new_sums", 2);
+  ids = structure->get<0>();
+  auto sumNewPtcls = PS_LAMBDA(const lid_t& e, const lid_t& p, const bool& mask) {
+    if (mask) {
+      Kokkos::atomic_add(&new_sums(0), ids(p));
+      Kokkos::atomic_add(&new_sums(1), e);
+    }
+  };
+  ps::parallel_for(structure, sumNewPtcls, "sumNewPtcls");
+  kkLidHost new_sums_host = ps::deviceToHost(new_sums);
+  if (new_sums_host(0) != sums_host(0) || new_sums_host(1) != sums_host(1)) {
+    fprintf(stderr, "[ERROR] Test %s: Particle ids or elements changed when switching "
+            "on rank %d\n", name, comm_rank);
+    ++fails;
+  }
+  return fails;
+}
@@ -6,6 +6,8 @@
 #include "Omega_h_adj.hpp"
 #include "Omega_h_element.hpp"
 #include "Omega_h_shape.hpp"
+#include "Omega_h_mark.hpp"
+#include "Omega_h_map.hpp"
 
 #include <particle_structs.hpp>
 
@@ -13,6 +15,9 @@
 #include "pumipic_constants.hpp"
 #include "pumipic_kktypes.hpp"
 #include "pumipic_profiling.hpp"
+#include "pumipic_geometry.hpp"
+#include "pumipic_search.hpp"
+#include "pumipic_spatial_index.hpp"
 
 namespace o = Omega_h;
 namespace ps = particle_structs;
@@ -277,8 +282,79 @@ OMEGA_H_DEVICE bool isPointWithinElemTet(const o::LOs& mesh2verts,
   return isPointWithinElemTet(mesh2verts, coords, pos, elem, bcc, tol);
 }
 
+//Return the entries of ptcls whose ptcl_done flag is still zero.
+//The search kernels only launch over this list so the cost of each
+//iteration is proportional to the number of particles still moving.
+inline o::LOs compact_active_ptcls(o::Write<o::LO> ptcl_done, o::LOs ptcls) {
+  o::Write<o::I8> still_active(ptcls.size(), "still_active");
+  auto mark = OMEGA_H_LAMBDA(o::LO i) {
+    still_active[i] = (ptcl_done[ptcls[i]] == 0);
+  };
+  o::parallel_for(ptcls.size(), mark, "pumipic_mark_active_ptcls");
+  return o::unmap(o::collect_marked(o::Read<o::I8>(still_active)), ptcls, 1);
+}
+
+//Mark the first n entries of the reused ptcl_done scratch array as done
+inline void reset_ptcl_done(o::Write<o::LO> ptcl_done, o::LO n) {
+  auto reset = OMEGA_H_LAMBDA(o::LO i) {
+    ptcl_done[i] = 1;
+  };
+  o::parallel_for(n, reset, "pumipic_reset_ptcl_done");
+}
+
+/* Resolve the segment orig->dest with the spatial index of the mesh
+
+   The exposed faces binned in the grid cells crossed by the segment are
+   tested for crossings. If one is crossed, -1 is returned and xface and
+   xpoint hold the first crossing along the segment. Otherwise the element
+   containing dest is returned, or -1 with xface = -1 if dest is not found.
+*/
+OMEGA_H_DEVICE o::LO locate_segment_3d(const GridLocator& grid,
+    const o::Reals& face_planes, const o::LOs& elem_faces,
+    const o::Vector<3>& orig, const o::Vector<3>& dest, const o::Real tol,
+    o::LO& xface, o::Vector<3>& xpoint) {
+  const o::Real a[3] = {orig[0], orig[1], orig[2]};
+  const o::Real b[3] = {dest[0], dest[1], dest[2]};
+  const auto line = dest - orig;
+  const auto len2 = o::inner_product(line, line);
+  o::Real tmin = 2;
+  xface = -1;
+  auto visit = [&](const o::LO cell) -> bool {
+    for(o::LO i = grid.bdry_offsets[cell]; i < grid.bdry_offsets[cell+1]; ++i) {
+      const auto elm = grid.bdry_sides[i] / 4;
+      const auto fi = grid.bdry_sides[i] % 4;
+      auto xpt = o::zero_vector<3>();
+      o::Real dproj = -1;
+      if(line_face_intx_cached(grid.elem_inv, face_planes, elm, fi, orig, dest,
+                               xpt, dproj, tol)) {
+        const auto t = (len2 > 0) ? o::inner_product(xpt - orig, line) / len2 : 0;
+        if(t < tmin) {
+          tmin = t;
+          xface = elem_faces[elm*4+fi];
+          xpoint = xpt;
+        }
+      }
+    }
+    //a face may be crossed in a later cell than the one it is found in
+    return false;
+  };
+  grid.traverse(a, b, visit);
+  if(xface >= 0)
+    return -1;
+  return grid.locate(dest);
+}
+
 template < class ParticleType, typename Segment3d, typename SegmentInt >
-bool search_mesh_3d(o::Mesh& mesh, // (in) mesh
+bool search_mesh_3d_fused(SearchContext& ctx, ParticleStructure< ParticleType >* ptcls,
+    Segment3d x_ps_d, Segment3d xtgt_ps_d, SegmentInt pid_d,
+    o::Write<o::LO>& elem_ids, o::Write<o::Real>& xpoints_d, o::Write<o::LO>& xface_d,
+    int steplimit=0, int debug=0);
+
+//Search reusing the cached mesh arrays and scratch buffers of ctx
+//If ctx.fusedWalk() is set the search is done by search_mesh_3d_fused with
+//looplimit as the per-particle step budget
+template < class ParticleType, typename Segment3d, typename SegmentInt >
+bool search_mesh_3d(SearchContext& ctx, // (in) search context of the mesh
     ParticleStructure< ParticleType >* ptcls, // (in) particle structure
     Segment3d x_ps_d, // (in) starting particle positions
     Segment3d xtgt_ps_d, // (in) target particle positions
@@ -287,6 +363,9 @@ bool search_mesh_3d(o::Mesh& mesh, // (in) mesh
     o::Write<o::Real>& xpoints_d, // (out) particle-boundary intersection points
     o::Write<o::LO>& xface_d, // (out) face ids of boundary-intersecting points
     int looplimit=0, int debug=0) {
+  if(ctx.fusedWalk())
+    return search_mesh_3d_fused(ctx, ptcls, x_ps_d, xtgt_ps_d, pid_d, elem_ids,
+                                xpoints_d, xface_d, looplimit, debug);
   const auto btime = pumipic_prebarrier();
   Kokkos::Profiling::pushRegion("pumpipic_search_mesh3d");
   Kokkos::Profiling::pushRegion("pumpipic_search_mesh_Init");
@@ -298,21 +377,20 @@ bool search_mesh_3d(o::Mesh& mesh, // (in) mesh
   MPI_Comm_size(MPI_COMM_WORLD, &comm_size);
 
   Kokkos::Profiling::pushRegion("pumpipic_search_mesh_omegah");
-  const auto side_is_exposed = mark_exposed_sides(&mesh);
-  const auto mesh2verts = mesh.ask_elem_verts();
-  const auto coords = mesh.coords();
-  const auto face_verts =  mesh.ask_verts_of(2);
-  const auto elem_faces = mesh.ask_down(3, 2).ab2b;
-  const auto dual_elems = mesh.ask_dual().ab2b;
-  const auto dual_faces = mesh.ask_dual().a2ab;
+  const auto& geom = ctx.geometry();
+  const auto elem_inv = geom.elemInverses();
+  const auto face_planes = geom.facePlanes();
+  const auto face_adj = geom.faceNeighbors();
+  const auto elem_faces = ctx.elemSides();
   const auto psCapacity = ptcls->capacity();
   Kokkos::Profiling::popRegion();
 
   Kokkos::Profiling::pushRegion("pumpipic_ptcl-done_elem_ids");
   // ptcl_done[i] = 2 : particle i has hit a boundary or reached its destination
-  o::Write<o::LO> ptcl_done(psCapacity, 1, "ptcl_done");
+  auto ptcl_done = ctx.ptclDone(psCapacity);
+  reset_ptcl_done(ptcl_done, psCapacity);
   // store the next parent for each particle
-  o::Write<o::LO> elem_ids_next(psCapacity,-1, "elem_ids_next");
+  auto elem_ids_next = ctx.elemIdsNext(psCapacity);
   Kokkos::Profiling::popRegion();
 
   auto fill = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
@@ -329,7 +407,7 @@ bool search_mesh_3d(o::Mesh& mesh, // (in) mesh
   auto checkParent = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
     if( mask > 0) {
       const auto orig = makeVector3(pid, x_ps_d);
-      if(!isPointWithinElemTet(mesh2verts, coords, orig, e, tol)) {
+      if(!isPointWithinElemTetCached(elem_inv, orig, e, tol)) {
         if(debug)
           printf("Search1: ptcl %d not_in parent_element %d :pos %g %g %g \n", 
             pid_d(pid), e, orig[0], orig[1], orig[2]);
@@ -338,26 +416,62 @@ bool search_mesh_3d(o::Mesh& mesh, // (in) mesh
     }
   };
   parallel_for(ptcls, checkParent, "pumipic_checkParent");
+  // indices of the particles that are still moving towards their destination
+  auto active = compact_active_ptcls(ptcl_done, o::LOs(psCapacity, 0, 1));
   Kokkos::Profiling::popRegion();
-  bool found = false;
+  bool found = (active.size() == 0);
   int loops = 0;
   
   //debug
   int nloops = 5;
   int lsize = 5;
-  int hsize = 1;
+  int hsize = 0;
   int nl = nloops*lsize;
   if(debug)
     hsize = psCapacity;
   auto el_hist = o::Write<o::LO>(hsize*nl, -2);
 
+  const auto fallbackSteps = ctx.longFlightSteps();
   while(!found) {
-    auto checkCurrentElm = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
-      if( mask > 0 && !ptcl_done[pid] ) {
+    const auto numActive = active.size();
+    if(fallbackSteps && loops >= fallbackSteps) {
+      //resolve the remaining long-flight particles with the spatial index
+      const auto grid = ctx.spatialIndex().locator();
+      o::Write<o::LO> numLost(1, 0, "numLost");
+      auto longFlight = OMEGA_H_LAMBDA(o::LO i) {
+        const auto pid = active[i];
+        const auto dest = makeVector3(pid, xtgt_ps_d);
+        const auto orig = makeVector3(pid, x_ps_d);
+        o::LO xface = -1;
+        auto xpoint = o::zero_vector<3>();
+        const auto elm = locate_segment_3d(grid, face_planes, elem_faces, orig, dest,
+                                           tol, xface, xpoint);
+        elem_ids[pid] = elm;
+        if(xface >= 0) {
+          for(o::LO j=0; j<3; ++j)
+            xpoints_d[pid*3+j] = xpoint[j];
+          xface_d[pid] = xface;
+        }
+        else if(elm < 0) {
+          Kokkos::atomic_add(&(numLost[0]), 1);
+        }
+        ptcl_done[pid] = 2;
+      };
+      o::parallel_for(numActive, longFlight, "pumipic_longFlightFallback");
+      o::HostWrite<o::LO> numLost_h(numLost);
+      if(numLost_h[0])
+        fprintf(stderr, "WARNING:Rank %d: %d particles were not located by the "
+                "long-flight fallback\n", rank, numLost_h[0]);
+      found = (numLost_h[0] == 0);
+      break;
+    }
+    auto checkCurrentElm = OMEGA_H_LAMBDA(o::LO i) {
+      const auto pid = active[i];
+      if( !ptcl_done[pid] ) {
         const auto searchElm = elem_ids[pid];
         OMEGA_H_CHECK(searchElm >= 0);
         const auto dest = makeVector3(pid, xtgt_ps_d);
-        auto inParent = isPointWithinElemTet(mesh2verts, coords, dest, searchElm, tol);
+        auto inParent = isPointWithinElemTetCached(elem_inv, dest, searchElm, tol);
         ptcl_done[pid] = (inParent) ? 2:0;
         //if ptcl not done, this will be reset below
         elem_ids_next[pid] = searchElm;
@@ -367,38 +481,31 @@ bool search_mesh_3d(o::Mesh& mesh, // (in) mesh
         }
       }
     };
-    parallel_for(ptcls, checkCurrentElm, "pumipic_checkCurrentElm");
+    o::parallel_for(numActive, checkCurrentElm, "pumipic_checkCurrentElm");
 
-    auto findIntersection = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
-      if( mask > 0 && ptcl_done[pid]<2 ) {
+    auto findIntersection = OMEGA_H_LAMBDA(o::LO i) {
+      const auto pid = active[i];
+      if( ptcl_done[pid]<2 ) {
         const auto searchElm = elem_ids[pid];
         OMEGA_H_CHECK(searchElm >= 0);
-        const auto tetv2v = o::gather_verts<4>(mesh2verts, searchElm);
         const auto dest = makeVector3(pid, xtgt_ps_d);
         const auto orig = makeVector3(pid, x_ps_d);
         const auto face_ids = o::gather_down<4>(elem_faces, searchElm);
-        auto dual_elem_id = dual_faces[searchElm];
         int adj_id = -1, ind_exp = -1;
         auto projd = o::zero_vector<4>(); //not used
         auto xpts = o::zero_vector<3>();
         for(int fi=0; fi<4; ++fi) {
-          const auto face_id = face_ids[fi];
           auto xpoint = o::zero_vector<3>();
-          const auto fv2v = o::gather_verts<3>(face_verts, face_id);
-          const auto face = gatherVectors3x3(coords, fv2v);
-          const auto flip = isFaceFlipped(fi, fv2v, tetv2v);
-          const auto det = line_triangle_intx_simple(face, orig, dest, xpoint, 
-            projd[fi], flip, tol);//, debug);
-          auto exposed = side_is_exposed[face_id];
-          if(det && exposed) {
+          const auto det = line_face_intx_cached(elem_inv, face_planes, searchElm,
+            fi, orig, dest, xpoint, projd[fi], tol);
+          const auto adj = face_adj[searchElm*4+fi];
+          if(det && adj < 0) {
             ind_exp = fi;
             for(o::LO i=0; i<3; ++i)
               xpts[i] = xpoint[i];
           }
-          if(det && !exposed)
-            adj_id = dual_elem_id;
-          if(!exposed)
-            ++dual_elem_id;
+          if(det && adj >= 0)
+            adj_id = adj;
         } //for
 
         //wall collision
@@ -417,7 +524,7 @@ bool search_mesh_3d(o::Mesh& mesh, // (in) mesh
 
         //interior
         if(adj_id >= 0) {
-          elem_ids_next[pid] = dual_elems[adj_id];
+          elem_ids_next[pid] = adj_id;
           ptcl_done[pid] = 1; // reset below to 0/non-zero
           if(debug && loops<nloops) {
             el_hist[pid*nl+lsize*loops+2] = adj_id;
@@ -426,36 +533,32 @@ bool search_mesh_3d(o::Mesh& mesh, // (in) mesh
         }
       }
     };
-    parallel_for(ptcls, findIntersection, "pumipic_findIntersection");
+    o::parallel_for(numActive, findIntersection, "pumipic_findIntersection");
 
-    auto processUndetected = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
+    auto processUndetected = OMEGA_H_LAMBDA(o::LO i) {
+      const auto pid = active[i];
       auto done = ptcl_done[pid];
       ptcl_done[pid] = (done <2) ? 0: 2;
-      if( mask > 0 && done < 1) {
+      if( done < 1) {
         const auto searchElm = elem_ids[pid];
         OMEGA_H_CHECK(searchElm >= 0);
-        const auto tetv2v = o::gather_verts<4>(mesh2verts, searchElm);
         const auto dest = makeVector3(pid, xtgt_ps_d);
         const auto orig = makeVector3(pid, x_ps_d);
         const auto face_ids = o::gather_down<4>(elem_faces, searchElm);
         o::Real projd[4] = {-1,-1,-1,-1};
         auto xpoints = o::zero_vector<12>();
         for(int fi=0; fi<4; ++fi) {
-          const auto face_id = face_ids[fi];
           auto xpoint = o::zero_vector<3>();
-          const auto fv2v = o::gather_verts<3>(face_verts, face_id);
-          const auto face = gatherVectors3x3(coords, fv2v);
-          const auto flip = isFaceFlipped(fi, fv2v, tetv2v);
-          const auto det = line_triangle_intx_simple(face, orig, dest, xpoint, 
-            projd[fi], flip, tol);//, debug);
+          line_face_intx_cached(elem_inv, face_planes, searchElm, fi, orig, dest,
+            xpoint, projd[fi], tol);
           for(int i=0; i<3; ++i) 
             xpoints[fi*3+i] = xpoint[i];
         }
         const o::LO max_ind = max_index(projd, 4);
         OMEGA_H_CHECK(max_ind >= 0);
         const auto face_id = face_ids[max_ind];
-        const auto exposed = side_is_exposed[face_id];
-        if(exposed) {
+        const auto adj = face_adj[searchElm*4+max_ind];
+        if(adj < 0) {
           elem_ids_next[pid] = -1;
           if(debug && loops<nloops)
             el_hist[pid*nl+lsize*loops+4] = elem_ids_next[pid];          
@@ -466,33 +569,33 @@ bool search_mesh_3d(o::Mesh& mesh, // (in) mesh
             printf("Search: ptcl %d hit boundary tobe reflected/stopped\n", pid_d(pid));
           ptcl_done[pid] = 2;
         } else {
-          elem_ids_next[pid] = dual_elems[face_id];
+          elem_ids_next[pid] = adj;
           if(debug && loops<nloops)
             el_hist[pid*nl+lsize*loops+4] = elem_ids_next[pid];
         }
       }
     };
-    parallel_for(ptcls, processUndetected, "pumipic_processUndetected");
-    found = true;
+    o::parallel_for(numActive, processUndetected, "pumipic_processUndetected");
     auto cp_elm_ids = OMEGA_H_LAMBDA( o::LO i) {
-      elem_ids[i] = elem_ids_next[i];
+      const auto pid = active[i];
+      elem_ids[pid] = elem_ids_next[pid];
     };
-    o::parallel_for(elem_ids.size(), cp_elm_ids, "copy_elem_ids");
-    o::LOs ptcl_done_r(ptcl_done);
-    auto minFlag = o::get_min(ptcl_done_r);
-    if(minFlag == 0)
-      found = false;
+    o::parallel_for(numActive, cp_elm_ids, "copy_elem_ids");
+    //drop the particles that finished during this iteration
+    active = compact_active_ptcls(ptcl_done, active);
+    found = (active.size() == 0);
     ++loops;
 
     if(looplimit && loops >= looplimit) {
-      auto ptclsNotFound = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
-        if( mask > 0 && !ptcl_done[pid] ) {
+      auto ptclsNotFound = OMEGA_H_LAMBDA(o::LO i) {
+        const auto pid = active[i];
+        if( !ptcl_done[pid] ) {
           auto elm = elem_ids[pid];
           auto ptcl = pid_d(pid);
           const auto dest = makeVector3(pid, xtgt_ps_d);
           const auto orig = makeVector3(pid, x_ps_d);
-          printf("rank %d : el %d next_elm %d ptcl %d  %.15e %.15e %.15e "
-            "=> %.15e %.15e %.15e \n", rank, e, elm, ptcl, orig[0], 
+          printf("rank %d : next_elm %d ptcl %d  %.15e %.15e %.15e "
+            "=> %.15e %.15e %.15e \n", rank, elm, ptcl, orig[0], 
             orig[1], orig[2], dest[0], dest[1],dest[2]);
           if(debug)
             for(int il=0; il<nloops; ++il) {
@@ -502,7 +605,7 @@ bool search_mesh_3d(o::Mesh& mesh, // (in) mesh
             }
         }
       };
-      parallel_for(ptcls, ptclsNotFound, "ptclsNotFound");
+      o::parallel_for(active.size(), ptclsNotFound, "ptclsNotFound");
       fprintf(stderr, "ERROR:loop limit %d exceeded\n", looplimit);
       break;
     }
@@ -513,6 +616,266 @@ bool search_mesh_3d(o::Mesh& mesh, // (in) mesh
   return found;   
 }
 
+template < class ParticleType, typename Segment3d, typename SegmentInt >
+bool search_mesh_3d(o::Mesh& mesh, // (in) mesh
+    ParticleStructure< ParticleType >* ptcls, // (in) particle structure
+    Segment3d x_ps_d, // (in) starting particle positions
+    Segment3d xtgt_ps_d, // (in) target particle positions
+    SegmentInt pid_d, // (in) particle ids
+    o::Write<o::LO>& elem_ids, // (out) parent element ids for the target positions
+    o::Write<o::Real>& xpoints_d, // (out) particle-boundary intersection points
+    o::Write<o::LO>& xface_d, // (out) face ids of boundary-intersecting points
+    int looplimit=0, int debug=0) {
+  SearchContext ctx(mesh);
+  return search_mesh_3d(ctx, ptcls, x_ps_d, xtgt_ps_d, pid_d, elem_ids,
+                        xpoints_d, xface_d, looplimit, debug);
+}
+
+
+/* Walk the segment orig->dest from tet to tet starting in elm
+
+   On return elm is the element containing dest, or -1 if the segment left
+   the mesh through the exposed face xface at xpoint. Returns false if the
+   walk did not finish within maxSteps steps; elm is then the last element
+   visited.
+*/
+OMEGA_H_DEVICE bool walk_tet(const o::Reals& elem_inv, const o::Reals& face_planes,
+    const o::LOs& face_adj, const o::LOs& elem_faces, const o::Vector<3>& orig,
+    const o::Vector<3>& dest, const o::LO maxSteps, const o::Real tol,
+    o::LO& elm, o::LO& xface, o::Vector<3>& xpoint) {
+  for(o::LO step = 0; step < maxSteps; ++step) {
+    if(isPointWithinElemTetCached(elem_inv, dest, elm, tol))
+      return true;
+    o::Real projd[4] = {-1,-1,-1,-1};
+    o::LO adj[4];
+    auto xpoints = o::zero_vector<12>();
+    o::LO ind_exp = -1, ind_adj = -1;
+    for(int fi=0; fi<4; ++fi) {
+      auto xpt = o::zero_vector<3>();
+      const auto det = line_face_intx_cached(elem_inv, face_planes, elm,
+        fi, orig, dest, xpt, projd[fi], tol);
+      for(int i=0; i<3; ++i)
+        xpoints[fi*3+i] = xpt[i];
+      adj[fi] = face_adj[elm*4+fi];
+      if(det && adj[fi] < 0)
+        ind_exp = fi;
+      if(det && adj[fi] >= 0)
+        ind_adj = fi;
+    }
+    if(ind_adj < 0 && ind_exp < 0) {
+      const o::LO max_ind = max_index(projd, 4);
+      OMEGA_H_CHECK(max_ind >= 0);
+      if(adj[max_ind] >= 0)
+        ind_adj = max_ind;
+      else
+        ind_exp = max_ind;
+    }
+    if(ind_adj >= 0) {
+      elm = adj[ind_adj];
+    } else {
+      for(o::LO i=0; i<3; ++i)
+        xpoint[i] = xpoints[ind_exp*3+i];
+      xface = elem_faces[elm*4+ind_exp];
+      elm = -1;
+      return true;
+    }
+  }
+  return false;
+}
+
+/* Fused variant of search_mesh_3d
+
+   Each particle walks from tet to tet inside a single kernel until the target
+   position is located, an exposed face is crossed, or the step budget is
+   exhausted. The outputs elem_ids, xpoints_d and xface_d are written once per
+   particle. The walk follows the same face selection as search_mesh_3d:
+   an interior face crossed by the path takes precedence over an exposed face
+   and if no face is crossed the face with the largest projection is used.
+   The starting element is only verified when debug is set.
+
+   steplimit is the per-particle step budget; 0 selects a budget of the
+   number of mesh elements. Returns true if every particle was resolved.
+*/
+template < class ParticleType, typename Segment3d, typename SegmentInt >
+bool search_mesh_3d_fused(SearchContext& ctx, // (in) search context of the mesh
+    ParticleStructure< ParticleType >* ptcls, // (in) particle structure
+    Segment3d x_ps_d, // (in) starting particle positions
+    Segment3d xtgt_ps_d, // (in) target particle positions
+    SegmentInt pid_d, // (in) particle ids
+    o::Write<o::LO>& elem_ids, // (out) parent element ids for the target positions
+    o::Write<o::Real>& xpoints_d, // (out) particle-boundary intersection points
+    o::Write<o::LO>& xface_d, // (out) face ids of boundary-intersecting points
+    int steplimit, int debug) {
+  const auto btime = pumipic_prebarrier();
+  Kokkos::Profiling::pushRegion("pumpipic_search_mesh3d_fused");
+  Kokkos::Timer timer;
+  const o::Real tol = 1.0e-20;
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+  const auto& geom = ctx.geometry();
+  const auto elem_inv = geom.elemInverses();
+  const auto face_planes = geom.facePlanes();
+  const auto face_adj = geom.faceNeighbors();
+  const auto elem_faces = ctx.elemSides();
+  const o::LO maxSteps = (steplimit > 0) ? steplimit : geom.nelems();
+  const o::LO fallbackSteps = ctx.longFlightSteps();
+  const bool useIndex = fallbackSteps > 0;
+  const o::LO walkSteps = (useIndex && fallbackSteps < maxSteps) ? fallbackSteps : maxSteps;
+  GridLocator grid;
+  if(useIndex)
+    grid = ctx.spatialIndex().locator();
+
+  o::Write<o::LO> numNotFound(1, 0, "numNotFound");
+  o::Write<o::LO> numLost(1, 0, "numLost");
+  auto walk = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
+    if(mask <= 0) {
+      elem_ids[pid] = -1;
+      return;
+    }
+    const auto orig = makeVector3(pid, x_ps_d);
+    const auto dest = makeVector3(pid, xtgt_ps_d);
+    if(debug && !isPointWithinElemTetCached(elem_inv, orig, e, tol)) {
+      printf("Search1: ptcl %d not_in parent_element %d :pos %g %g %g \n",
+        pid_d(pid), e, orig[0], orig[1], orig[2]);
+      OMEGA_H_CHECK(false);
+    }
+    o::LO searchElm = e;
+    o::LO xface = -1;
+    auto xpoint = o::zero_vector<3>();
+    bool done = walk_tet(elem_inv, face_planes, face_adj, elem_faces, orig,
+                         dest, walkSteps, tol, searchElm, xface, xpoint);
+    if(!done && useIndex) {
+      searchElm = locate_segment_3d(grid, face_planes, elem_faces, orig, dest, tol,
+                                    xface, xpoint);
+      done = true;
+      //neither a wall hit nor an element containing dest
+      if(searchElm < 0 && xface < 0) {
+        if(debug)
+          printf("rank %d : ptcl %d not located by the long-flight fallback\n",
+                 rank, pid_d(pid));
+        Kokkos::atomic_add(&(numLost[0]), 1);
+      }
+    }
+    if(done && xface >= 0) {
+      //wall collision
+      for(o::LO i=0; i<3; ++i)
+        xpoints_d[pid*3+i] = xpoint[i];
+      xface_d[pid] = xface;
+      if(debug)
+        printf("Search: ptcl %d hit boundary %d  to-be stopped/reflected\n",
+          pid_d(pid), xface);
+    }
+    elem_ids[pid] = searchElm;
+    if(!done) {
+      if(debug)
+        printf("rank %d : elm %d ptcl %d  %.15e %.15e %.15e "
+          "=> %.15e %.15e %.15e not found\n", rank, searchElm, pid_d(pid),
+          orig[0], orig[1], orig[2], dest[0], dest[1], dest[2]);
+      Kokkos::atomic_add(&(numNotFound[0]), 1);
+    }
+  };
+  parallel_for(ptcls, walk, "pumipic_search_mesh3d_fused");
+  o::HostWrite<o::LO> numNotFound_h(numNotFound);
+  o::HostWrite<o::LO> numLost_h(numLost);
+  if(numNotFound_h[0])
+    fprintf(stderr, "ERROR:Rank %d: step limit %d exceeded by %d particles\n",
+            rank, maxSteps, numNotFound_h[0]);
+  if(numLost_h[0])
+    fprintf(stderr, "WARNING:Rank %d: %d particles were not located by the "
+            "long-flight fallback\n", rank, numLost_h[0]);
+  const bool found = (numNotFound_h[0] == 0 && numLost_h[0] == 0);
+  Kokkos::Profiling::popRegion();
+  pumipic::RecordTime("Search Mesh 3d fused", timer.seconds(), btime);
+  return found;
+}
+
+template < class ParticleType, typename Segment3d, typename SegmentInt >
+bool search_mesh_3d_fused(o::Mesh& mesh, // (in) mesh
+    ParticleStructure< ParticleType >* ptcls, // (in) particle structure
+    Segment3d x_ps_d, // (in) starting particle positions
+    Segment3d xtgt_ps_d, // (in) target particle positions
+    SegmentInt pid_d, // (in) particle ids
+    o::Write<o::LO>& elem_ids, // (out) parent element ids for the target positions
+    o::Write<o::Real>& xpoints_d, // (out) particle-boundary intersection points
+    o::Write<o::LO>& xface_d, // (out) face ids of boundary-intersecting points
+    int steplimit=0, int debug=0) {
+  SearchContext ctx(mesh);
+  return search_mesh_3d_fused(ctx, ptcls, x_ps_d, xtgt_ps_d, pid_d, elem_ids,
+                              xpoints_d, xface_d, steplimit, debug);
+}
+
+/* Batched point location without a particle structure
+
+   Walks the segment from each origin to its target starting in start_elems
+   using one flat kernel over the points. Coordinates hold 3 reals per point.
+   On return elem_ids holds the element containing each target, or -1 if the
+   segment left the mesh; for those points xpoints and xface_ids hold the
+   boundary intersection point and face (xface_ids is -1 otherwise).
+   steplimit is the per-point step budget; 0 selects the number of mesh
+   elements. Returns true if every point was resolved within the budget.
+*/
+inline bool search_points_3d(SearchContext& ctx, // (in) search context of the mesh
+    o::Reals orig, // (in) starting point positions
+    o::Reals dest, // (in) target point positions
+    o::LOs start_elems, // (in) elements containing the starting positions
+    o::Write<o::LO>& elem_ids, // (out) parent element ids for the target positions
+    o::Write<o::Real>& xpoints, // (out) point-boundary intersection points
+    o::Write<o::LO>& xface_ids, // (out) face ids of boundary-intersecting points
+    int steplimit=0) {
+  Kokkos::Profiling::pushRegion("pumipic_search_points_3d");
+  const auto& geom = ctx.geometry();
+  const auto elem_inv = geom.elemInverses();
+  const auto face_planes = geom.facePlanes();
+  const auto face_adj = geom.faceNeighbors();
+  const auto elem_faces = ctx.elemSides();
+  const o::LO maxSteps = (steplimit > 0) ? steplimit : geom.nelems();
+  const o::LO fallbackSteps = ctx.longFlightSteps();
+  const bool useIndex = fallbackSteps > 0;
+  const o::LO walkSteps = (useIndex && fallbackSteps < maxSteps) ? fallbackSteps : maxSteps;
+  GridLocator grid;
+  if(useIndex)
+    grid = ctx.spatialIndex().locator();
+  const o::Real tol = 1.0e-20;
+  const o::LO npts = start_elems.size();
+  elem_ids = o::Write<o::LO>(npts, "elem_ids");
+  xpoints = o::Write<o::Real>(npts*3, 0, "xpoints");
+  xface_ids = o::Write<o::LO>(npts, -1, "xface_ids");
+  auto elm_ids = elem_ids;
+  auto xpts = xpoints;
+  auto xfaces = xface_ids;
+  o::Write<o::LO> numNotFound(1, 0, "numNotFound");
+  auto walk = OMEGA_H_LAMBDA(o::LO i) {
+    o::Vector<3> o_pt, d_pt;
+    for(int j=0; j<3; ++j) {
+      o_pt[j] = orig[i*3+j];
+      d_pt[j] = dest[i*3+j];
+    }
+    o::LO elm = start_elems[i];
+    o::LO xface = -1;
+    auto xpoint = o::zero_vector<3>();
+    bool done = walk_tet(elem_inv, face_planes, face_adj, elem_faces, o_pt,
+                         d_pt, walkSteps, tol, elm, xface, xpoint);
+    if(!done && useIndex) {
+      elm = locate_segment_3d(grid, face_planes, elem_faces, o_pt, d_pt, tol,
+                              xface, xpoint);
+      //neither a wall hit nor an element containing the target
+      done = (elm >= 0 || xface >= 0);
+    }
+    elm_ids[i] = elm;
+    if(done && xface >= 0) {
+      for(int j=0; j<3; ++j)
+        xpts[i*3+j] = xpoint[j];
+      xfaces[i] = xface;
+    }
+    if(!done)
+      Kokkos::atomic_add(&(numNotFound[0]), 1);
+  };
+  o::parallel_for(npts, walk, "pumipic_search_points_3d");
+  o::HostWrite<o::LO> numNotFound_h(numNotFound);
+  Kokkos::Profiling::popRegion();
+  return numNotFound_h[0] == 0;
+}
 
 template < class ParticleType, typename Segment3d, typename SegmentInt >
 bool search_mesh(o::Mesh& mesh, ParticleStructure< ParticleType >* ptcls,
@@ -961,9 +1324,69 @@ OMEGA_H_DEVICE o::Vector<3> closest_point_on_triangle(
   return ptq;
 }
 
+/* Walk from triangle to triangle towards dest starting in elm
+
+   The next triangle is the one across the edge with the smallest area
+   coordinate, as in search_mesh_2d. On return elm is the triangle
+   containing dest, or -1 if the walk left the mesh through the exposed
+   edge xedge. Returns false if the walk did not finish within maxSteps.
+*/
+OMEGA_H_DEVICE bool walk_tri(const o::Reals& tri_inv, const o::LOs& edge_adj,
+    const o::LOs& elem_edges, const o::Vector<2>& dest,
+    const o::LO maxSteps, o::LO& elm, o::LO& xedge) {
+  for(o::LO step = 0; step < maxSteps; ++step) {
+    o::Vector<3> bcc;
+    barycentric_tri_cached(tri_inv, elm, dest, bcc);
+    if(all_positive(bcc))
+      return true;
+    const auto ei = min3(bcc);
+    const auto next = edge_adj[elm*3 + ei];
+    if(next < 0) {
+      xedge = elem_edges[elm*3 + ei];
+      elm = -1;
+      return true;
+    }
+    elm = next;
+  }
+  return false;
+}
+
+/* 2D variant of locate_segment_3d
+
+   Returns the triangle containing dest or -1 if the segment orig->dest
+   crosses an exposed edge, which is returned in xedge, or dest is not found.
+*/
+OMEGA_H_DEVICE o::LO locate_segment_2d(const GridLocator& grid,
+    const o::Reals& edge_lines, const o::LOs& elem_edges,
+    const o::Vector<2>& orig, const o::Vector<2>& dest, o::LO& xedge) {
+  const o::Real a[3] = {orig[0], orig[1], 0};
+  const o::Real b[3] = {dest[0], dest[1], 0};
+  o::Real tmin = 2;
+  xedge = -1;
+  auto visit = [&](const o::LO cell) -> bool {
+    for(o::LO i = grid.bdry_offsets[cell]; i < grid.bdry_offsets[cell+1]; ++i) {
+      const auto elm = grid.bdry_sides[i] / 3;
+      const auto ei = grid.bdry_sides[i] % 3;
+      o::Vector<2> xpt;
+      o::Real t = 2;
+      if(line_edge_intx_cached(grid.elem_inv, edge_lines, elm, ei, orig, dest,
+                               xpt, t, grid.tol) && t < tmin) {
+        tmin = t;
+        xedge = elem_edges[elm*3+ei];
+      }
+    }
+    return false;
+  };
+  grid.traverse(a, b, visit);
+  if(xedge >= 0)
+    return -1;
+  return grid.locate(dest);
+}
+
+//Search reusing the cached mesh arrays and scratch buffers of ctx
 template < class ParticleStruct, typename CurrentCoordView,
            typename TargetCoordView, typename SegmentInt>
-bool search_mesh_2d(o::Mesh& mesh, // (in) mesh
+bool search_mesh_2d(SearchContext& ctx, // (in) search context of the mesh
                     ParticleStruct* ptcls, // (in) particle structure
                     CurrentCoordView x_ps_d, // (in) starting particle positions
                     TargetCoordView xtgt_ps_d, // (in) target particle positions
@@ -980,21 +1403,19 @@ bool search_mesh_2d(o::Mesh& mesh, // (in) mesh
   MPI_Comm_rank(MPI_COMM_WORLD,&rank);
   MPI_Comm_size(MPI_COMM_WORLD,&comm_size);
 
-  const auto faces2edges = mesh.ask_down(o::FACE, o::EDGE);
-  const auto edges2faces = mesh.ask_up(o::EDGE, o::FACE);
-  const auto side_is_exposed = mark_exposed_sides(&mesh);
-  const auto faces2verts = mesh.ask_elem_verts();
-  const auto coords = mesh.coords();
-  const auto edge_verts =  mesh.ask_verts_of(o::EDGE);
-  const auto faceEdges = faces2edges.ab2b;
-  const auto triArea = measure_elements_real(&mesh);
+  const auto edges2faces = ctx.sideElems();
+  const auto side_is_exposed = ctx.sideIsExposed();
+  const auto faceEdges = ctx.elemSides();
+  const auto tri_inv = ctx.geometry().elemInverses();
+  const auto edge_lines = ctx.geometry().edgeLines();
 
   const auto psCapacity = ptcls->capacity();
 
   // ptcl_done[i] = 1 : particle i has hit a boundary or reached its destination
-  o::Write<o::LO> ptcl_done(psCapacity, 1, "ptcl_done");
+  auto ptcl_done = ctx.ptclDone(psCapacity);
+  reset_ptcl_done(ptcl_done, psCapacity);
   // store the last crossed edge
-  o::Write<o::LO> lastEdge(psCapacity,-1);
+  auto lastEdge = ctx.lastSide(psCapacity);
   auto lamb = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
     if(mask > 0) {
       if (elem_ids[pid] == -1) {
@@ -1015,11 +1436,9 @@ bool search_mesh_2d(o::Mesh& mesh, // (in) mesh
       auto searchElm = elem_ids[pid];
       auto ptcl = pid_d(pid);
       OMEGA_H_CHECK(searchElm >= 0);
-      auto faceVerts = o::gather_verts<3>(faces2verts, searchElm);
-      const auto faceCoords = o::gather_vectors<3,2>(coords, faceVerts);
       auto ptclOrigin = makeVector2(pid, x_ps_d);
       Omega_h::Vector<3> faceBcc;
-      barycentric_tri(triArea, faceCoords, ptclOrigin, faceBcc, searchElm);
+      barycentric_tri_cached(tri_inv, searchElm, ptclOrigin, faceBcc);
       if(!all_positive(faceBcc,1e-8)) {
         if (debug) {
           printf("%d Particle not in element! ptcl %d elem %d => %d "
@@ -1039,32 +1458,63 @@ bool search_mesh_2d(o::Mesh& mesh, // (in) mesh
     fprintf(stderr, "[WARNING] Rank %d: %d particles are not located in their "
             "starting elements. Deleting them...\n", rank, numNotInElem_h[0]);
   }
-  bool found = false;
+  // indices of the particles that are still moving towards their destination
+  auto active = compact_active_ptcls(ptcl_done, o::LOs(psCapacity, 0, 1));
+  bool found = (active.size() == 0);
   int loops = 0;
+  const auto fallbackSteps = ctx.longFlightSteps();
   while(!found) {
-    auto checkCurrentElm = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
+    const auto numActive = active.size();
+    if(fallbackSteps && loops >= fallbackSteps) {
+      //resolve the remaining long-flight particles with the spatial index
+      const auto grid = ctx.spatialIndex().locator();
+      o::Write<o::LO> numLost(1, 0, "numLost");
+      auto longFlight = OMEGA_H_LAMBDA(o::LO i) {
+        const auto pid = active[i];
+        const auto ptclDest = makeVector2(pid, xtgt_ps_d);
+        const auto ptclOrigin = makeVector2(pid, x_ps_d);
+        o::LO xedge = -1;
+        const auto elm = locate_segment_2d(grid, edge_lines, faceEdges, ptclOrigin,
+                                           ptclDest, xedge);
+        elem_ids[pid] = elm;
+        if(elm < 0 && xedge < 0) {
+          if (debug)
+            printf("rank %d ptcl %d not located by the long-flight fallback\n",
+                   rank, pid_d(pid));
+          Kokkos::atomic_add(&(numLost[0]), 1);
+        }
+        ptcl_done[pid] = 1;
+      };
+      o::parallel_for(numActive, longFlight, "pumipic_longFlightFallback");
+      o::HostWrite<o::LO> numLost_h(numLost);
+      if(numLost_h[0])
+        fprintf(stderr, "WARNING:Rank %d: %d particles were not located by the "
+                "long-flight fallback\n", rank, numLost_h[0]);
+      found = (numLost_h[0] == 0);
+      break;
+    }
+    auto checkCurrentElm = OMEGA_H_LAMBDA(o::LO i) {
+      const auto pid = active[i];
       //active particle that is still moving to its target position
-      if( mask > 0 && !ptcl_done[pid] ) {
+      if( !ptcl_done[pid] ) {
         auto searchElm = elem_ids[pid];
         auto ptcl = pid_d(pid);
         OMEGA_H_CHECK(searchElm >= 0);
         const auto edges = o::gather_down<3>(faceEdges, searchElm);
-        const auto faceVerts = o::gather_verts<3>(faces2verts, searchElm);
-        const auto faceCoords = o::gather_vectors<3,2>(coords, faceVerts);
         const auto ptclDest = makeVector2(pid, xtgt_ps_d);
-        const auto ptclOrigin = makeVector2(pid, x_ps_d);
         Omega_h::Vector<3> faceBcc;
-        barycentric_tri(triArea, faceCoords, ptclDest, faceBcc, searchElm);
+        barycentric_tri_cached(tri_inv, searchElm, ptclDest, faceBcc);
         auto isDestInParentElm = all_positive(faceBcc);
         ptcl_done[pid] = isDestInParentElm;
         const int idx = min3(faceBcc);
         lastEdge[pid] = edges[idx];
       }
     };
-    parallel_for(ptcls, checkCurrentElm);
+    o::parallel_for(numActive, checkCurrentElm, "pumipic_checkCurrentElm");
 
-    auto checkExposedEdges = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
-      if( mask > 0 && !ptcl_done[pid] ) {
+    auto checkExposedEdges = OMEGA_H_LAMBDA(o::LO i) {
+      const auto pid = active[i];
+      if( !ptcl_done[pid] ) {
         auto searchElm = elem_ids[pid];
         auto ptcl = pid_d(pid);
         assert(lastEdge[pid] != -1);
@@ -1074,12 +1524,13 @@ bool search_mesh_2d(o::Mesh& mesh, // (in) mesh
         elem_ids[pid] = exposed ? -1 : elem_ids[pid]; //leaves domain if exposed
       }
     };
-    parallel_for(ptcls, checkExposedEdges, "pumipic_checkExposedEdges");
+    o::parallel_for(numActive, checkExposedEdges, "pumipic_checkExposedEdges");
 
     auto e2f_vals = edges2faces.ab2b; // CSR value array
     auto e2f_offsets = edges2faces.a2ab; // CSR offset array, index by mesh edge ids
-    auto setNextElm = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
-      if( mask > 0 && !ptcl_done[pid] ) {
+    auto setNextElm = OMEGA_H_LAMBDA(o::LO i) {
+      const auto pid = active[i];
+      if( !ptcl_done[pid] ) {
         auto searchElm = elem_ids[pid];
         auto ptcl = pid_d(pid);
         auto bridge = lastEdge[pid];
@@ -1095,19 +1546,18 @@ bool search_mesh_2d(o::Mesh& mesh, // (in) mesh
         elem_ids[pid] = nextElm;
       }
     };
-    parallel_for(ptcls, setNextElm, "pumipic_setNextElm");
+    o::parallel_for(numActive, setNextElm, "pumipic_setNextElm");
 
-    found = true;
-    o::LOs ptcl_done_r(ptcl_done);
-    auto minFlag = o::get_min(ptcl_done_r);
-    if(minFlag == 0)
-      found = false;
+    //drop the particles that finished during this iteration
+    active = compact_active_ptcls(ptcl_done, active);
+    found = (active.size() == 0);
     ++loops;
 
     if(looplimit && loops >= looplimit) {
       Omega_h::Write<o::LO> numNotFound(1,0);
-      auto ptclsNotFound = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
-        if( mask > 0 && !ptcl_done[pid] ) {
+      auto ptclsNotFound = OMEGA_H_LAMBDA(o::LO i) {
+        const auto pid = active[i];
+        if( !ptcl_done[pid] ) {
           auto searchElm = elem_ids[pid];
           auto ptcl = pid_d(pid);
           const auto ptclDest = makeVector2(pid, xtgt_ps_d);
@@ -1121,7 +1571,7 @@ bool search_mesh_2d(o::Mesh& mesh, // (in) mesh
           Kokkos::atomic_add(&(numNotFound[0]), 1);
         }
       };
-      ps::parallel_for(ptcls, ptclsNotFound, "ptclsNotFound");
+      o::parallel_for(active.size(), ptclsNotFound, "ptclsNotFound");
       Omega_h::HostWrite<o::LO> numNotFound_h(numNotFound);
       fprintf(stderr, "ERROR:Rank %d: loop limit %d exceeded. %d particles were "
               "not found. Deleting them...\n", rank, looplimit, numNotFound_h[0]);
@@ -1137,5 +1587,76 @@ bool search_mesh_2d(o::Mesh& mesh, // (in) mesh
   return found;
 }
 
+template < class ParticleStruct, typename CurrentCoordView,
+           typename TargetCoordView, typename SegmentInt>
+bool search_mesh_2d(o::Mesh& mesh, // (in) mesh
+                    ParticleStruct* ptcls, // (in) particle structure
+                    CurrentCoordView x_ps_d, // (in) starting particle positions
+                    TargetCoordView xtgt_ps_d, // (in) target particle positions
+                    SegmentInt pid_d, // (in) particle ids
+                    o::Write<o::LO> elem_ids, // (out) parent element ids for the target positions
+                    int looplimit=0,  // (in) [optional] number of loops before giving up
+                    bool debug = false) {
+  SearchContext ctx(mesh);
+  return search_mesh_2d(ctx, ptcls, x_ps_d, xtgt_ps_d, pid_d, elem_ids,
+                        looplimit, debug);
+}
+
+/* Batched 2D point location without a particle structure
+
+   Locates the target of each point (2 reals per point) by walking from
+   start_elems in one flat kernel over the points. On return elem_ids holds
+   the triangle containing each target, or -1 if the walk left the mesh in
+   which case xedge_ids holds the exposed edge that was crossed (-1
+   otherwise). steplimit is the per-point step budget; 0 selects the number
+   of mesh elements. Returns true if every point was resolved.
+*/
+inline bool search_points_2d(SearchContext& ctx, // (in) search context of the mesh
+    o::Reals dest, // (in) target point positions
+    o::LOs start_elems, // (in) elements to start the walk from
+    o::Write<o::LO>& elem_ids, // (out) parent element ids for the target positions
+    o::Write<o::LO>& xedge_ids, // (out) exposed edges crossed by points leaving the mesh
+    int steplimit=0) {
+  Kokkos::Profiling::pushRegion("pumipic_search_points_2d");
+  const auto tri_inv = ctx.geometry().elemInverses();
+  const auto elem_edges = ctx.elemSides();
+  const auto edge_adj = ctx.geometry().edgeNeighbors();
+  const o::LO maxSteps = (steplimit > 0) ? steplimit : ctx.geometry().nelems();
+  const o::LO fallbackSteps = ctx.longFlightSteps();
+  const bool useIndex = fallbackSteps > 0;
+  const o::LO walkSteps = (useIndex && fallbackSteps < maxSteps) ? fallbackSteps : maxSteps;
+  GridLocator grid;
+  if(useIndex)
+    grid = ctx.spatialIndex().locator();
+  const o::LO npts = start_elems.size();
+  elem_ids = o::Write<o::LO>(npts, "elem_ids");
+  xedge_ids = o::Write<o::LO>(npts, -1, "xedge_ids");
+  auto elm_ids = elem_ids;
+  auto xedges = xedge_ids;
+  o::Write<o::LO> numNotFound(1, 0, "numNotFound");
+  auto walk = OMEGA_H_LAMBDA(o::LO i) {
+    o::Vector<2> d_pt;
+    for(int j=0; j<2; ++j)
+      d_pt[j] = dest[i*2+j];
+    o::LO elm = start_elems[i];
+    o::LO xedge = -1;
+    bool done = walk_tri(tri_inv, edge_adj, elem_edges, d_pt, walkSteps, elm, xedge);
+    if(!done && useIndex) {
+      //no origin is given to trace the crossed edge from, only locate the target
+      elm = grid.locate(d_pt);
+      xedge = -1;
+      done = (elm >= 0);
+    }
+    elm_ids[i] = elm;
+    xedges[i] = xedge;
+    if(!done)
+      Kokkos::atomic_add(&(numNotFound[0]), 1);
+  };
+  o::parallel_for(npts, walk, "pumipic_search_points_2d");
+  o::HostWrite<o::LO> numNotFound_h(numNotFound);
+  Kokkos::Profiling::popRegion();
+  return numNotFound_h[0] == 0;
+}
+
 } //namespace
 #endif //define
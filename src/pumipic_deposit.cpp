@@ -0,0 +1,41 @@
+#include "pumipic_deposit.hpp"
+#include "Omega_h_adj.hpp"
+#include "Omega_h_for.hpp"
+
+namespace pumipic {
+  Deposition::Deposition(o::Mesh& mesh, int nc, Mode m) : ncomp(nc), mode_(m) {
+    if (ncomp < 1) {
+      fprintf(stderr, "[ERROR] Deposition requires at least one component per vertex\n");
+      throw 1;
+    }
+    const int dim = mesh.dim();
+    nelems = mesh.nelems();
+    nverts = mesh.nverts();
+    nvpe = dim + 1;
+    verts2elems = mesh.ask_up(0, dim);
+    elem_accum = o::Write<o::Real>(nelems * nvpe * ncomp, 0, "deposit_elem_accum");
+  }
+
+  o::Reals Deposition::gatherToVertices() {
+    const auto v2e_offsets = verts2elems.a2ab;
+    const auto v2e_elems = verts2elems.ab2b;
+    const auto v2e_codes = verts2elems.codes;
+    const auto accum = o::Reals(elem_accum);
+    const auto nc = ncomp;
+    const auto slotsPerElm = nvpe * ncomp;
+    o::Write<o::Real> vtx_vals(nverts * ncomp, "deposit_vtx_vals");
+    auto gather = OMEGA_H_LAMBDA(const o::LO v) {
+      for (int c = 0; c < nc; ++c) {
+        o::Real sum = 0;
+        for (o::LO ve = v2e_offsets[v]; ve < v2e_offsets[v+1]; ++ve) {
+          const auto elm = v2e_elems[ve];
+          const auto localVtx = o::code_which_down(v2e_codes[ve]);
+          sum += accum[elm * slotsPerElm + localVtx * nc + c];
+        }
+        vtx_vals[v * nc + c] = sum;
+      }
+    };
+    o::parallel_for(nverts, gather, "pumipic_deposit_gather");
+    return o::Reals(vtx_vals);
+  }
+}
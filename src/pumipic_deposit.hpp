@@ -0,0 +1,173 @@
+#ifndef PUMIPIC_DEPOSIT_HPP
+#define PUMIPIC_DEPOSIT_HPP
+
+#include "Omega_h_mesh.hpp"
+#include <particle_structs.hpp>
+#include "pumipic_profiling.hpp"
+
+namespace o = Omega_h;
+namespace ps = particle_structs;
+
+namespace pumipic {
+
+/*
+  Device side handle passed to the deposition kernel
+
+  Contributions of a particle are added to the vertex slots of its parent
+  element by local vertex index. With DEPOSIT_ELEMENT_TEAMS the slots are
+  private to one thread of the element's team and are plain adds; with
+  DEPOSIT_ATOMIC they are the element's slots in the mesh array and every
+  add is atomic.
+*/
+struct ElementContribution {
+  o::Real* slots;
+  int ncomp;
+  bool atomic;
+  OMEGA_H_DEVICE void add(const int localVtx, const int comp, const o::Real val) const {
+    o::Real* slot = slots + localVtx * ncomp + comp;
+    if (atomic)
+      Kokkos::atomic_add(slot, val);
+    else
+      *slot += val;
+  }
+};
+
+//Number of private copies of the element sums in each team
+//The particles of an element are split round robin between the copies
+const int DEPOSIT_TEAM_LANES = 8;
+
+/* Accumulate the particle contributions to the element slots with one team
+   per element
+   accum - nelems*nvpe*ncomp element slots, every slot is overwritten
+*/
+template <class PS, class ContribFn>
+void deposit_element_teams(PS* ptcls, ContribFn& contrib, o::Write<o::Real> accum,
+                           const int nvpe, const int ncomp, std::string name) {
+  typedef typename PS::TeamMember TeamMember;
+  typedef typename PS::ElementPtcls ElementPtcls;
+  typedef Kokkos::View<o::Real*, typename PS::execution_space::scratch_memory_space,
+                       Kokkos::MemoryTraits<Kokkos::Unmanaged> > ScratchReals;
+  const int slotsPerElm = nvpe * ncomp;
+  const int nlanes = DEPOSIT_TEAM_LANES;
+  const std::size_t scratch = ScratchReals::shmem_size(nlanes * slotsPerElm);
+  auto accumulate = PS_LAMBDA(const TeamMember& team, const lid_t& e,
+                              const ElementPtcls& elmPtcls) {
+    ScratchReals sums(team.team_scratch(0), nlanes * slotsPerElm);
+    Kokkos::parallel_for(Kokkos::TeamThreadRange(team, nlanes * slotsPerElm),
+                         [&](const int i) {
+      sums(i) = 0;
+    });
+    team.team_barrier();
+    const lid_t n = elmPtcls.size();
+    Kokkos::parallel_for(Kokkos::TeamThreadRange(team, nlanes), [&](const int lane) {
+      ElementContribution c{sums.data() + lane * slotsPerElm, ncomp, false};
+      for (lid_t i = lane; i < n; i += nlanes)
+        contrib(e, elmPtcls(i), c);
+    });
+    team.team_barrier();
+    //every slot of the element is written, empty elements write zeros
+    Kokkos::parallel_for(Kokkos::TeamThreadRange(team, slotsPerElm), [&](const int s) {
+      o::Real sum = 0;
+      for (int lane = 0; lane < nlanes; ++lane)
+        sum += sums(lane * slotsPerElm + s);
+      accum[e * slotsPerElm + s] = sum;
+    });
+  };
+  ps::parallel_for_elements(ptcls, accumulate, scratch, name);
+}
+
+/* Accumulate the particle contributions to the element slots with atomics
+   accum - nelems*nvpe*ncomp element slots, zeroed before accumulating
+*/
+template <class PS, class ContribFn>
+void deposit_atomic(PS* ptcls, ContribFn& contrib, o::Write<o::Real> accum,
+                    const int nvpe, const int ncomp, std::string name) {
+  Kokkos::deep_copy(accum.view(), 0);
+  o::Real* slots = accum.data();
+  const int slotsPerElm = nvpe * ncomp;
+  auto accumulate = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
+    if (mask > 0) {
+      ElementContribution c{slots + e * slotsPerElm, ncomp, true};
+      contrib(e, pid, c);
+    }
+  };
+  ps::parallel_for(ptcls, accumulate, name);
+}
+
+/*
+  Particle to mesh vertex deposition
+
+  Deposition is split in two phases:
+    1. the particles accumulate into per-element vertex slots. By default
+       (DEPOSIT_ELEMENT_TEAMS) one team runs per element: the team's threads
+       accumulate disjoint subsets of the element's particles into their own
+       copy of the element's nvpe*ncomp sums in level 0 scratch memory, the
+       copies are reduced in the team and each slot of the element is written
+       once. No atomics are used and no copy of the mesh-sized slot array is
+       made. DEPOSIT_ATOMIC is the fallback for structures or contribution
+       kernels that can not run under a team: each particle adds to the
+       element's slots with atomics.
+    2. each vertex sums the slots of its adjacent elements using the
+       vertex-to-element adjacency. No atomics are needed.
+
+  The deposited array has numComponents() values per vertex. The object
+  keeps its buffers between calls and should be rebuilt if the mesh changes.
+*/
+class Deposition {
+public:
+  enum Mode {
+    DEPOSIT_ELEMENT_TEAMS, //one team per element, sums in scratch memory
+    DEPOSIT_ATOMIC //atomic adds to the element slots
+  };
+
+  Deposition(o::Mesh& mesh, int ncomp = 1, Mode mode = DEPOSIT_ELEMENT_TEAMS);
+
+  int numComponents() const {return ncomp;}
+  Mode mode() const {return mode_;}
+
+  /* Deposit to the mesh vertices
+     ptcls - particle structure, the element ids must be of the mesh
+     contrib - kernel called on each active particle as
+               contrib(elm, pid, c) with an ElementContribution c and
+               adding its contributions with c.add(localVertex, component, value)
+     returns nverts*numComponents() deposited values
+  */
+  template <class PS, class ContribFn>
+  o::Reals toVertices(PS* ptcls, ContribFn& contrib,
+                      std::string name = "pumipic_deposit");
+
+private:
+  //Sum the element slots to the vertices
+  o::Reals gatherToVertices();
+
+  int ncomp;
+  Mode mode_;
+  o::LO nelems;
+  o::LO nverts;
+  int nvpe;
+  o::Adj verts2elems;
+  o::Write<o::Real> elem_accum;
+};
+
+template <class PS, class ContribFn>
+o::Reals Deposition::toVertices(PS* ptcls, ContribFn& contrib, std::string name) {
+  const auto btime = pumipic_prebarrier();
+  Kokkos::Profiling::pushRegion(name);
+  Kokkos::Timer timer;
+  if (ptcls->nElems() != nelems) {
+    fprintf(stderr, "[ERROR] Deposition on a particle structure with %d elements "
+            "does not match the mesh with %d elements\n", ptcls->nElems(), nelems);
+    throw 1;
+  }
+  if (mode_ == DEPOSIT_ATOMIC)
+    deposit_atomic(ptcls, contrib, elem_accum, nvpe, ncomp, name);
+  else
+    deposit_element_teams(ptcls, contrib, elem_accum, nvpe, ncomp, name);
+  o::Reals vtx_vals = gatherToVertices();
+  RecordTime(name, timer.seconds(), btime);
+  Kokkos::Profiling::popRegion();
+  return vtx_vals;
+}
+
+} //namespace
+#endif
@@ -0,0 +1,111 @@
+#include "pumipic_geometry.hpp"
+#include "Omega_h_for.hpp"
+#include "Omega_h_adj.hpp"
+#include "Omega_h_mark.hpp"
+#include "pumipic_utils.hpp"
+
+namespace pumipic {
+  GeometryCache::GeometryCache(o::Mesh& mesh) {
+    dim_ = mesh.dim();
+    nelems_ = mesh.nelems();
+    const auto elem2verts = mesh.ask_elem_verts();
+    const auto coords = mesh.coords();
+    if (dim_ == 3) {
+      o::Write<o::Real> inv(nelems_*TetInvSize, "tet_inverses");
+      o::Write<o::Real> planes(nelems_*TetPlaneSize, "tet_face_planes");
+      o::Write<o::LO> adj(nelems_*4, -1, "tet_face_neighbors");
+      const auto side_is_exposed = mark_exposed_sides(&mesh);
+      const auto face_verts = mesh.ask_verts_of(2);
+      const auto elem_faces = mesh.ask_down(3, 2).ab2b;
+      const auto dual = mesh.ask_dual();
+      const auto dual_elems = dual.ab2b;
+      const auto dual_faces = dual.a2ab;
+      auto fill = OMEGA_H_LAMBDA(o::LO e) {
+        const auto tetv2v = o::gather_verts<4>(elem2verts, e);
+        const auto tet = o::gather_vectors<4, 3>(coords, tetv2v);
+        o::Matrix<3, 3> basis;
+        for (int j = 0; j < 3; ++j)
+          basis[j] = tet[j+1] - tet[0];
+        const auto basis_inv = o::invert(basis);
+        for (int j = 0; j < 3; ++j) {
+          for (int i = 0; i < 3; ++i)
+            inv[e*TetInvSize + j*3 + i] = basis_inv[j][i];
+          inv[e*TetInvSize + 9 + j] = tet[0][j];
+        }
+        const auto face_ids = o::gather_down<4>(elem_faces, e);
+        auto dual_elem_id = dual_faces[e];
+        for (int fi = 0; fi < 4; ++fi) {
+          const auto face_id = face_ids[fi];
+          const auto fv2v = o::gather_verts<3>(face_verts, face_id);
+          const auto abc = o::gather_vectors<3, 3>(coords, fv2v);
+          auto normv = o::cross(abc[1] - abc[0], abc[2] - abc[0]);
+          if (isFaceFlipped(fi, fv2v, tetv2v))
+            normv = -1*normv;
+          const auto n = o::normalize(normv);
+          for (int i = 0; i < 3; ++i)
+            planes[e*TetPlaneSize + fi*4 + i] = n[i];
+          planes[e*TetPlaneSize + fi*4 + 3] = o::inner_product(n, abc[0]);
+          if (!side_is_exposed[face_id]) {
+            adj[e*4 + fi] = dual_elems[dual_elem_id];
+            ++dual_elem_id;
+          }
+        }
+      };
+      o::parallel_for(nelems_, fill, "pumipic_geometry_cache_3d");
+      elem_inv = o::Reals(inv);
+      face_planes = o::Reals(planes);
+      face_adj = o::LOs(adj);
+    }
+    else if (dim_ == 2) {
+      o::Write<o::Real> inv(nelems_*TriInvSize, "tri_inverses");
+      o::Write<o::Real> lines(nelems_*TriEdgeSize, "tri_edge_lines");
+      o::Write<o::LO> adj(nelems_*3, -1, "tri_edge_neighbors");
+      const auto side_is_exposed = mark_exposed_sides(&mesh);
+      const auto elem_edges = mesh.ask_down(2, 1).ab2b;
+      const auto dual = mesh.ask_dual();
+      const auto dual_elems = dual.ab2b;
+      const auto dual_edges = dual.a2ab;
+      auto fill = OMEGA_H_LAMBDA(o::LO e) {
+        const auto triv2v = o::gather_verts<3>(elem2verts, e);
+        const auto tri = o::gather_vectors<3, 2>(coords, triv2v);
+        o::Matrix<2, 2> basis;
+        for (int j = 0; j < 2; ++j)
+          basis[j] = tri[j+1] - tri[0];
+        const auto basis_inv = o::invert(basis);
+        for (int j = 0; j < 2; ++j) {
+          for (int i = 0; i < 2; ++i)
+            inv[e*TriInvSize + j*2 + i] = basis_inv[j][i];
+          inv[e*TriInvSize + 4 + j] = tri[0][j];
+        }
+        const auto edge_ids = o::gather_down<3>(elem_edges, e);
+        auto dual_elem_id = dual_edges[e];
+        for (int ei = 0; ei < 3; ++ei) {
+          const auto v0 = tri[o::simplex_down_template(o::FACE, o::EDGE, ei, 0)];
+          const auto v1 = tri[o::simplex_down_template(o::FACE, o::EDGE, ei, 1)];
+          const auto opp = tri[o::simplex_opposite_template(o::FACE, o::EDGE, ei)];
+          o::Vector<2> normv;
+          normv[0] = v1[1] - v0[1];
+          normv[1] = v0[0] - v1[0];
+          if (o::inner_product(normv, opp - v0) > 0)
+            normv = -1*normv;
+          const auto n = o::normalize(normv);
+          for (int i = 0; i < 2; ++i)
+            lines[e*TriEdgeSize + ei*3 + i] = n[i];
+          lines[e*TriEdgeSize + ei*3 + 2] = o::inner_product(n, v0);
+          if (!side_is_exposed[edge_ids[ei]]) {
+            adj[e*3 + ei] = dual_elems[dual_elem_id];
+            ++dual_elem_id;
+          }
+        }
+      };
+      o::parallel_for(nelems_, fill, "pumipic_geometry_cache_2d");
+      elem_inv = o::Reals(inv);
+      edge_lines = o::Reals(lines);
+      edge_adj = o::LOs(adj);
+    }
+    else {
+      fprintf(stderr, "[ERROR] GeometryCache does not support %d dimensional meshes\n", dim_);
+      throw 1;
+    }
+  }
+}
@@ -0,0 +1,174 @@
+#ifndef PUMIPIC_GEOMETRY_HPP
+#define PUMIPIC_GEOMETRY_HPP
+
+#include "Omega_h_mesh.hpp"
+#include "Omega_h_element.hpp"
+#include "Omega_h_shape.hpp"
+
+#include "pumipic_constants.hpp"
+
+namespace o = Omega_h;
+
+namespace pumipic {
+
+/*
+  Per-element geometry precomputed once per mesh for the search kernels
+
+  Every element stores the inverse of its simplex basis followed by its
+  first vertex so barycentric coordinates are a single matrix-vector product:
+    3D: 12 reals per tet (3x3 inverse column-major, vertex 0)
+    2D:  6 reals per triangle (2x2 inverse column-major, vertex 0)
+  In 3D every tet also stores the outward unit normal and plane offset of
+  its four faces in the order of mesh.ask_down(3, 2), 16 reals per tet, and
+  the element across each face (-1 if the face is exposed).
+  In 2D every triangle stores the outward unit normal and line offset of its
+  three edges in the order of mesh.ask_down(2, 1), 9 reals per triangle, and
+  the element across each edge (-1 if the edge is exposed).
+*/
+class GeometryCache {
+public:
+  explicit GeometryCache(o::Mesh& mesh);
+
+  int dim() const {return dim_;}
+  o::LO nelems() const {return nelems_;}
+  //Inverse simplex basis and origin of each element
+  o::Reals elemInverses() const {return elem_inv;}
+  //Outward face planes of each tet (3D only)
+  o::Reals facePlanes() const {return face_planes;}
+  //Element across each face of each tet (3D only)
+  o::LOs faceNeighbors() const {return face_adj;}
+  //Outward edge lines of each triangle (2D only)
+  o::Reals edgeLines() const {return edge_lines;}
+  //Element across each edge of each triangle (2D only)
+  o::LOs edgeNeighbors() const {return edge_adj;}
+
+private:
+  int dim_;
+  o::LO nelems_;
+  o::Reals elem_inv;
+  o::Reals face_planes;
+  o::LOs face_adj;
+  o::Reals edge_lines;
+  o::LOs edge_adj;
+};
+
+#define TetInvSize 12
+#define TriInvSize 6
+#define TetPlaneSize 16
+#define TriEdgeSize 9
+
+//Barycentric coordinates of pos from the inverse basis record at inv[b]
+//inv is the cached array or a copy of one record (e.g. in scratch memory)
+//bcc[i] is the coordinate of local vertex i
+template <typename InvArray>
+OMEGA_H_DEVICE void barycentric_tet_record(const InvArray& inv, const int b,
+    const o::Vector<3>& pos, o::Vector<4>& bcc) {
+  o::Vector<3> d;
+  for(int i=0; i<3; ++i)
+    d[i] = pos[i] - inv[b+9+i];
+  o::Real sum = 0;
+  for(int i=0; i<3; ++i) {
+    o::Real l = 0;
+    for(int j=0; j<3; ++j)
+      l += inv[b+j*3+i] * d[j];
+    bcc[i+1] = l;
+    sum += l;
+  }
+  bcc[0] = 1 - sum;
+}
+
+//Barycentric coordinates of pos in elem using the cached inverse basis
+//bcc[i] is the coordinate of local vertex i
+OMEGA_H_DEVICE void barycentric_tet_cached(const o::Reals& elem_inv,
+    const o::LO elem, const o::Vector<3>& pos, o::Vector<4>& bcc) {
+  barycentric_tet_record(elem_inv, elem*TetInvSize, pos, bcc);
+}
+
+OMEGA_H_DEVICE bool isPointWithinElemTetCached(const o::Reals& elem_inv,
+    const o::Vector<3>& pos, const o::LO elem, const o::Real tol=1.0e-20) {
+  o::Vector<4> bcc;
+  barycentric_tet_cached(elem_inv, elem, pos, bcc);
+  for(int i=0; i<4; ++i)
+    if(!(o::are_close(bcc[i], 0.0, tol, tol) || bcc[i] > 0))
+      return false;
+  return true;
+}
+
+//Intersection of the segment origin->dest with face fi of tet elem
+//Matches line_triangle_intx_simple: only exiting crossings are detected,
+//dproj is only written when origin is behind and dest in front of the face
+OMEGA_H_DEVICE bool line_face_intx_cached(const o::Reals& elem_inv,
+    const o::Reals& face_planes, const o::LO elem, const o::LO fi,
+    const o::Vector<3>& origin, const o::Vector<3>& dest,
+    o::Vector<3>& xpoint, o::Real& dproj, const o::Real tol=0) {
+  for(int i=0; i<3; ++i)
+    xpoint[i] = 0;
+  const auto b = elem*TetPlaneSize + fi*4;
+  o::Vector<3> n;
+  for(int i=0; i<3; ++i)
+    n[i] = face_planes[b+i];
+  const auto dist2plane = face_planes[b+3] - o::inner_product(n, origin);
+  const auto proj_end = o::inner_product(n, dest) - face_planes[b+3];
+  if(dist2plane < -tol || proj_end < -tol)
+    return false;
+  const auto line = dest - origin;
+  dproj = o::inner_product(line, n);
+  const o::Real par_t = (dproj>0) ? dist2plane/dproj : 0;
+  xpoint = origin + par_t * line;
+  if(dproj <= 0)
+    return false;
+  o::Vector<4> bcc;
+  barycentric_tet_cached(elem_inv, elem, xpoint, bcc);
+  //the coordinate of the vertex opposite the face vanishes on the face
+  const auto opp = o::simplex_opposite_template(o::REGION, o::FACE, fi);
+  for(int i=0; i<4; ++i)
+    if(i != opp && (bcc[i] < 0 || bcc[i] > 1))
+      return false;
+  return true;
+}
+
+//Area coordinates of pos from the inverse basis record at inv[b]
+//l[i] is the coordinate of local vertex i
+template <typename InvArray>
+OMEGA_H_DEVICE void vertex_coords_tri_record(const InvArray& inv, const int b,
+    const o::Vector<2>& pos, o::Vector<3>& l) {
+  const o::Real d0 = pos[0] - inv[b+4];
+  const o::Real d1 = pos[1] - inv[b+5];
+  l[1] = inv[b]*d0 + inv[b+2]*d1;
+  l[2] = inv[b+1]*d0 + inv[b+3]*d1;
+  l[0] = 1 - l[1] - l[2];
+}
+
+//Area coordinates of pos in triangle elem in the edge order of barycentric_tri
+OMEGA_H_DEVICE void barycentric_tri_cached(const o::Reals& elem_inv,
+    const o::LO elem, const o::Vector<2>& pos, o::Vector<3>& bcc) {
+  o::Vector<3> l;
+  vertex_coords_tri_record(elem_inv, elem*TriInvSize, pos, l);
+  for(int i=0; i<3; ++i)
+    bcc[i] = l[o::simplex_opposite_template(o::FACE, o::EDGE, i)];
+}
+
+//Intersection of the segment origin->dest with edge ei of triangle elem
+//Only exiting crossings are detected, as in line_face_intx_cached; t is the
+//parameter of xpoint along the segment
+OMEGA_H_DEVICE bool line_edge_intx_cached(const o::Reals& elem_inv,
+    const o::Reals& edge_lines, const o::LO elem, const o::LO ei,
+    const o::Vector<2>& origin, const o::Vector<2>& dest,
+    o::Vector<2>& xpoint, o::Real& t, const o::Real tol=0) {
+  const auto b = elem*TriEdgeSize + ei*3;
+  const o::Real dist_o = edge_lines[b]*origin[0] + edge_lines[b+1]*origin[1] - edge_lines[b+2];
+  const o::Real dist_d = edge_lines[b]*dest[0] + edge_lines[b+1]*dest[1] - edge_lines[b+2];
+  if(dist_o > 0 || dist_d <= 0)
+    return false;
+  t = -dist_o / (dist_d - dist_o);
+  xpoint = origin + t * (dest - origin);
+  o::Vector<3> bcc;
+  barycentric_tri_cached(elem_inv, elem, xpoint, bcc);
+  for(int j=0; j<3; ++j)
+    if(j != ei && (bcc[j] < -tol || bcc[j] > 1 + tol))
+      return false;
+  return true;
+}
+
+} //namespace
+#endif
@@ -0,0 +1,30 @@
+#include "pumipic_interpolate.hpp"
+#include "Omega_h_for.hpp"
+
+namespace pumipic {
+  FieldGather::FieldGather(o::Mesh& mesh) : mesh_(&mesh), geom(mesh), ncomp(0) {}
+
+  FieldGather::FieldGather(o::Mesh& mesh, const GeometryCache& g)
+    : mesh_(&mesh), geom(g), ncomp(0) {}
+
+  void FieldGather::setField(o::Reals vtx_field, int nc) {
+    if (nc < 1 || vtx_field.size() != mesh_->nverts() * nc) {
+      fprintf(stderr, "[ERROR] Vertex field of size %d does not hold %d components "
+              "for %d vertices\n", vtx_field.size(), nc, mesh_->nverts());
+      throw 1;
+    }
+    ncomp = nc;
+    const auto nvpe = mesh_->dim() + 1;
+    const auto elem2verts = mesh_->ask_elem_verts();
+    o::Write<o::Real> packed(mesh_->nelems() * nvpe * nc, "field_gather_elem_field");
+    auto pack = OMEGA_H_LAMBDA(const o::LO e) {
+      for (int i = 0; i < nvpe; ++i) {
+        const auto v = elem2verts[e * nvpe + i];
+        for (int c = 0; c < nc; ++c)
+          packed[(e * nvpe + i) * nc + c] = vtx_field[v * nc + c];
+      }
+    };
+    o::parallel_for(mesh_->nelems(), pack, "pumipic_field_gather_pack");
+    elem_field = o::Reals(packed);
+  }
+}
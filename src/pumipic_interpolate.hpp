@@ -0,0 +1,175 @@
+#ifndef PUMIPIC_INTERPOLATE_HPP
+#define PUMIPIC_INTERPOLATE_HPP
+
+#include "Omega_h_mesh.hpp"
+#include <particle_structs.hpp>
+#include "pumipic_geometry.hpp"
+#include "pumipic_profiling.hpp"
+
+namespace o = Omega_h;
+namespace ps = particle_structs;
+
+namespace pumipic {
+
+/*
+  Mesh to particle interpolation of vertex fields
+
+  The vertex values of every element are packed contiguously once per field
+  (setField), so the interpolation kernel reads one element record and the
+  cached inverse basis of the element instead of gathering the element
+  vertices, their coordinates and the field values through the
+  element-to-vertex adjacency for every particle. toParticles runs one team
+  per element which stages the element's records in scratch memory once for
+  all of its particles.
+
+  The record of element e holds (dim+1)*ncomp values: the ncomp components
+  of local vertex 0, then of local vertex 1, ...
+*/
+class FieldGather {
+public:
+  explicit FieldGather(o::Mesh& mesh);
+  FieldGather(o::Mesh& mesh, const GeometryCache& geom);
+
+  int dim() const {return geom.dim();}
+  int numComponents() const {return ncomp;}
+  const GeometryCache& geometry() const {return geom;}
+  //Packed element records of the field set with setField
+  o::Reals elemField() const {return elem_field;}
+
+  /* Pack the vertex field to be interpolated
+     vtx_field - nverts*ncomp values
+     ncomp - number of components per vertex
+  */
+  void setField(o::Reals vtx_field, int ncomp);
+
+  /* Interpolate the field to the particle positions
+     ptcls - particle structure, the element ids must be of the mesh
+     x - particle positions, dim() components per particle
+     out - interpolated values, numComponents() components per particle
+  */
+  template <class PS, typename CoordSegment, typename OutSegment>
+  void toParticles(PS* ptcls, CoordSegment x, OutSegment out,
+                   std::string name = "pumipic_field_gather");
+
+private:
+  o::Mesh* mesh_;
+  GeometryCache geom;
+  int ncomp;
+  o::Reals elem_field;
+};
+
+//Interpolate one component from the vertex weights w of an element record
+//the values of the component are rec[b], rec[b+ncomp], ... for each vertex
+template <int NV, typename FieldArray>
+OMEGA_H_DEVICE o::Real interpolate_weights(const FieldArray& rec, const int b,
+    const o::Vector<NV>& w, const int ncomp) {
+  o::Real val = 0;
+  for (int i = 0; i < NV; ++i)
+    val += w[i] * rec[b + i * ncomp];
+  return val;
+}
+
+//Interpolate component comp of the packed field at pos in tet elem
+//To interpolate several components compute the coordinates once with
+//barycentric_tet_cached and call interpolate_weights per component
+OMEGA_H_DEVICE o::Real interpolate_tet_cached(const o::Reals& elem_inv,
+    const o::Reals& elem_field, const o::LO elem, const o::Vector<3>& pos,
+    const int ncomp, const int comp) {
+  o::Vector<4> bcc;
+  barycentric_tet_cached(elem_inv, elem, pos, bcc);
+  return interpolate_weights(elem_field, elem * 4 * ncomp + comp, bcc, ncomp);
+}
+
+//Interpolate component comp of the packed field at pos in triangle elem
+OMEGA_H_DEVICE o::Real interpolate_tri_cached(const o::Reals& elem_inv,
+    const o::Reals& elem_field, const o::LO elem, const o::Vector<2>& pos,
+    const int ncomp, const int comp) {
+  o::Vector<3> l;
+  vertex_coords_tri_record(elem_inv, elem * TriInvSize, pos, l);
+  return interpolate_weights(elem_field, elem * 3 * ncomp + comp, l, ncomp);
+}
+
+//Each particle computes its coordinates once and interpolates every
+//component from the staged record
+template <class PS, typename CoordSegment, typename OutSegment>
+void FieldGather::toParticles(PS* ptcls, CoordSegment x, OutSegment out,
+                              std::string name) {
+  typedef typename PS::TeamMember TeamMember;
+  typedef typename PS::ElementPtcls ElementPtcls;
+  typedef Kokkos::View<o::Real*, typename PS::execution_space::scratch_memory_space,
+                       Kokkos::MemoryTraits<Kokkos::Unmanaged> > ScratchReals;
+  const auto btime = pumipic_prebarrier();
+  Kokkos::Profiling::pushRegion(name);
+  Kokkos::Timer timer;
+  if (!elem_field.exists()) {
+    fprintf(stderr, "[ERROR] FieldGather::setField must be called before "
+            "interpolating to particles\n");
+    throw 1;
+  }
+  const auto elem_inv = geom.elemInverses();
+  const auto field = elem_field;
+  const auto nc = ncomp;
+  const int invSize = geom.dim() == 3 ? TetInvSize : TriInvSize;
+  const int recSize = (geom.dim() + 1) * nc;
+  const std::size_t scratch = ScratchReals::shmem_size(invSize) +
+                              ScratchReals::shmem_size(recSize);
+  if (geom.dim() == 3) {
+    auto gather = PS_LAMBDA(const TeamMember& team, const lid_t& e,
+                            const ElementPtcls& elmPtcls) {
+      ScratchReals inv(team.team_scratch(0), TetInvSize);
+      ScratchReals rec(team.team_scratch(0), recSize);
+      Kokkos::parallel_for(Kokkos::TeamThreadRange(team, TetInvSize + recSize),
+                           [&](const int i) {
+        if (i < TetInvSize)
+          inv(i) = elem_inv[e * TetInvSize + i];
+        else
+          rec(i - TetInvSize) = field[e * recSize + i - TetInvSize];
+      });
+      team.team_barrier();
+      Kokkos::parallel_for(Kokkos::TeamThreadRange(team, elmPtcls.size()),
+                           [&](const lid_t i) {
+        const lid_t pid = elmPtcls(i);
+        o::Vector<3> pos;
+        for (int j = 0; j < 3; ++j)
+          pos[j] = x(pid, j);
+        o::Vector<4> bcc;
+        barycentric_tet_record(inv, 0, pos, bcc);
+        for (int c = 0; c < nc; ++c)
+          out(pid, c) = interpolate_weights(rec, c, bcc, nc);
+      });
+    };
+    ps::parallel_for_elements(ptcls, gather, scratch, name);
+  }
+  else {
+    auto gather = PS_LAMBDA(const TeamMember& team, const lid_t& e,
+                            const ElementPtcls& elmPtcls) {
+      ScratchReals inv(team.team_scratch(0), TriInvSize);
+      ScratchReals rec(team.team_scratch(0), recSize);
+      Kokkos::parallel_for(Kokkos::TeamThreadRange(team, TriInvSize + recSize),
+                           [&](const int i) {
+        if (i < TriInvSize)
+          inv(i) = elem_inv[e * TriInvSize + i];
+        else
+          rec(i - TriInvSize) = field[e * recSize + i - TriInvSize];
+      });
+      team.team_barrier();
+      Kokkos::parallel_for(Kokkos::TeamThreadRange(team, elmPtcls.size()),
+                           [&](const lid_t i) {
+        const lid_t pid = elmPtcls(i);
+        o::Vector<2> pos;
+        for (int j = 0; j < 2; ++j)
+          pos[j] = x(pid, j);
+        o::Vector<3> l;
+        vertex_coords_tri_record(inv, 0, pos, l);
+        for (int c = 0; c < nc; ++c)
+          out(pid, c) = interpolate_weights(rec, c, l, nc);
+      });
+    };
+    ps::parallel_for_elements(ptcls, gather, scratch, name);
+  }
+  RecordTime(name, timer.seconds(), btime);
+  Kokkos::Profiling::popRegion();
+}
+
+} //namespace
+#endif
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <vector>
 #include "pumipic_mesh.hpp"
 #include <particle_structs.hpp>
 #include "pumipic_lb.hpp"
@@ -28,6 +29,29 @@ namespace pumipic {
   template <class PS>
   void migrate_ptcls(Mesh& mesh, PS* ptcls, Omega_h::LOs new_elems);
 
+  /* Distributor over the ranks particles can migrate to from this picpart
+     mesh - picpart mesh
+
+     Particles can only move to the ranks buffered in the picpart, so the
+       migration only communicates with this rank and the buffered ranks.
+       If every rank is buffered the world distributor is returned.
+  */
+  template <class PS>
+  Distributor<typename PS::memory_space> neighborDistributor(Mesh& mesh) {
+    const int comm_rank = mesh.comm()->rank();
+    const int comm_size = mesh.comm()->size();
+    const int nbuffers = mesh.numBuffers(mesh.dim());
+    MPI_Comm comm = mesh.comm()->get_impl();
+    if (nbuffers >= comm_size)
+      return Distributor<typename PS::memory_space>(comm);
+    Omega_h::HostWrite<Omega_h::LO> buffers = mesh.bufferedRanks(mesh.dim());
+    std::vector<int> ranks(nbuffers);
+    ranks[0] = comm_rank;
+    for (int i = 0; i < nbuffers - 1; ++i)
+      ranks[i+1] = buffers[i];
+    return Distributor<typename PS::memory_space>(nbuffers, ranks.data(), comm);
+  }
+
 
   template <class PS>
   void setUnsafeProcs(Mesh& mesh, PS* ptcls, Omega_h::LOs elems,
@@ -63,7 +87,7 @@ namespace pumipic {
     balancer->repartition(mesh, ptcls, tol, new_elems, new_procs, step_factor);
     float balance_time = balance_timer.seconds();
     Kokkos::Timer migrate_timer;
-    ptcls->migrate(new_elems, new_procs);
+    ptcls->migrate(new_elems, new_procs, neighborDistributor<PS>(mesh));
     float migrate_time = migrate_timer.seconds();
     RecordTime("migration_init", init_time);
     RecordTime("migration_balance", balance_time);
@@ -78,7 +102,7 @@ namespace pumipic {
     setUnsafeProcs(mesh, ptcls, elems, new_elems, new_procs);
     float init_time = init_timer.seconds();
     Kokkos::Timer migrate_timer;
-    ptcls->migrate(new_elems, new_procs);
+    ptcls->migrate(new_elems, new_procs, neighborDistributor<PS>(mesh));
     float migrate_time = migrate_timer.seconds();
     RecordTime("migration_init", init_time);
     RecordTime("migration", migrate_time);
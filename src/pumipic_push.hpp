@@ -10,8 +10,14 @@
 #include "Omega_h_scalar.hpp" //divide
 #include "Omega_h_fail.hpp"
 
+#include <particle_structs.hpp>
+
 #include "pumipic_utils.hpp"
 #include "pumipic_constants.hpp"
+#include "pumipic_interpolate.hpp"
+#include "pumipic_profiling.hpp"
+
+namespace ps = particle_structs;
 
 namespace pumipic
 {
@@ -25,7 +31,7 @@ OMEGA_H_INLINE void pushBoris(Omega_h::LO nelems, Omega_h::Write<Omega_h::Real>
 {
   auto pushPtcl = OMEGA_H_LAMBDA( Omega_h::LO ielem)
   {
-    Omega_h::LO pid = ielem; //TODO Replace by ptcl loop
+    Omega_h::LO pid = ielem;
 
     Omega_h::Vector<3> vel{vx[pid], vy[pid], vz[pid]}; //current
     Omega_h::Vector<3> eField{eFld0x[pid], eFld0y[pid], eFld0z[pid]}; //previous
@@ -41,7 +47,7 @@ OMEGA_H_INLINE void pushBoris(Omega_h::LO nelems, Omega_h::Write<Omega_h::Real>
 
       //v_minus = v + q_prime*E;
     Omega_h::Vector<3> qpE = qPrime*eField;
-    Omega_h::Vector<3> vMinus = vel - qpE;
+    Omega_h::Vector<3> vMinus = vel + qpE;
 
     //v_prime = v_minus + q_prime*(v_minus x B)
     Omega_h::Vector<3> vmxB = Omega_h::cross(vMinus,bField);
@@ -71,7 +77,124 @@ OMEGA_H_INLINE void pushBoris(Omega_h::LO nelems, Omega_h::Write<Omega_h::Real>
     vz[pid] = vel[2];
   };
 
-  Omega_h::parallel_for(1,  pushPtcl, "push");
+  Omega_h::parallel_for(nelems,  pushPtcl, "push");
+}
+
+/* Boris velocity update: half electric kick, magnetic rotation and second
+   half electric kick. qmdt2 is charge/mass*dt/2.
+*/
+OMEGA_H_DEVICE Omega_h::Vector<3> borisVelocity(const Omega_h::Vector<3>& vel,
+    const Omega_h::Vector<3>& eField, const Omega_h::Vector<3>& bField,
+    const Omega_h::Real qmdt2) {
+  const Omega_h::Vector<3> qpE = qmdt2*eField;
+  const Omega_h::Vector<3> vMinus = vel + qpE;
+  const Omega_h::Vector<3> t = qmdt2*bField;
+  const Omega_h::Real tMag2 = Omega_h::inner_product(t, t);
+  const Omega_h::Vector<3> s = (2.0/(1.0+tMag2))*t;
+  const Omega_h::Vector<3> vPrime = vMinus + Omega_h::cross(vMinus, t);
+  const Omega_h::Vector<3> vPlus = vMinus + Omega_h::cross(vPrime, s);
+  return vPlus + qpE;
+}
+
+/* Boris push of the particles of a particle structure
+
+   Updates the velocity in place and writes the position after dt to
+   x_next. The fields are read per particle from the eField and bField
+   segments. All segments hold 3 components per particle.
+*/
+template <class PS, typename PosSegment, typename NextSegment,
+          typename VelSegment, typename EFieldSegment, typename BFieldSegment>
+void pushBoris(PS* ptcls, PosSegment x, NextSegment x_next, VelSegment vel,
+               EFieldSegment eField, BFieldSegment bField,
+               Omega_h::Real charge, Omega_h::Real mass, Omega_h::Real dt) {
+  OMEGA_H_CHECK(mass > 0 && dt > 0);
+  const Omega_h::Real qmdt2 = charge/mass*dt*0.5;
+  auto push = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
+    if (mask > 0) {
+      Omega_h::Vector<3> v, ef, bf;
+      for (int i = 0; i < 3; ++i) {
+        v[i] = vel(pid, i);
+        ef[i] = eField(pid, i);
+        bf[i] = bField(pid, i);
+      }
+      v = borisVelocity(v, ef, bf, qmdt2);
+      for (int i = 0; i < 3; ++i) {
+        vel(pid, i) = v[i];
+        x_next(pid, i) = x(pid, i) + v[i]*dt;
+      }
+    }
+  };
+  ps::parallel_for(ptcls, push, "pumipic_push_boris");
+}
+
+/* Boris push fused with the field interpolation and the parent element check
+
+   The electric and magnetic fields are interpolated from the vertex fields
+   set in eField and bField (3 components per vertex of a tet mesh) at the
+   current position, the velocity is updated in place and the position after
+   dt is written to x_next. If elem_ids is given it is set to the parent
+   element of the particle when x_next is still within it and to -1 when the
+   particle left its parent element. Returns the number of particles that
+   left their parent element; if none did the search can be skipped.
+*/
+template <class PS, typename PosSegment, typename NextSegment, typename VelSegment>
+Omega_h::LO pushBoris(PS* ptcls, const FieldGather& eField, const FieldGather& bField,
+                      PosSegment x, NextSegment x_next, VelSegment vel,
+                      Omega_h::Real charge, Omega_h::Real mass, Omega_h::Real dt,
+                      Omega_h::Write<Omega_h::LO> elem_ids = Omega_h::Write<Omega_h::LO>()) {
+  const auto btime = pumipic_prebarrier();
+  Kokkos::Profiling::pushRegion("pumipic_push_boris_fused");
+  Kokkos::Timer timer;
+  if (eField.dim() != 3 || eField.numComponents() != 3 ||
+      bField.numComponents() != 3) {
+    fprintf(stderr, "[ERROR] The fused Boris push requires 3 component fields "
+            "on a tet mesh\n");
+    throw 1;
+  }
+  OMEGA_H_CHECK(mass > 0 && dt > 0);
+  const Omega_h::Real qmdt2 = charge/mass*dt*0.5;
+  const auto elem_inv = eField.geometry().elemInverses();
+  const auto efld = eField.elemField();
+  const auto bfld = bField.elemField();
+  const bool setElems = elem_ids.exists();
+  Omega_h::Write<Omega_h::LO> numLeft(1, 0, "numLeft");
+  auto push = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
+    if (mask > 0) {
+      Omega_h::Vector<3> pos, v, ef, bf;
+      for (int i = 0; i < 3; ++i) {
+        pos[i] = x(pid, i);
+        v[i] = vel(pid, i);
+      }
+      //both fields share the mesh, interpolate them from one set of coordinates
+      Omega_h::Vector<4> bcc;
+      barycentric_tet_cached(elem_inv, e, pos, bcc);
+      for (int i = 0; i < 3; ++i) {
+        ef[i] = interpolate_weights(efld, e*12 + i, bcc, 3);
+        bf[i] = interpolate_weights(bfld, e*12 + i, bcc, 3);
+      }
+      v = borisVelocity(v, ef, bf, qmdt2);
+      Omega_h::Vector<3> next;
+      for (int i = 0; i < 3; ++i) {
+        next[i] = pos[i] + v[i]*dt;
+        vel(pid, i) = v[i];
+        x_next(pid, i) = next[i];
+      }
+      //first step of the search: does the particle stay in its parent
+      const bool inParent = isPointWithinElemTetCached(elem_inv, next, e);
+      if (!inParent)
+        Kokkos::atomic_add(&(numLeft[0]), 1);
+      if (setElems)
+        elem_ids[pid] = inParent ? e : -1;
+    }
+    else if (setElems) {
+      elem_ids[pid] = -1;
+    }
+  };
+  ps::parallel_for(ptcls, push, "pumipic_push_boris_fused");
+  Omega_h::HostWrite<Omega_h::LO> numLeft_h(numLeft);
+  RecordTime("pumipic_push_boris_fused", timer.seconds(), btime);
+  Kokkos::Profiling::popRegion();
+  return numLeft_h[0];
 }
 
 } //namespace
@@ -0,0 +1,58 @@
+#include "pumipic_search.hpp"
+#include "pumipic_mesh.hpp"
+#include "Omega_h_adj.hpp"
+#include "Omega_h_mark.hpp"
+
+namespace {
+  //Grow the scratch array to hold capacity entries
+  Omega_h::Write<Omega_h::LO> growScratch(Omega_h::Write<Omega_h::LO>& scratch,
+                                          Omega_h::LO capacity, const char* name) {
+    if (!scratch.exists() || scratch.size() < capacity) {
+      //Pad the allocation to avoid reallocating for small increases in capacity
+      const Omega_h::LO size = capacity + capacity / 10;
+      scratch = Omega_h::Write<Omega_h::LO>(size, name);
+    }
+    return scratch;
+  }
+}
+
+namespace pumipic {
+  SearchContext::SearchContext(o::Mesh& mesh) : mesh_(&mesh), geom(mesh) {
+    init();
+  }
+
+  SearchContext::SearchContext(Mesh& picparts) : mesh_(picparts.mesh()),
+                                                 geom(*picparts.mesh()) {
+    init();
+  }
+
+  SearchContext::~SearchContext() {
+    delete index;
+  }
+
+  void SearchContext::init() {
+    fallback_steps = 0;
+    fused_walk = false;
+    index = NULL;
+    const int dim = mesh_->dim();
+    elem_sides = mesh_->ask_down(dim, dim - 1).ab2b;
+    side_elems = mesh_->ask_up(dim - 1, dim);
+    side_is_exposed = mark_exposed_sides(mesh_);
+  }
+
+  const SpatialIndex& SearchContext::spatialIndex() {
+    if (!index)
+      index = new SpatialIndex(*mesh_, geom);
+    return *index;
+  }
+
+  o::Write<o::LO> SearchContext::ptclDone(o::LO capacity) {
+    return growScratch(ptcl_done, capacity, "ptcl_done");
+  }
+  o::Write<o::LO> SearchContext::elemIdsNext(o::LO capacity) {
+    return growScratch(elem_ids_next, capacity, "elem_ids_next");
+  }
+  o::Write<o::LO> SearchContext::lastSide(o::LO capacity) {
+    return growScratch(last_side, capacity, "last_side");
+  }
+}
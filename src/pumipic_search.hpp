@@ -0,0 +1,86 @@
+#ifndef PUMIPIC_SEARCH_HPP
+#define PUMIPIC_SEARCH_HPP
+
+#include "Omega_h_mesh.hpp"
+#include "pumipic_geometry.hpp"
+#include "pumipic_spatial_index.hpp"
+
+namespace o = Omega_h;
+
+namespace pumipic {
+
+class Mesh;
+
+/*
+  Persistent state for repeated mesh searches
+
+  Holds the mesh-derived arrays used by the search kernels (element
+  geometry, element-to-side and side-to-element adjacencies and the exposed
+  side flags) and the per-particle scratch arrays. The scratch arrays are
+  only reallocated when the particle capacity grows, so a context created
+  once and passed to search_mesh_3d/search_mesh_2d every timestep performs
+  no allocation or full-mesh recomputation in the search loop.
+
+  The context must be rebuilt if the mesh changes.
+
+  Long-flight fallback: when enabled with setLongFlightFallback(steps),
+  particles still walking after steps iterations are resolved with the
+  spatial index. The index checks the segment for exposed side crossings and
+  locates the destination. This bounds the number of search iterations.
+
+  Fused walk: when enabled with setFusedWalk(true), search_mesh_3d walks
+  each particle to its destination in a single kernel (see
+  search_mesh_3d_fused) instead of one kernel launch per iteration.
+*/
+class SearchContext {
+public:
+  explicit SearchContext(o::Mesh& mesh);
+  explicit SearchContext(Mesh& picparts);
+  ~SearchContext();
+  SearchContext(const SearchContext&) = delete;
+  SearchContext& operator=(const SearchContext&) = delete;
+
+  o::Mesh& mesh() {return *mesh_;}
+  int dim() const {return geom.dim();}
+  const GeometryCache& geometry() const {return geom;}
+  //Sides bounding each element (faces of tets, edges of triangles)
+  o::LOs elemSides() const {return elem_sides;}
+  //Elements adjacent to each side
+  o::Adj sideElems() const {return side_elems;}
+  //1 if the side is on the boundary of the (picpart) mesh
+  o::Read<o::I8> sideIsExposed() const {return side_is_exposed;}
+
+  /* Scratch arrays with at least capacity entries
+
+     The contents are not preserved across calls.
+  */
+  o::Write<o::LO> ptclDone(o::LO capacity);
+  o::Write<o::LO> elemIdsNext(o::LO capacity);
+  o::Write<o::LO> lastSide(o::LO capacity);
+
+  //Number of walk iterations before the spatial index is used (0 disables)
+  void setLongFlightFallback(int steps) {fallback_steps = steps;}
+  int longFlightSteps() const {return fallback_steps;}
+  //Walk each particle in a single kernel in search_mesh_3d
+  void setFusedWalk(bool fused) {fused_walk = fused;}
+  bool fusedWalk() const {return fused_walk;}
+  //Spatial index of the mesh, built on first use
+  const SpatialIndex& spatialIndex();
+
+private:
+  void init();
+  o::Mesh* mesh_;
+  GeometryCache geom;
+  o::LOs elem_sides;
+  o::Adj side_elems;
+  o::Read<o::I8> side_is_exposed;
+  o::Write<o::LO> ptcl_done;
+  o::Write<o::LO> elem_ids_next;
+  o::Write<o::LO> last_side;
+  int fallback_steps;
+  bool fused_walk;
+  SpatialIndex* index;
+};
+
+} //namespace
+#endif
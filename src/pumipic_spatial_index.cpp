@@ -0,0 +1,192 @@
+#include "pumipic_spatial_index.hpp"
+#include "Omega_h_for.hpp"
+#include "Omega_h_array_ops.hpp"
+#include "Omega_h_scan.hpp"
+#include "Omega_h_mark.hpp"
+#include "Omega_h_element.hpp"
+#include <Kokkos_Core.hpp>
+#include <cmath>
+
+namespace {
+  //Range of cells overlapped by the bounding box of element e
+  //If skip is a local vertex index it is left out of the box
+  OMEGA_H_DEVICE void cellRange(const pumipic::GridLocator& grid, const o::Reals& coords,
+                                const o::LOs& elem2verts, const int nverts, const o::LO e,
+                                o::LO* first, o::LO* last, const int skip = -1) {
+    for (int d = 0; d < grid.dim; ++d) {
+      const int v0 = (skip == 0) ? 1 : 0;
+      o::Real bmin = coords[elem2verts[e*nverts + v0]*grid.dim + d];
+      o::Real bmax = bmin;
+      for (int v = v0 + 1; v < nverts; ++v) {
+        if (v == skip)
+          continue;
+        const o::Real x = coords[elem2verts[e*nverts + v]*grid.dim + d];
+        bmin = (x < bmin) ? x : bmin;
+        bmax = (x > bmax) ? x : bmax;
+      }
+      const o::LO f = (bmin - grid.origin[d]) * grid.inv_cell_size[d];
+      const o::LO l = (bmax - grid.origin[d]) * grid.inv_cell_size[d];
+      first[d] = (f < 0) ? 0 : ((f < grid.ncells[d]) ? f : grid.ncells[d] - 1);
+      last[d] = (l < 0) ? 0 : ((l < grid.ncells[d]) ? l : grid.ncells[d] - 1);
+    }
+    for (int d = grid.dim; d < 3; ++d) {
+      first[d] = 0;
+      last[d] = 0;
+    }
+  }
+}
+
+namespace pumipic {
+  SpatialIndex::SpatialIndex(o::Mesh& mesh, o::Real elems_per_cell, o::Real tol) :
+    geom(mesh) {
+    loc.tol = tol;
+    build(mesh, elems_per_cell);
+  }
+
+  SpatialIndex::SpatialIndex(o::Mesh& mesh, const GeometryCache& g,
+                             o::Real elems_per_cell, o::Real tol) : geom(g) {
+    loc.tol = tol;
+    build(mesh, elems_per_cell);
+  }
+
+  o::LO SpatialIndex::numCells() const {
+    o::LO n = 1;
+    for (int d = 0; d < loc.dim; ++d)
+      n *= loc.ncells[d];
+    return n;
+  }
+
+  void SpatialIndex::build(o::Mesh& mesh, o::Real elems_per_cell) {
+    const int dim = mesh.dim();
+    const o::LO nelems = mesh.nelems();
+    const auto coords = mesh.coords();
+    const auto elem2verts = mesh.ask_elem_verts();
+    loc.dim = dim;
+    loc.elem_inv = geom.elemInverses();
+
+    //Size the cells so each one overlaps about elems_per_cell elements
+    o::Real lo[3] = {0, 0, 0};
+    o::Real extent[3] = {1, 1, 1};
+    o::Real volume = 1;
+    for (int d = 0; d < dim; ++d) {
+      const auto comp = o::get_component(coords, dim, d);
+      lo[d] = o::get_min(comp);
+      extent[d] = o::get_max(comp) - lo[d];
+      //Pad the bounding box so points on the mesh boundary are inside the grid
+      const o::Real pad = (extent[d] > 0 ? extent[d] : 1) * 1e-8;
+      lo[d] -= pad;
+      extent[d] += 2 * pad;
+      volume *= extent[d];
+    }
+    const o::Real ncells_target = std::max<o::Real>(1, nelems / elems_per_cell);
+    const o::Real h = std::pow(volume / ncells_target, 1.0 / dim);
+    o::LO total_cells = 1;
+    for (int d = 0; d < 3; ++d) {
+      if (d < dim) {
+        loc.ncells[d] = std::max<o::LO>(1, std::min<o::LO>(1024, std::ceil(extent[d] / h)));
+        loc.origin[d] = lo[d];
+        loc.inv_cell_size[d] = loc.ncells[d] / extent[d];
+        total_cells *= loc.ncells[d];
+      }
+      else {
+        loc.ncells[d] = 1;
+        loc.origin[d] = 0;
+        loc.inv_cell_size[d] = 0;
+      }
+    }
+
+    const auto grid = loc;
+    const int nverts = dim + 1;
+
+    //Count the elements overlapping each cell
+    o::Write<o::LO> cell_counts(total_cells, 0, "cell_counts");
+    auto countElems = OMEGA_H_LAMBDA(o::LO e) {
+      o::LO first[3], last[3];
+      cellRange(grid, coords, elem2verts, nverts, e, first, last);
+      for (o::LO k = first[2]; k <= last[2]; ++k)
+        for (o::LO j = first[1]; j <= last[1]; ++j)
+          for (o::LO i = first[0]; i <= last[0]; ++i) {
+            const o::LO cell = (k * grid.ncells[1] + j) * grid.ncells[0] + i;
+            Kokkos::atomic_add(&(cell_counts[cell]), 1);
+          }
+    };
+    o::parallel_for(nelems, countElems, "pumipic_spatial_index_count");
+    const auto offsets = o::offset_scan(o::LOs(cell_counts));
+
+    //Fill the element lists of each cell
+    o::Write<o::LO> fill_index(total_cells, 0, "cell_fill_index");
+    o::Write<o::LO> elems(offsets.last(), "cell_elems");
+    auto fillElems = OMEGA_H_LAMBDA(o::LO e) {
+      o::LO first[3], last[3];
+      cellRange(grid, coords, elem2verts, nverts, e, first, last);
+      for (o::LO k = first[2]; k <= last[2]; ++k)
+        for (o::LO j = first[1]; j <= last[1]; ++j)
+          for (o::LO i = first[0]; i <= last[0]; ++i) {
+            const o::LO cell = (k * grid.ncells[1] + j) * grid.ncells[0] + i;
+            const o::LO index = Kokkos::atomic_fetch_add(&(fill_index[cell]), 1);
+            elems[offsets[cell] + index] = e;
+          }
+    };
+    o::parallel_for(nelems, fillElems, "pumipic_spatial_index_fill");
+    loc.cell_offsets = offsets;
+    loc.cell_elems = o::LOs(elems);
+
+    //Bin the exposed sides by the bounding box of their vertices
+    const auto side_is_exposed = mark_exposed_sides(&mesh);
+    const auto elem_sides = mesh.ask_down(dim, dim - 1).ab2b;
+    o::Write<o::LO> bdry_counts(total_cells, 0, "bdry_counts");
+    auto countSides = OMEGA_H_LAMBDA(o::LO e) {
+      for (int s = 0; s < nverts; ++s) {
+        if (!side_is_exposed[elem_sides[e*nverts + s]])
+          continue;
+        o::LO first[3], last[3];
+        const int opp = o::simplex_opposite_template(dim, dim - 1, s);
+        cellRange(grid, coords, elem2verts, nverts, e, first, last, opp);
+        for (o::LO k = first[2]; k <= last[2]; ++k)
+          for (o::LO j = first[1]; j <= last[1]; ++j)
+            for (o::LO i = first[0]; i <= last[0]; ++i) {
+              const o::LO cell = (k * grid.ncells[1] + j) * grid.ncells[0] + i;
+              Kokkos::atomic_add(&(bdry_counts[cell]), 1);
+            }
+      }
+    };
+    o::parallel_for(nelems, countSides, "pumipic_spatial_index_count_bdry");
+    const auto bdry_offsets = o::offset_scan(o::LOs(bdry_counts));
+    o::Write<o::LO> bdry_fill(total_cells, 0, "bdry_fill_index");
+    o::Write<o::LO> sides(bdry_offsets.last(), "bdry_sides");
+    auto fillSides = OMEGA_H_LAMBDA(o::LO e) {
+      for (int s = 0; s < nverts; ++s) {
+        if (!side_is_exposed[elem_sides[e*nverts + s]])
+          continue;
+        o::LO first[3], last[3];
+        const int opp = o::simplex_opposite_template(dim, dim - 1, s);
+        cellRange(grid, coords, elem2verts, nverts, e, first, last, opp);
+        for (o::LO k = first[2]; k <= last[2]; ++k)
+          for (o::LO j = first[1]; j <= last[1]; ++j)
+            for (o::LO i = first[0]; i <= last[0]; ++i) {
+              const o::LO cell = (k * grid.ncells[1] + j) * grid.ncells[0] + i;
+              const o::LO index = Kokkos::atomic_fetch_add(&(bdry_fill[cell]), 1);
+              sides[bdry_offsets[cell] + index] = e * nverts + s;
+            }
+      }
+    };
+    o::parallel_for(nelems, fillSides, "pumipic_spatial_index_fill_bdry");
+    loc.bdry_offsets = bdry_offsets;
+    loc.bdry_sides = o::LOs(sides);
+  }
+
+  o::LOs SpatialIndex::locate(o::Reals points) const {
+    const int dim = loc.dim;
+    const o::LO npts = points.size() / dim;
+    const auto grid = loc;
+    o::Write<o::LO> elem_ids(npts, "located_elem_ids");
+    auto locatePoints = OMEGA_H_LAMBDA(o::LO i) {
+      o::Real x[3] = {0, 0, 0};
+      for (int d = 0; d < dim; ++d)
+        x[d] = points[i*dim + d];
+      elem_ids[i] = grid.locate(x);
+    };
+    o::parallel_for(npts, locatePoints, "pumipic_spatial_index_locate");
+    return o::LOs(elem_ids);
+  }
+}
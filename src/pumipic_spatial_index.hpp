@@ -0,0 +1,163 @@
+#ifndef PUMIPIC_SPATIAL_INDEX_HPP
+#define PUMIPIC_SPATIAL_INDEX_HPP
+
+#include "Omega_h_mesh.hpp"
+#include "pumipic_geometry.hpp"
+
+namespace o = Omega_h;
+
+namespace pumipic {
+
+/*
+  Device side handle to a SpatialIndex
+
+  The handle is cheap to copy and may be captured by kernels to locate
+  points without a starting element.
+*/
+struct GridLocator {
+  int dim;
+  o::Real tol;
+  o::Real origin[3];
+  o::Real inv_cell_size[3];
+  o::LO ncells[3];
+  o::LOs cell_offsets;
+  o::LOs cell_elems;
+  //Exposed sides overlapping each cell encoded as elem*(dim+1)+local side index
+  o::LOs bdry_offsets;
+  o::LOs bdry_sides;
+  o::Reals elem_inv;
+
+  //Returns the cell containing x or -1 if x is outside the grid
+  OMEGA_H_DEVICE o::LO cellOf(const o::Real* x) const {
+    o::LO cell = 0;
+    for (int d = dim - 1; d >= 0; --d) {
+      const o::Real s = (x[d] - origin[d]) * inv_cell_size[d];
+      if (s < 0 || s > ncells[d])
+        return -1;
+      o::LO c = static_cast<o::LO>(s);
+      if (c == ncells[d])
+        --c;
+      cell = cell * ncells[d] + c;
+    }
+    return cell;
+  }
+
+  //Returns the element containing x or -1 if x is outside the mesh
+  OMEGA_H_DEVICE o::LO locate(const o::Real* x) const {
+    const auto cell = cellOf(x);
+    if (cell < 0)
+      return -1;
+    for (o::LO i = cell_offsets[cell]; i < cell_offsets[cell+1]; ++i) {
+      const auto elm = cell_elems[i];
+      if (dim == 3) {
+        o::Vector<3> p;
+        for (int d = 0; d < 3; ++d)
+          p[d] = x[d];
+        if (isPointWithinElemTetCached(elem_inv, p, elm, tol))
+          return elm;
+      }
+      else {
+        o::Vector<2> p;
+        for (int d = 0; d < 2; ++d)
+          p[d] = x[d];
+        o::Vector<3> bcc;
+        barycentric_tri_cached(elem_inv, elm, p, bcc);
+        if (bcc[0] >= -tol && bcc[1] >= -tol && bcc[2] >= -tol)
+          return elm;
+      }
+    }
+    return -1;
+  }
+  OMEGA_H_DEVICE o::LO locate(const o::Vector<3>& x) const {
+    o::Real p[3] = {x[0], x[1], x[2]};
+    return locate(p);
+  }
+  OMEGA_H_DEVICE o::LO locate(const o::Vector<2>& x) const {
+    o::Real p[3] = {x[0], x[1], 0};
+    return locate(p);
+  }
+
+  /* Visits the cells crossed by the segment a->b in order from a
+
+     visit(cell) is called for each cell and the traversal stops early if it
+     returns true. Cells outside the grid are not visited.
+  */
+  template <class Visit>
+  OMEGA_H_DEVICE void traverse(const o::Real* a, const o::Real* b, Visit& visit) const {
+    o::LO c[3] = {0, 0, 0};
+    o::LO step[3] = {0, 0, 0};
+    o::Real tmax[3] = {2, 2, 2};
+    o::Real tdelta[3] = {0, 0, 0};
+    for (int d = 0; d < dim; ++d) {
+      const o::Real s = (a[d] - origin[d]) * inv_cell_size[d];
+      if (s < 0 || s > ncells[d])
+        return;
+      c[d] = (s < ncells[d]) ? static_cast<o::LO>(s) : ncells[d] - 1;
+      const o::Real dir = (b[d] - a[d]) * inv_cell_size[d];
+      if (dir > 0) {
+        step[d] = 1;
+        tmax[d] = (c[d] + 1 - s) / dir;
+        tdelta[d] = 1 / dir;
+      }
+      else if (dir < 0) {
+        step[d] = -1;
+        tmax[d] = (c[d] - s) / dir;
+        tdelta[d] = -1 / dir;
+      }
+    }
+    while (true) {
+      o::LO cell = 0;
+      for (int d = dim - 1; d >= 0; --d)
+        cell = cell * ncells[d] + c[d];
+      if (visit(cell))
+        return;
+      int next = 0;
+      for (int d = 1; d < dim; ++d)
+        if (tmax[d] < tmax[next])
+          next = d;
+      if (tmax[next] > 1)
+        return;
+      c[next] += step[next];
+      if (c[next] < 0 || c[next] >= ncells[next])
+        return;
+      tmax[next] += tdelta[next];
+    }
+  }
+};
+
+/*
+  Uniform grid over the element bounding boxes of a mesh (or picpart)
+
+  Each grid cell lists the elements whose bounding box overlaps it so a
+  point is located by testing the few elements of a single cell. The cell
+  size is chosen so that a cell overlaps about elems_per_cell elements of
+  average size. Points that are on the boundary of two elements are
+  assigned to the first element found, within the tolerance tol.
+  The exposed sides of the mesh are binned in the same grid so segments
+  can be tested for boundary crossings without walking the mesh.
+*/
+class SpatialIndex {
+public:
+  explicit SpatialIndex(o::Mesh& mesh, o::Real elems_per_cell = 2, o::Real tol = 1e-10);
+  SpatialIndex(o::Mesh& mesh, const GeometryCache& geom, o::Real elems_per_cell = 2,
+               o::Real tol = 1e-10);
+
+  int dim() const {return loc.dim;}
+  o::LO numCells() const;
+  //Device handle for locating points inside kernels
+  const GridLocator& locator() const {return loc;}
+
+  /* Locates a batch of points
+     points holds dim coordinates per point
+     Returns the containing element of each point or -1 if it is outside the mesh
+  */
+  o::LOs locate(o::Reals points) const;
+
+private:
+  void build(o::Mesh& mesh, o::Real elems_per_cell);
+  GeometryCache geom;
+  GridLocator loc;
+};
+
+} //namespace
+#endif
@@ -5,8 +5,13 @@
 #include "ppMacros.h"
 #ifdef PP_USE_CUDA
 #include <thrust/scan.h>
+#include <thrust/sort.h>
+#include <thrust/device_ptr.h>
 #include <thrust/execution_policy.h>
 #endif
+#include <algorithm>
+#include <utility>
+#include <vector>
 namespace pumipic {
 
   /* template <typename ExecSpace> struct ThrustSpace; */
@@ -53,6 +58,159 @@ namespace pumipic {
     Kokkos::parallel_scan("inclusive_scan", entries.size(), inclusive_sum);
 #endif
   }
+  /* Sort the n entries of data by comp with the host execution space
+     Chunks of at least 1024 entries, at most one per thread, are stable sorted in
+       parallel then neighboring runs are merged in parallel alternating between data
+       and buffer, which holds n entries. Entries that compare equal keep their relative
+       order. Returns the array holding the sorted entries, either data or buffer.
+   */
+  template <typename T, typename Compare>
+  T* host_chunk_sort(T* data, T* buffer, int n, Compare comp) {
+    typedef Kokkos::DefaultHostExecutionSpace HostExecSpace;
+    typedef Kokkos::RangePolicy<HostExecSpace> HostPolicy;
+    if (n <= 1)
+      return data;
+    const int num_chunks = std::max(1, std::min(HostExecSpace().concurrency(), n / 1024));
+    const int chunk = n / num_chunks + (n % num_chunks != 0);
+    Kokkos::parallel_for("chunk_sort", HostPolicy(0, num_chunks), [=](const int& c) {
+      const int start = std::min(c * chunk, n);
+      const int end = std::min(start + chunk, n);
+      std::stable_sort(data + start, data + end, comp);
+    });
+    HostExecSpace().fence();
+    //std::merge takes equal keys from the first run first which keeps the sort stable
+    for (int width = chunk; width < n; width *= 2) {
+      const int num_merges = (n - 1) / (2 * width) + 1;
+      Kokkos::parallel_for("chunk_sort_merge", HostPolicy(0, num_merges), [=](const int& m) {
+        const int start = m * 2 * width;
+        const int mid = std::min(start + width, n);
+        const int end = std::min(mid + width, n);
+        std::merge(data + start, data + mid, data + mid, data + end, buffer + start, comp);
+      });
+      HostExecSpace().fence();
+      std::swap(data, buffer);
+    }
+    return data;
+  }
+  /* Stable sort of the first n entries of 'keys' with 'values' reordered alongside
+     Entries with equal keys keep their relative order so the result is deterministic.
+     On the host execution spaces the pairs are sorted on a host copy with
+     host_chunk_sort.
+     For small integer keys see stable_counting_sort.
+   */
+  template <typename KeyViewT, typename ValueViewT>
+  void stable_sort_by_key(KeyViewT keys, ValueViewT values, int n) {
+    if (n <= 0)
+      return;
+#ifdef PP_USE_CUDA
+    thrust::device_ptr<typename KeyViewT::value_type> keys_t(keys.data());
+    thrust::device_ptr<typename ValueViewT::value_type> values_t(values.data());
+    thrust::stable_sort_by_key(thrust::device, keys_t, keys_t + n, values_t);
+#else
+    typedef typename KeyViewT::non_const_value_type KeyT;
+    typedef typename ValueViewT::non_const_value_type ValueT;
+    typedef std::pair<KeyT, ValueT> PairT;
+    typedef Kokkos::DefaultHostExecutionSpace HostExecSpace;
+    typedef Kokkos::RangePolicy<HostExecSpace> HostPolicy;
+    Kokkos::fence();
+    auto keys_host = Kokkos::create_mirror_view_and_copy(Kokkos::HostSpace(), keys);
+    auto values_host = Kokkos::create_mirror_view_and_copy(Kokkos::HostSpace(), values);
+    std::vector<PairT> pairs_vec(n), merged_vec(n);
+    PairT* pairs = pairs_vec.data();
+    PairT* merged = merged_vec.data();
+    Kokkos::parallel_for("stable_sort_pairs", HostPolicy(0, n), [=](const int& i) {
+      pairs[i] = PairT(keys_host(i), values_host(i));
+    });
+    auto byKey = [](const PairT& a, const PairT& b) {return a.first < b.first;};
+    HostExecSpace().fence();
+    pairs = host_chunk_sort(pairs, merged, n, byKey);
+    Kokkos::parallel_for("stable_sort_unpairs", HostPolicy(0, n), [=](const int& i) {
+      keys_host(i) = pairs[i].first;
+      values_host(i) = pairs[i].second;
+    });
+    HostExecSpace().fence();
+    Kokkos::deep_copy(keys, keys_host);
+    Kokkos::deep_copy(values, values_host);
+#endif
+  }
+  /* Stable counting sort of the first n entries of 'values' by 'bins'
+     bins holds the bin of each entry in [0, num_bins) and is reordered alongside the
+       values. Entries in the same bin keep their relative order.
+     Runs on the execution space of the views. The bins are counted with atomics and
+       the path is chosen from the largest bin:
+       - when every bin holds few entries each entry is placed at the offset of its bin
+         plus the number of entries of the bin that precede it in the input
+       - otherwise the entries are split into blocks, the per block histograms are
+         scanned in bin then block order and each block places its entries in order
+   */
+  template <typename BinViewT, typename ValueViewT>
+  void stable_counting_sort(BinViewT bins, ValueViewT values, int n, int num_bins) {
+    typedef typename ValueViewT::execution_space ExecSpace;
+    typedef typename ValueViewT::device_type Device;
+    typedef Kokkos::View<int*, Device> IntView;
+    typedef Kokkos::View<typename BinViewT::non_const_value_type*, Device> BinCopy;
+    typedef Kokkos::View<typename ValueViewT::non_const_value_type*, Device> ValueCopy;
+    typedef Kokkos::RangePolicy<ExecSpace> Policy;
+    if (n <= 0 || num_bins <= 0)
+      return;
+    BinCopy bins_in(Kokkos::ViewAllocateWithoutInitializing("sort_bins_in"), n);
+    ValueCopy values_in(Kokkos::ViewAllocateWithoutInitializing("sort_values_in"), n);
+    Kokkos::parallel_for("sort_copy_input", Policy(0, n), KOKKOS_LAMBDA(const int& i) {
+      bins_in(i) = bins(i);
+      values_in(i) = values(i);
+    });
+    IntView counts("sort_bin_counts", num_bins + 1);
+    IntView slot(Kokkos::ViewAllocateWithoutInitializing("sort_bin_slot"), n);
+    Kokkos::parallel_for("sort_count", Policy(0, n), KOKKOS_LAMBDA(const int& i) {
+      slot(i) = Kokkos::atomic_fetch_add(&counts(bins_in(i)), 1);
+    });
+    int max_bin = 0;
+    Kokkos::parallel_reduce("sort_max_bin", Policy(0, num_bins),
+                            KOKKOS_LAMBDA(const int& b, int& mx) {
+      if (counts(b) > mx)
+        mx = counts(b);
+    }, Kokkos::Max<int>(max_bin));
+    if (max_bin <= 32) {
+      IntView offsets("sort_bin_offsets", num_bins + 1);
+      exclusive_scan(counts, offsets);
+      IntView order(Kokkos::ViewAllocateWithoutInitializing("sort_order"), n);
+      Kokkos::parallel_for("sort_group", Policy(0, n), KOKKOS_LAMBDA(const int& i) {
+        order(offsets(bins_in(i)) + slot(i)) = i;
+      });
+      //The rank of an entry in its bin is the number of entries of the bin with a
+      //  smaller input position, each entry scans at most max_bin flags
+      Kokkos::parallel_for("sort_place", Policy(0, n), KOKKOS_LAMBDA(const int& i) {
+        const int b = bins_in(i);
+        int rank = 0;
+        for (int j = offsets(b); j < offsets(b + 1); ++j)
+          rank += (order(j) < i);
+        bins(offsets(b) + rank) = b;
+        values(offsets(b) + rank) = values_in(i);
+      });
+    }
+    else {
+      //At most one block per thread, the histograms hold at most n entries
+      const int avg_bin = n / num_bins;
+      const int num_blocks = std::max(1, std::min(ExecSpace().concurrency(), avg_bin));
+      const int block = n / num_blocks + (n % num_blocks != 0);
+      IntView counts("sort_block_counts", num_bins * num_blocks + 1);
+      Kokkos::parallel_for("sort_count", Policy(0, num_blocks), KOKKOS_LAMBDA(const int& k) {
+        const int end = (k + 1) * block < n ? (k + 1) * block : n;
+        for (int i = k * block; i < end; ++i)
+          ++counts(bins_in(i) * num_blocks + k);
+      });
+      IntView offsets("sort_block_offsets", num_bins * num_blocks + 1);
+      exclusive_scan(counts, offsets);
+      Kokkos::parallel_for("sort_place", Policy(0, num_blocks), KOKKOS_LAMBDA(const int& k) {
+        const int end = (k + 1) * block < n ? (k + 1) * block : n;
+        for (int i = k * block; i < end; ++i) {
+          const int j = offsets(bins_in(i) * num_blocks + k)++;
+          bins(j) = bins_in(i);
+          values(j) = values_in(i);
+        }
+      });
+    }
+  }
   /* Taken from https://stackoverflow.com/questions/31762958/check-if-class-is-a-template-specialization
      Checks if type is a specialization of a class template
    */
@@ -175,6 +333,34 @@ namespace pumipic {
     return lastVal;
   }
 
+  /* Value type of the result of a reduction, the result is either a scalar or a
+     Kokkos reducer (Kokkos::Sum, Kokkos::Max, ...)
+   */
+  template <typename ReturnType, bool = Kokkos::is_reducer<ReturnType>::value>
+  struct ReduceValueType {
+    typedef ReturnType type;
+  };
+  template <typename ReturnType>
+  struct ReduceValueType<ReturnType, true> {
+    typedef typename ReturnType::value_type type;
+  };
+
+  /* Returns the last segment s in [0, n) with offsets(s) <= index
+     offsets must be nondecreasing, so empty segments before the found one are skipped
+   */
+  template <typename ViewT>
+  PP_INLINE int findSegment(ViewT offsets, int n, int index) {
+    int low = 0, high = n;
+    while (high - low > 1) {
+      const int mid = (low + high) / 2;
+      if (offsets(mid) <= index)
+        low = mid;
+      else
+        high = mid;
+    }
+    return low;
+  }
+
   template <typename ViewT>
   PP_INLINE typename std::enable_if<ViewT::rank == 1>::type copyViewToView(ViewT dst, int dstind,
                                                                            ViewT src, int srcind){
@@ -22,69 +22,35 @@ void printGyroConfig() {
       gyro_rmax, gyro_num_rings, gyro_points_per_ring, gyro_theta);
 }
 
-o::LOs searchAndBuildMap(o::Mesh* mesh, o::Reals element_centroids,
-                               o::Reals projected_points, o::LOs starting_element) {
+o::LOs searchAndBuildMap(p::SearchContext& ctx, o::Reals projected_points,
+                         o::LOs starting_element) {
+  o::Mesh& mesh = ctx.mesh();
   o::LO num_points = starting_element.size();
 
-  //Create PS for the projected points to perform adjacency search on
-  PSpt::kkLidView ptcls_per_elem("ptcls_per_elem", mesh->nelems());
-  PSpt::kkLidView point_element("point_element", num_points);
-  auto point_info = particle_structs::createMemberViews<Point>(num_points);
-  auto start_pos = particle_structs::getMemberView<Point, 0>(point_info);
-  auto end_pos = particle_structs::getMemberView<Point, 1>(point_info);
-  auto point_id = particle_structs::getMemberView<Point, 2>(point_info);
-  auto countPointsInElement = OMEGA_H_LAMBDA(const o::LO& id) {
-    const o::LO elm = starting_element[id];
-    Kokkos::atomic_fetch_add(&(ptcls_per_elem(elm)), 1); //can just be 'add', no fetch needed
-    point_id(id) = id;
-    point_element(id) = elm;
-    for (int i = 0; i < 2; ++i) {
-      start_pos(id,i) = element_centroids[elm*2+i];
-      end_pos(id,i) = projected_points[id*2+i];
-    }
-  };
-  o::parallel_for(num_points, countPointsInElement, "countPointsInElement");
-
-  const int sigma = INT_MAX;
-  const int V = 64;
-  Kokkos::TeamPolicy<Kokkos::DefaultExecutionSpace> policy(10000, 32);
-  PSpt::kkGidView empty_gids("empty_gids", 0);
-  PSpt* gyro_ps = new ps::SellCSigma<Point>(policy, sigma, V,
-                                            mesh->nelems(), num_points,
-                                            ptcls_per_elem, empty_gids,
-                                            point_element, point_info);
-  printf("created ps for gyro mapping with %d points and %d elms\n",
-      num_points, mesh->nelems());
-
-  //Adjacency search
-  auto start = gyro_ps->get<0>();
-  auto end = gyro_ps->get<1>();
-  auto pids = gyro_ps->get<2>();
+  //Adjacency search of the projected points
   int maxLoops = 100;
-  int psCapacity = gyro_ps->capacity();
-  o::Write<o::LO> elem_ids(psCapacity, -1);
-  bool isFound = p::search_mesh_2d(*mesh, gyro_ps, start, end, pids,
-                                   elem_ids, maxLoops);
+  o::Write<o::LO> elem_ids;
+  o::Write<o::LO> exit_edges;
+  bool isFound = p::search_points_2d(ctx, projected_points, starting_element,
+                                     elem_ids, exit_edges, maxLoops);
   assert(isFound);
 
-  const auto numElms = mesh->nelems();
+  const auto numElms = mesh.nelems();
   //Gyro avg mapping: 3 vertices per ring point (Assumes all elements are triangles)
   const o::LO nvpe = 3;
   o::Write<o::LO> gyro_avg_map(nvpe * num_points, -1);
-  auto elm2Verts = mesh->ask_down(mesh->dim(), 0);
-  auto createGyroMapping = PS_LAMBDA(const int&, const int& pid, const int& mask) {
-    const o::LO parent = elem_ids[pid];
-    if (mask && parent >= 0) { //skip points outside the domain (parent == -1)
+  auto elm2Verts = mesh.ask_down(mesh.dim(), 0);
+  auto createGyroMapping = OMEGA_H_LAMBDA(const o::LO& id) {
+    const o::LO parent = elem_ids[id];
+    if (parent >= 0) { //skip points outside the domain (parent == -1)
       assert(parent>=0 && parent<numElms);
-      const o::LO id = pids(pid);
       const o::LO start_index = id* nvpe;
       const o::LO start_elm = parent*nvpe;
       for (int i = 0; i < 3; ++i)
         gyro_avg_map[start_index+i] = elm2Verts.ab2b[start_elm+i];
     }
   };
-  ps::parallel_for(gyro_ps, createGyroMapping);
-  delete gyro_ps;
+  o::parallel_for(num_points, createGyroMapping, "createGyroMapping");
   return o::LOs(gyro_avg_map);
 }
 
@@ -142,29 +108,18 @@ void createGyroRingMappings(o::Mesh* mesh, o::LOs& forward_map,
   };
   o::parallel_for(num_points, setInitialElement, "setInitialElement");
 
-  //Calculate centroids of each element
-  o::Write<o::Real> element_centroids(mesh->nelems()*2);
-  auto cells2nodes = mesh->get_adj(mesh->dim(), o::VERT).ab2b;
-  auto calculateCentroids = OMEGA_H_LAMBDA(const o::LO& elm) {
-    auto elmVerts = o::gather_verts<3>(cells2nodes, elm);
-    auto vtxCoords = o::gather_vectors<3,2>(coords, elmVerts);
-    auto center = average(vtxCoords);
-    element_centroids[elm*2] = center[0];
-    element_centroids[elm*2+1] = center[1];
-  };
-  o::parallel_for(mesh->nelems(), calculateCentroids, "calculateCentroids");
-
   //Create both mapping
-  forward_map = searchAndBuildMap(mesh, o::Reals(element_centroids),
-                                  o::Reals(forward_ring_points),
+  p::SearchContext ctx(*mesh);
+  forward_map = searchAndBuildMap(ctx, o::Reals(forward_ring_points),
                                   o::LOs(starting_element));
-  backward_map = searchAndBuildMap(mesh, o::Reals(element_centroids),
-                                   o::Reals(backward_ring_points),
+  backward_map = searchAndBuildMap(ctx, o::Reals(backward_ring_points),
                                    o::LOs(starting_element));
   Kokkos::Profiling::popRegion();
 }
 
-void gyroScatter(o::Mesh* mesh, PS* ptcls, o::LOs v2v, std::string scatterTagName) {
+/* deposit - built once per run with gyro_num_rings components */
+void gyroScatter(o::Mesh* mesh, PS* ptcls, p::Deposition& deposit, o::LOs v2v,
+                 std::string scatterTagName) {
   const auto btime = pumipic_prebarrier();
   Kokkos::Timer timer;
   Kokkos::Profiling::pushRegion("xgcm_gyroScatter");
@@ -174,33 +129,27 @@ void gyroScatter(o::Mesh* mesh, PS* ptcls, o::LOs v2v, std::string scatterTagNam
   const auto gr = gyro_rmax;
   const auto gnr = gyro_num_rings;
   const auto gppr = gyro_points_per_ring;
-  auto elm2verts = mesh->ask_down(mesh->dim(), 0);
-  auto nvpe = 3; //triangles
   const double ringWidth = gr/gnr;
-  o::Write<o::Real> ring_accum(gnr*mesh->nverts(),0, "ring_accumulator");
-  auto accumulateToRings = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
-    if(mask > 0) {
-      const auto ptclRadius = ringWidth*1.125; //TODO compute the radius
-      assert(ptclRadius >= ringWidth);
-      auto ringDown = 0;
-      for(int i=2; i<=gnr; i++)
-        ringDown += (ptclRadius >= ringWidth*i);
-      auto ringUp = ringDown+1;
-      assert(ringUp<gnr);
-      assert(ptclRadius >= ringWidth*(ringDown+1));
-      assert(ptclRadius < ringWidth*(ringUp+1));
-      const auto firstVtx = e*nvpe;
-      for(int i=0; i<nvpe; i++) {
-        const auto v = elm2verts.ab2b[firstVtx+i];
-        const auto vtxIdx = v*gnr;
-        const auto ringUpIdx = vtxIdx+ringUp;
-        const auto ringDownIdx = vtxIdx+ringDown;
-        Kokkos::atomic_fetch_add(&(ring_accum[ringUpIdx]), 1); //replace with add
-        Kokkos::atomic_fetch_add(&(ring_accum[ringDownIdx]), 1); //replace with add
-      }
+  //rings of each vertex are the deposition components
+  assert(deposit.numComponents() == gnr);
+  auto accumulateToRings = PS_LAMBDA(const int& e, const int& pid,
+                                       const p::ElementContribution& c) {
+    const auto ptclRadius = ringWidth*1.125; //TODO compute the radius
+    assert(ptclRadius >= ringWidth);
+    auto ringDown = 0;
+    for(int i=2; i<=gnr; i++)
+      ringDown += (ptclRadius >= ringWidth*i);
+    auto ringUp = ringDown+1;
+    assert(ringUp<gnr);
+    assert(ptclRadius >= ringWidth*(ringDown+1));
+    assert(ptclRadius < ringWidth*(ringUp+1));
+    for(int i=0; i<3; i++) {
+      c.add(i, ringUp, 1);
+      c.add(i, ringDown, 1);
     }
   };
-  ps::parallel_for(ptcls,accumulateToRings);
+  o::Reals ring_accum = deposit.toVertices(ptcls, accumulateToRings,
+                                           "xgcm_accumulateToRings");
   const Omega_h::LO nverts = mesh->nverts();
   o::Write<o::Real> scatter_w(mesh->nverts(),0,"scatterTag_w");
   auto scatterToMappedVerts = OMEGA_H_LAMBDA(const o::LO& v) {
@@ -211,7 +160,7 @@ void gyroScatter(o::Mesh* mesh, PS* ptcls, o::LOs v2v, std::string scatterTagNam
         const auto ringIdx = ring*gppr;
         for(int pt=0; pt<gppr; pt++) {
           const auto ptIdx = 3*(vtxIdx+ringIdx+pt);
-          for(int elmVtx=0; elmVtx<nvpe; elmVtx++) {
+          for(int elmVtx=0; elmVtx<3; elmVtx++) {
             const auto mappedIdx = ptIdx + elmVtx;
             const auto mappedVtx = v2v[mappedIdx];
             if (mappedVtx >= 0)
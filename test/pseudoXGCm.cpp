@@ -3,6 +3,7 @@
 #include "pumipic_adjacency.hpp"
 #include "pumipic_mesh.hpp"
 #include "pumipic_ptcl_ops.hpp"
+#include "pumipic_deposit.hpp"
 #include "pumipic_profiling.hpp"
 #include "pseudoXGCmTypes.hpp"
 #include "gyroScatter.hpp"
@@ -140,7 +141,8 @@ void rebuild(p::Mesh& picparts, PS* ptcls, p::Distributor<>& dist,
   }
 }
 
-void search(p::Mesh& picparts, PS* ptcls, p::Distributor<>& dist, bool output) {
+void search(p::Mesh& picparts, p::SearchContext& ctx, PS* ptcls, p::Distributor<>& dist,
+            bool output) {
   int comm_rank;
   MPI_Comm_rank(MPI_COMM_WORLD, &comm_rank);
   o::Mesh* mesh = picparts.mesh();
@@ -151,7 +153,7 @@ void search(p::Mesh& picparts, PS* ptcls, p::Distributor<>& dist, bool output) {
   auto x = ptcls->get<0>();
   auto xtgt = ptcls->get<1>();
   auto pid = ptcls->get<2>();
-  bool isFound = p::search_mesh_2d(*mesh, ptcls, x, xtgt, pid, elem_ids, maxLoops);
+  bool isFound = p::search_mesh_2d(ctx, ptcls, x, xtgt, pid, elem_ids, maxLoops);
   assert(isFound);
   //rebuild the PS to set the new element-to-particle lists
   rebuild(picparts, ptcls, dist, elem_ids, output);
@@ -388,14 +390,7 @@ int main(int argc, char** argv) {
   o::Mesh* mesh = picparts.mesh();
   mesh->ask_elem_verts(); //caching adjacency info
 
-  int nBuffers = picparts.numBuffers(picparts.dim());
-  int* buffered_ranks = new int[nBuffers];
-  auto buffers = picparts.bufferedRanks(picparts.dim());
-  buffered_ranks[0] = comm_rank;
-  for (int i = 0; i < nBuffers - 1; ++i)
-    buffered_ranks[i+1] = buffers[i];
-  p::Distributor<> dist(nBuffers, buffered_ranks);
-  delete [] buffered_ranks;
+  p::Distributor<> dist = p::neighborDistributor<PS>(picparts);
 
   //Build gyro avg mappings
   const auto rmax = 0.038;
@@ -497,6 +492,10 @@ int main(int argc, char** argv) {
       particle_structs::enable_prebarrier();
       pumipic_enable_prebarrier();
     }
+    //mesh arrays and search buffers reused by every search
+    p::SearchContext searchCtx(picparts);
+    //vertex adjacencies and element accumulators reused by every scatter
+    p::Deposition deposit(*mesh, gyro_num_rings);
     Kokkos::Timer timer;
     Kokkos::Timer fullTimer;
     int iter;
@@ -519,7 +518,7 @@ int main(int argc, char** argv) {
       ellipticalPush::push(ptcls, *mesh, degPerPush, iter);
       MPI_Barrier(MPI_COMM_WORLD);
       timer.reset();
-      search(picparts,ptcls, dist, output);
+      search(picparts, searchCtx, ptcls, dist, output);
       ps_np = ptcls->nPtcls();
       MPI_Allreduce(&ps_np, &totNp, 1, MPI_LONG, MPI_SUM, MPI_COMM_WORLD);
       if(totNp == 0) {
@@ -529,8 +528,8 @@ int main(int argc, char** argv) {
       tagParentElements(picparts,ptcls,iter);
       if(output && !(iter%100))
         render(picparts,iter, comm_rank);
-      gyroScatter(mesh,ptcls,forward_map,fwdTagName);
-      gyroScatter(mesh,ptcls,backward_map,bkwdTagName);
+      gyroScatter(mesh,ptcls,deposit,forward_map,fwdTagName);
+      gyroScatter(mesh,ptcls,deposit,backward_map,bkwdTagName);
       gyroSync(picparts,fwdTagName,bkwdTagName,syncTagName);
     }
     if (comm_rank == 0)
@@ -153,8 +153,9 @@ int main(int argc, char** argv) {
   mesh->add_tag(o::VERT, fwdTagName, 1, o::Reals(mesh->nverts(), 0));
   mesh->add_tag(o::VERT, bkwdTagName, 1, o::Reals(mesh->nverts(), 0));
 
-  gyroScatter(mesh,ptcls,fwd_map_centerOnly, fwdTagName);
-  gyroScatter(mesh,ptcls,bkwd_map_centerOnly, bkwdTagName);
+  p::Deposition deposit(*mesh, gyro_num_rings);
+  gyroScatter(mesh,ptcls,deposit,fwd_map_centerOnly, fwdTagName);
+  gyroScatter(mesh,ptcls,deposit,bkwd_map_centerOnly, bkwdTagName);
 
   auto fwdTagVals = mesh->get_array<o::Real>(o::VERT, fwdTagName);
   Omega_h::parallel_for(mesh->nverts(), OMEGA_H_LAMBDA(const int& i) {
@@ -0,0 +1,136 @@
+#include <vector>
+#include <algorithm>
+#include <Omega_h_file.hpp>
+#include <Omega_h_for.hpp>
+#include <particle_structs.hpp>
+#include <pumipic_library.hpp>
+#include <pumipic_deposit.hpp>
+
+namespace o = Omega_h;
+namespace p = pumipic;
+
+using particle_structs::SellCSigma;
+using particle_structs::MemberTypes;
+
+//The deposition weight of each particle
+typedef MemberTypes<double> Particle;
+typedef ps::ParticleStructure<Particle> PS;
+
+o::Mesh readMesh(const char* meshFile, o::Library& lib) {
+  std::string fn(meshFile);
+  auto ext = fn.substr(fn.find_last_of(".") + 1);
+  if( ext == "msh")
+    return Omega_h::gmsh::read(meshFile, lib.self());
+  return Omega_h::binary::read(meshFile, lib.self());
+}
+
+/* Deposit the particle weights and compare the vertex sums to the sums of
+   the weights of the particles in the elements adjacent to each vertex.
+   Particle pid in element e adds w*(v+1)*(c+1) to component c of its
+   local vertex v.
+*/
+int testDeposit(o::Mesh& mesh, PS* ptcls, p::Deposition::Mode mode, int ncomp,
+                const char* name) {
+  const int nvpe = mesh.dim() + 1;
+  auto weight = ptcls->get<0>();
+  auto contrib = PS_LAMBDA(const int& e, const int& pid,
+                           const p::ElementContribution& c) {
+    for (int v = 0; v < nvpe; ++v)
+      for (int comp = 0; comp < ncomp; ++comp)
+        c.add(v, comp, weight(pid) * (v + 1) * (comp + 1));
+  };
+  p::Deposition deposit(mesh, ncomp, mode);
+  o::Reals vtx_vals = deposit.toVertices(ptcls, contrib, name);
+  //deposit twice to check that the element slots are reset between calls
+  vtx_vals = deposit.toVertices(ptcls, contrib, name);
+
+  //Expected vertex sums from the element of each particle
+  const auto cap = ptcls->capacity();
+  o::Write<o::LO> elms(cap, -1, "ptcl_elms");
+  o::Write<o::Real> weights(cap, 0, "ptcl_weights");
+  auto record = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
+    if (mask > 0) {
+      elms[pid] = e;
+      weights[pid] = weight(pid);
+    }
+  };
+  ps::parallel_for(ptcls, record, "record_ptcls");
+  o::HostRead<o::LO> elms_h(elms);
+  o::HostRead<o::Real> weights_h(weights);
+  o::HostRead<o::LO> elem2verts_h(mesh.ask_elem_verts());
+  std::vector<o::Real> expected(mesh.nverts() * ncomp, 0);
+  for (int pid = 0; pid < cap; ++pid) {
+    const o::LO e = elms_h[pid];
+    if (e < 0)
+      continue;
+    for (int v = 0; v < nvpe; ++v)
+      for (int comp = 0; comp < ncomp; ++comp)
+        expected[elem2verts_h[e * nvpe + v] * ncomp + comp] +=
+          weights_h[pid] * (v + 1) * (comp + 1);
+  }
+  o::HostRead<o::Real> vtx_vals_h(vtx_vals);
+  if (vtx_vals_h.size() != (int)expected.size()) {
+    fprintf(stderr, "[ERROR] %s deposited %d values instead of %d\n", name,
+            vtx_vals_h.size(), (int)expected.size());
+    return 1;
+  }
+  int fails = 0;
+  for (int i = 0; i < vtx_vals_h.size(); ++i) {
+    if (fabs(vtx_vals_h[i] - expected[i]) > 1e-10 * std::max(1.0, fabs(expected[i]))) {
+      if (fails < 10)
+        fprintf(stderr, "[ERROR] %s vertex %d component %d deposited %f expected %f\n",
+                name, i / ncomp, i % ncomp, vtx_vals_h[i], expected[i]);
+      ++fails;
+    }
+  }
+  return fails;
+}
+
+int main(int argc, char** argv) {
+  p::Library pic_lib(&argc, &argv);
+  o::Library& lib = pic_lib.omega_h_lib();
+  if (argc != 2) {
+    fprintf(stderr, "Usage: %s <mesh>\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  o::Mesh mesh = readMesh(argv[1], lib);
+  const o::LO ne = mesh.nelems();
+
+  //Every fourth element is empty, the others have more particles than the
+  //team path splits them over
+  PS::kkLidView ptcls_per_elem("ptcls_per_elem", ne);
+  PS::kkGidView element_gids("element_gids", ne);
+  o::Write<o::LO> numPtcls(1, 0, "numPtcls");
+  auto setPtclsPerElem = OMEGA_H_LAMBDA(const o::LO& e) {
+    element_gids(e) = e;
+    ptcls_per_elem(e) = (e % 4) * 5;
+    Kokkos::atomic_add(&(numPtcls[0]), ptcls_per_elem(e));
+  };
+  o::parallel_for(ne, setPtclsPerElem, "setPtclsPerElem");
+  const int np = o::HostRead<o::LO>(o::LOs(numPtcls))[0];
+  const int sigma = INT_MAX;
+  const int V = 32;
+  Kokkos::TeamPolicy<Kokkos::DefaultExecutionSpace> policy(10000, 32);
+  PS* ptcls = new SellCSigma<Particle>(policy, sigma, V, ne, np,
+                                       ptcls_per_elem, element_gids);
+  auto weight = ptcls->get<0>();
+  auto setWeights = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
+    if (mask > 0)
+      weight(pid) = 1 + pid % 7;
+  };
+  ps::parallel_for(ptcls, setWeights, "setWeights");
+  printf("Depositing %d particles in %d elements\n", np, ne);
+
+  int fails = 0;
+  fails += testDeposit(mesh, ptcls, p::Deposition::DEPOSIT_ELEMENT_TEAMS, 1, "teams_1");
+  fails += testDeposit(mesh, ptcls, p::Deposition::DEPOSIT_ELEMENT_TEAMS, 3, "teams_3");
+  fails += testDeposit(mesh, ptcls, p::Deposition::DEPOSIT_ATOMIC, 1, "atomic_1");
+  fails += testDeposit(mesh, ptcls, p::Deposition::DEPOSIT_ATOMIC, 3, "atomic_3");
+  delete ptcls;
+  if (fails) {
+    fprintf(stderr, "[ERROR] %d deposited values do not match\n", fails);
+    return EXIT_FAILURE;
+  }
+  printf("All tests passed\n");
+  return 0;
+}
@@ -0,0 +1,141 @@
+#include <Omega_h_file.hpp>
+#include <Omega_h_for.hpp>
+#include <particle_structs.hpp>
+#include <pumipic_library.hpp>
+#include "pumipic_kktypes.hpp"
+#include "pumipic_interpolate.hpp"
+
+namespace o = Omega_h;
+namespace p = pumipic;
+
+using particle_structs::SellCSigma;
+using particle_structs::MemberTypes;
+using pumipic::Vector3d;
+
+//position, interpolated field
+typedef MemberTypes<Vector3d, Vector3d> Particle;
+typedef ps::ParticleStructure<Particle> PS;
+
+o::Mesh readMesh(const char* meshFile, o::Library& lib) {
+  std::string fn(meshFile);
+  auto ext = fn.substr(fn.find_last_of(".") + 1);
+  if( ext == "msh")
+    return Omega_h::gmsh::read(meshFile, lib.self());
+  return Omega_h::binary::read(meshFile, lib.self());
+}
+
+//Component c of a linear field, interpolated exactly by the vertex values
+OMEGA_H_INLINE o::Real linearField(const o::Real* x, const int dim, const int c) {
+  o::Real val = 1.5 - c;
+  for (int d = 0; d < dim; ++d)
+    val += (d + 1 + 2 * c) * x[d] - 0.25 * c * d;
+  return val;
+}
+
+/* Interpolate a linear field with ncomp components to the particles and
+   compare to the field evaluated at the particle positions
+*/
+int testGather(o::Mesh& mesh, PS* ptcls, const int ncomp) {
+  const int dim = mesh.dim();
+  const auto coords = mesh.coords();
+  o::Write<o::Real> vtx_field(mesh.nverts() * ncomp, "vtx_field");
+  auto setField = OMEGA_H_LAMBDA(const o::LO v) {
+    o::Real pos[3];
+    for (int d = 0; d < dim; ++d)
+      pos[d] = coords[v*dim + d];
+    for (int c = 0; c < ncomp; ++c)
+      vtx_field[v*ncomp + c] = linearField(pos, dim, c);
+  };
+  o::parallel_for(mesh.nverts(), setField, "setField");
+  p::FieldGather gather(mesh);
+  gather.setField(o::Reals(vtx_field), ncomp);
+  auto x = ptcls->get<0>();
+  auto out = ptcls->get<1>();
+  gather.toParticles(ptcls, x, out);
+
+  o::Write<o::LO> fails(1, 0, "fails");
+  auto check = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
+    if (mask > 0) {
+      o::Real pos[3];
+      for (int d = 0; d < dim; ++d)
+        pos[d] = x(pid, d);
+      for (int c = 0; c < ncomp; ++c) {
+        const o::Real expected = linearField(pos, dim, c);
+        if (fabs(out(pid, c) - expected) > 1e-10 * (1 + fabs(expected))) {
+          printf("[ERROR] ptcl %d elm %d component %d interpolated %.15e expected %.15e\n",
+                 pid, e, c, out(pid, c), expected);
+          Kokkos::atomic_add(&(fails[0]), 1);
+        }
+      }
+    }
+  };
+  ps::parallel_for(ptcls, check, "checkGather");
+  const int numFails = o::HostRead<o::LO>(o::LOs(fails))[0];
+  if (numFails)
+    fprintf(stderr, "[ERROR] %d interpolated values with %d components do not match\n",
+            numFails, ncomp);
+  return numFails;
+}
+
+int main(int argc, char** argv) {
+  p::Library pic_lib(&argc, &argv);
+  o::Library& lib = pic_lib.omega_h_lib();
+  if (argc != 2) {
+    fprintf(stderr, "Usage: %s <mesh>\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  o::Mesh mesh = readMesh(argv[1], lib);
+  const int dim = mesh.dim();
+  const int nvpe = dim + 1;
+  const o::LO ne = mesh.nelems();
+
+  //Up to three particles per element, some elements are empty
+  PS::kkLidView ptcls_per_elem("ptcls_per_elem", ne);
+  PS::kkGidView element_gids("element_gids", ne);
+  o::Write<o::LO> numPtcls(1, 0, "numPtcls");
+  auto setPtclsPerElem = OMEGA_H_LAMBDA(const o::LO& e) {
+    element_gids(e) = e;
+    ptcls_per_elem(e) = e % 4;
+    Kokkos::atomic_add(&(numPtcls[0]), ptcls_per_elem(e));
+  };
+  o::parallel_for(ne, setPtclsPerElem, "setPtclsPerElem");
+  const int np = o::HostRead<o::LO>(o::LOs(numPtcls))[0];
+  const int sigma = INT_MAX;
+  const int V = 1024;
+  Kokkos::TeamPolicy<Kokkos::DefaultExecutionSpace> policy(10000, 32);
+  PS* ptcls = new SellCSigma<Particle>(policy, sigma, V, ne, np,
+                                       ptcls_per_elem, element_gids);
+
+  //Particles at weighted averages of the element vertices
+  const auto coords = mesh.coords();
+  const auto elem2verts = mesh.ask_elem_verts();
+  auto x = ptcls->get<0>();
+  auto setPositions = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
+    if (mask > 0) {
+      o::Real w[4];
+      o::Real wsum = 0;
+      for (int v = 0; v < nvpe; ++v) {
+        w[v] = 1 + ((pid + 3 * v) % 5);
+        wsum += w[v];
+      }
+      for (int d = 0; d < 3; ++d) {
+        o::Real c = 0;
+        if (d < dim)
+          for (int v = 0; v < nvpe; ++v)
+            c += w[v] / wsum * coords[elem2verts[e*nvpe + v]*dim + d];
+        x(pid, d) = c;
+      }
+    }
+  };
+  ps::parallel_for(ptcls, setPositions, "setPositions");
+  printf("Interpolating to %d particles in %d elements of a %dd mesh\n", np, ne, dim);
+
+  int fails = 0;
+  fails += testGather(mesh, ptcls, 1);
+  fails += testGather(mesh, ptcls, 3);
+  delete ptcls;
+  if (fails)
+    return EXIT_FAILURE;
+  printf("All tests passed\n");
+  return 0;
+}
@@ -0,0 +1,226 @@
+#include <algorithm>
+#include <Omega_h_file.hpp>
+#include <Omega_h_for.hpp>
+#include <Omega_h_bbox.hpp>
+#include <particle_structs.hpp>
+#include <pumipic_library.hpp>
+#include "pumipic_kktypes.hpp"
+#include "pumipic_adjacency.hpp"
+
+namespace o = Omega_h;
+namespace p = pumipic;
+
+using particle_structs::SellCSigma;
+using particle_structs::MemberTypes;
+using pumipic::Vector3d;
+
+//current position, target position, particle id
+typedef MemberTypes<Vector3d, Vector3d, int> Particle;
+typedef ps::ParticleStructure<Particle> PS;
+
+//Number of walk steps before the spatial index resolves a particle
+const int FALLBACK_STEPS = 2;
+
+o::Mesh readMesh(const char* meshFile, o::Library& lib) {
+  std::string fn(meshFile);
+  auto ext = fn.substr(fn.find_last_of(".") + 1);
+  if( ext == "msh")
+    return Omega_h::gmsh::read(meshFile, lib.self());
+  return Omega_h::binary::read(meshFile, lib.self());
+}
+
+/* One particle at the centroid of each element moving along a fixed
+   direction by up to half of the mesh's largest extent, many elements
+   further than the fallback step budget. The origin, target and element of
+   the particle of element e are also stored at index e of orig, dest and
+   start_elems.
+*/
+PS* createParticles(o::Mesh& mesh, o::Write<o::Real> orig, o::Write<o::Real> dest,
+                    o::Write<o::LO> start_elems) {
+  const o::LO ne = mesh.nelems();
+  PS::kkLidView ptcls_per_elem("ptcls_per_elem", ne);
+  PS::kkGidView element_gids("element_gids", ne);
+  auto setPtclsPerElem = OMEGA_H_LAMBDA(const o::LO& e) {
+    element_gids(e) = e;
+    ptcls_per_elem(e) = 1;
+  };
+  o::parallel_for(ne, setPtclsPerElem, "setPtclsPerElem");
+  const int sigma = INT_MAX;
+  const int V = 1024;
+  Kokkos::TeamPolicy<Kokkos::DefaultExecutionSpace> policy(10000, 32);
+  PS* ptcls = new SellCSigma<Particle>(policy, sigma, V, ne, ne,
+                                       ptcls_per_elem, element_gids);
+  const auto bb = o::get_bounding_box<3>(&mesh);
+  o::Real maxLen = 0;
+  for (int i = 0; i < 3; ++i)
+    maxLen = std::max(maxLen, bb.max[i] - bb.min[i]);
+  const auto coords = mesh.coords();
+  const auto elem2verts = mesh.ask_elem_verts();
+  auto x = ptcls->get<0>();
+  auto xtgt = ptcls->get<1>();
+  auto pid_d = ptcls->get<2>();
+  const o::Real dir[3] = {-0.688247201611685, 0.229415733870562, 0.688247201611685};
+  auto setPositions = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
+    if (mask > 0) {
+      const o::Real len = maxLen * (0.1 + 0.4 * (pid % 8) / 8.0);
+      for (int i = 0; i < 3; ++i) {
+        o::Real c = 0;
+        for (int v = 0; v < 4; ++v)
+          c += coords[elem2verts[e*4 + v]*3 + i] / 4;
+        x(pid, i) = c;
+        xtgt(pid, i) = c + len * dir[i];
+        orig[e*3 + i] = x(pid, i);
+        dest[e*3 + i] = xtgt(pid, i);
+      }
+      start_elems[e] = e;
+      pid_d(pid) = pid;
+    }
+  };
+  ps::parallel_for(ptcls, setPositions, "setPositions");
+  return ptcls;
+}
+
+/* Compare the fallback search results to the full walk
+   Particles found in an element must have their target in that element
+   and particles that left the mesh must report the same face and
+   intersection point as the walk.
+*/
+int checkFallback(PS* ptcls, p::SearchContext& ctx, o::LOs ref_elems, o::Reals ref_xpoints,
+                  o::LOs ref_xfaces, o::Write<o::LO> elem_ids, o::Write<o::Real> xpoints,
+                  o::Write<o::LO> xfaces, const char* name) {
+  const auto elem_inv = ctx.geometry().elemInverses();
+  auto xtgt = ptcls->get<1>();
+  o::Write<o::LO> fails(1, 0, "fails");
+  auto check = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
+    if (mask > 0) {
+      const auto tgt = p::makeVector3(pid, xtgt);
+      const auto elm = elem_ids[pid];
+      bool match = (elm == ref_elems[e]);
+      if (match && elm >= 0)
+        match = p::isPointWithinElemTetCached(elem_inv, tgt, elm, 1e-10);
+      if (match && elm < 0) {
+        match = (xfaces[pid] == ref_xfaces[e]);
+        for (int i = 0; i < 3; ++i)
+          match = match && fabs(xpoints[pid*3 + i] - ref_xpoints[e*3 + i]) <= 1e-10;
+      }
+      if (!match) {
+        printf("[ERROR] ptcl %d elm %d face %d expected elm %d face %d\n", pid, elm,
+               xfaces[pid], ref_elems[e], ref_xfaces[e]);
+        Kokkos::atomic_add(&(fails[0]), 1);
+      }
+    }
+  };
+  ps::parallel_for(ptcls, check, "checkFallback");
+  const int numFails = o::HostRead<o::LO>(o::LOs(fails))[0];
+  if (numFails)
+    fprintf(stderr, "[ERROR] %s: %d particles not resolved correctly by the fallback\n",
+            name, numFails);
+  return numFails;
+}
+
+int main(int argc, char** argv) {
+  p::Library pic_lib(&argc, &argv);
+  o::Library& lib = pic_lib.omega_h_lib();
+  if (argc != 2) {
+    fprintf(stderr, "Usage: %s <3d mesh>\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  o::Mesh mesh = readMesh(argv[1], lib);
+  if (mesh.dim() != 3) {
+    fprintf(stderr, "[ERROR] the long-flight fallback test requires a tetrahedral mesh\n");
+    return EXIT_FAILURE;
+  }
+  const o::LO ne = mesh.nelems();
+  o::Write<o::Real> orig(ne * 3, "orig");
+  o::Write<o::Real> dest(ne * 3, "dest");
+  o::Write<o::LO> start_elems(ne, "start_elems");
+  PS* ptcls = createParticles(mesh, orig, dest, start_elems);
+  auto x = ptcls->get<0>();
+  auto xtgt = ptcls->get<1>();
+  auto pid_d = ptcls->get<2>();
+  const auto cap = ptcls->capacity();
+  p::SearchContext ctx(mesh);
+
+  //Reference walk without a step budget
+  o::Write<o::LO> ref_elems;
+  o::Write<o::Real> ref_xpoints;
+  o::Write<o::LO> ref_xfaces;
+  if (!p::search_points_3d(ctx, orig, dest, start_elems, ref_elems, ref_xpoints,
+                           ref_xfaces)) {
+    fprintf(stderr, "[ERROR] reference walk did not resolve every particle\n");
+    return EXIT_FAILURE;
+  }
+  //The flights must be longer than the fallback budget for the test to be useful
+  {
+    o::Write<o::LO> e;
+    o::Write<o::Real> xp;
+    o::Write<o::LO> xf;
+    if (p::search_points_3d(ctx, orig, dest, start_elems, e, xp, xf, FALLBACK_STEPS)) {
+      fprintf(stderr, "[ERROR] every flight is shorter than %d steps\n", FALLBACK_STEPS);
+      return EXIT_FAILURE;
+    }
+  }
+
+  ctx.setLongFlightFallback(FALLBACK_STEPS);
+  int fails = 0;
+  //Iterative search
+  {
+    o::Write<o::LO> elem_ids(cap, -1, "elem_ids");
+    o::Write<o::Real> xpoints(cap * 3, 0, "xpoints");
+    o::Write<o::LO> xfaces(cap, -1, "xfaces");
+    if (!p::search_mesh_3d<Particle>(ctx, ptcls, x, xtgt, pid_d, elem_ids, xpoints,
+                                     xfaces, 100)) {
+      fprintf(stderr, "[ERROR] search with the fallback did not locate every particle\n");
+      ++fails;
+    }
+    fails += checkFallback(ptcls, ctx, ref_elems, ref_xpoints, ref_xfaces, elem_ids,
+                           xpoints, xfaces, "search_mesh_3d");
+  }
+  //Fused search
+  {
+    ctx.setFusedWalk(true);
+    o::Write<o::LO> elem_ids(cap, -1, "elem_ids");
+    o::Write<o::Real> xpoints(cap * 3, 0, "xpoints");
+    o::Write<o::LO> xfaces(cap, -1, "xfaces");
+    if (!p::search_mesh_3d<Particle>(ctx, ptcls, x, xtgt, pid_d, elem_ids, xpoints,
+                                     xfaces, 100)) {
+      fprintf(stderr, "[ERROR] fused search with the fallback did not locate every "
+              "particle\n");
+      ++fails;
+    }
+    fails += checkFallback(ptcls, ctx, ref_elems, ref_xpoints, ref_xfaces, elem_ids,
+                           xpoints, xfaces, "search_mesh_3d_fused");
+  }
+  //Points
+  {
+    o::Write<o::LO> elem_ids;
+    o::Write<o::Real> xpoints;
+    o::Write<o::LO> xfaces;
+    if (!p::search_points_3d(ctx, orig, dest, start_elems, elem_ids, xpoints, xfaces)) {
+      fprintf(stderr, "[ERROR] point search with the fallback did not locate every "
+              "point\n");
+      ++fails;
+    }
+    o::LOs ref_e(ref_elems), ref_f(ref_xfaces), e_ids(elem_ids), f_ids(xfaces);
+    o::Reals ref_x(ref_xpoints), x_pts(xpoints);
+    o::Write<o::LO> pointFails(1, 0, "pointFails");
+    auto check = OMEGA_H_LAMBDA(o::LO i) {
+      bool match = e_ids[i] == ref_e[i] && f_ids[i] == ref_f[i];
+      for (int j = 0; j < 3; ++j)
+        match = match && fabs(x_pts[i*3 + j] - ref_x[i*3 + j]) <= 1e-10;
+      if (!match)
+        Kokkos::atomic_add(&(pointFails[0]), 1);
+    };
+    o::parallel_for(ne, check, "checkPoints");
+    const int numPointFails = o::HostRead<o::LO>(o::LOs(pointFails))[0];
+    if (numPointFails)
+      fprintf(stderr, "[ERROR] search_points_3d: %d points not resolved correctly by the "
+              "fallback\n", numPointFails);
+    fails += numPointFails;
+  }
+  delete ptcls;
+  if (fails)
+    return EXIT_FAILURE;
+  printf("All tests passed\n");
+  return 0;
+}
@@ -0,0 +1,273 @@
+#include <algorithm>
+#include <cmath>
+#include <Omega_h_file.hpp>
+#include <Omega_h_for.hpp>
+#include <Omega_h_bbox.hpp>
+#include <particle_structs.hpp>
+#include <pumipic_library.hpp>
+#include "pumipic_kktypes.hpp"
+#include "pumipic_push.hpp"
+
+namespace o = Omega_h;
+namespace p = pumipic;
+
+using particle_structs::SellCSigma;
+using particle_structs::MemberTypes;
+using pumipic::Vector3d;
+
+//position, next position, velocity, electric field, magnetic field
+typedef MemberTypes<Vector3d, Vector3d, Vector3d, Vector3d, Vector3d> Particle;
+typedef ps::ParticleStructure<Particle> PS;
+
+//The array based push uses a singly charged ion of 10 amu
+const o::Real CHARGE = 1.60217662e-19;
+const o::Real MASS = 10 * 1.6737236e-27;
+
+o::Mesh readMesh(const char* meshFile, o::Library& lib) {
+  std::string fn(meshFile);
+  auto ext = fn.substr(fn.find_last_of(".") + 1);
+  if( ext == "msh")
+    return Omega_h::gmsh::read(meshFile, lib.self());
+  return Omega_h::binary::read(meshFile, lib.self());
+}
+
+//Linear fields, interpolated exactly from the vertex values
+struct ElectricField {
+  OMEGA_H_INLINE o::Vector<3> operator()(const o::Vector<3>& x) const {
+    return o::vector_3(1e6 + 1e6*x[0] + 5e5*x[1],
+                       -5e5 + 1e6*x[1] - 5e5*x[2],
+                       2e5 + 2.5e5*x[0] + 1e6*x[2]);
+  }
+};
+struct MagneticField {
+  OMEGA_H_INLINE o::Vector<3> operator()(const o::Vector<3>& x) const {
+    return o::vector_3(0.2 + 0.5*x[0], -0.1 + 0.5*x[1], 1.0 + 0.5*x[2]);
+  }
+};
+
+template <typename FieldFn>
+o::Reals vertexField(o::Mesh& mesh, FieldFn field) {
+  const auto coords = mesh.coords();
+  o::Write<o::Real> vals(mesh.nverts() * 3, "vertex_field");
+  auto setVals = OMEGA_H_LAMBDA(const o::LO v) {
+    const auto f = field(o::get_vector<3>(coords, v));
+    for (int i = 0; i < 3; ++i)
+      vals[v*3 + i] = f[i];
+  };
+  o::parallel_for(mesh.nverts(), setVals, "setVertexField");
+  return o::Reals(vals);
+}
+
+bool isClose(o::Real a, o::Real b) {
+  return fabs(a - b) <= 1e-9 * std::max(1.0, std::max(fabs(a), fabs(b)));
+}
+
+/* Compare the velocity and next position of the particles to the reference
+   ref_next and ref_vel hold 3 components per particle. If elem_ids is given
+   it must hold the parent element of particles whose reference position is
+   in it and -1 for the others.
+*/
+int compare(PS* ptcls, o::Reals ref_next, o::Reals ref_vel, o::Reals elem_inv,
+            o::Write<o::LO> elem_ids, const char* name) {
+  const auto cap = ptcls->capacity();
+  auto xnext = ptcls->get<1>();
+  auto vel = ptcls->get<2>();
+  o::Write<o::Real> px(cap * 3, 0), pv(cap * 3, 0);
+  o::Write<o::LO> mask_d(cap, 0);
+  auto copyOut = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
+    mask_d[pid] = (mask > 0) ? 1 : 0;
+    if (mask > 0) {
+      for (int i = 0; i < 3; ++i) {
+        px[pid*3 + i] = xnext(pid, i);
+        pv[pid*3 + i] = vel(pid, i);
+      }
+    }
+  };
+  ps::parallel_for(ptcls, copyOut, "copyOut");
+  o::HostRead<o::LO> mask_h(mask_d);
+  o::HostRead<o::Real> px_h(px), pv_h(pv), rx_h(ref_next), rv_h(ref_vel);
+  int fails = 0;
+  for (int pid = 0; pid < cap; ++pid) {
+    if (!mask_h[pid])
+      continue;
+    bool match = true;
+    for (int i = 0; i < 3; ++i)
+      match = match && isClose(px_h[pid*3 + i], rx_h[pid*3 + i]) &&
+        isClose(pv_h[pid*3 + i], rv_h[pid*3 + i]);
+    if (!match) {
+      if (fails < 10)
+        fprintf(stderr, "[ERROR] %s ptcl %d next %e %e %e expected %e %e %e\n", name,
+                pid, px_h[pid*3], px_h[pid*3+1], px_h[pid*3+2], rx_h[pid*3],
+                rx_h[pid*3+1], rx_h[pid*3+2]);
+      ++fails;
+    }
+  }
+  if (elem_ids.exists()) {
+    o::Write<o::LO> elmFails(1, 0, "elmFails");
+    auto checkElems = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
+      if (mask > 0) {
+        const auto next = o::get_vector<3>(ref_next, pid);
+        const o::LO expected = p::isPointWithinElemTetCached(elem_inv, next, e) ? e : -1;
+        if (elem_ids[pid] != expected)
+          Kokkos::atomic_add(&(elmFails[0]), 1);
+      }
+    };
+    ps::parallel_for(ptcls, checkElems, "checkElems");
+    const int numElmFails = o::HostRead<o::LO>(o::LOs(elmFails))[0];
+    if (numElmFails)
+      fprintf(stderr, "[ERROR] %s %d parent elements do not match\n", name, numElmFails);
+    fails += numElmFails;
+  }
+  return fails;
+}
+
+int main(int argc, char** argv) {
+  p::Library pic_lib(&argc, &argv);
+  o::Library& lib = pic_lib.omega_h_lib();
+  if (argc != 2) {
+    fprintf(stderr, "Usage: %s <3d mesh>\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  o::Mesh mesh = readMesh(argv[1], lib);
+  if (mesh.dim() != 3) {
+    fprintf(stderr, "[ERROR] the fused Boris push requires a tetrahedral mesh\n");
+    return EXIT_FAILURE;
+  }
+  const o::LO ne = mesh.nelems();
+
+  //Two particles per element at points inside the element
+  PS::kkLidView ptcls_per_elem("ptcls_per_elem", ne);
+  PS::kkGidView element_gids("element_gids", ne);
+  auto setPtclsPerElem = OMEGA_H_LAMBDA(const o::LO& e) {
+    element_gids(e) = e;
+    ptcls_per_elem(e) = 2;
+  };
+  o::parallel_for(ne, setPtclsPerElem, "setPtclsPerElem");
+  const int sigma = INT_MAX;
+  const int V = 1024;
+  Kokkos::TeamPolicy<Kokkos::DefaultExecutionSpace> policy(10000, 32);
+  PS* ptcls = new SellCSigma<Particle>(policy, sigma, V, ne, 2 * ne,
+                                       ptcls_per_elem, element_gids);
+
+  //Particles move about one element per step, some stay in their element
+  const auto bb = o::get_bounding_box<3>(&mesh);
+  o::Real volume = 1;
+  for (int i = 0; i < 3; ++i)
+    volume *= bb.max[i] - bb.min[i];
+  const o::Real h = std::cbrt(6 * volume / ne);
+  const o::Real dt = 2e-8;
+  const o::Real speed = h / dt;
+  const auto coords = mesh.coords();
+  const auto elem2verts = mesh.ask_elem_verts();
+  auto x = ptcls->get<0>();
+  auto xnext = ptcls->get<1>();
+  auto vel = ptcls->get<2>();
+  auto efield = ptcls->get<3>();
+  auto bfield = ptcls->get<4>();
+  auto setPtcls = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
+    if (mask > 0) {
+      //weighted average of the vertices, the weights differ per particle
+      const o::Real w[4] = {0.1 + 0.05 * (pid % 3), 0.2, 0.3, 0.4 - 0.05 * (pid % 3)};
+      o::Vector<3> pos = o::zero_vector<3>();
+      for (int v = 0; v < 4; ++v)
+        pos = pos + w[v] * o::get_vector<3>(coords, elem2verts[e*4 + v]);
+      const o::Real s = speed * (0.05 + 0.6 * (pid % 5) / 5.0);
+      const o::Real theta = 0.7 * pid;
+      const auto v = o::vector_3(s * cos(theta), s * sin(theta), s * 0.3);
+      const auto ef = ElectricField()(pos);
+      const auto bf = MagneticField()(pos);
+      for (int i = 0; i < 3; ++i) {
+        x(pid, i) = pos[i];
+        xnext(pid, i) = 0;
+        vel(pid, i) = v[i];
+        efield(pid, i) = ef[i];
+        bfield(pid, i) = bf[i];
+      }
+    }
+  };
+  ps::parallel_for(ptcls, setPtcls, "setPtcls");
+
+  //Reference: the array based push with the previous position set to the
+  //current one
+  const auto cap = ptcls->capacity();
+  o::Write<o::Real> rx(cap, 0), ry(cap, 0), rz(cap, 0);
+  o::Write<o::Real> rxp(cap, 0), ryp(cap, 0), rzp(cap, 0);
+  o::Write<o::Real> rvx(cap, 0), rvy(cap, 0), rvz(cap, 0);
+  o::Write<o::Real> rex(cap, 0), rey(cap, 0), rez(cap, 0);
+  o::Write<o::Real> rbx(cap, 0), rby(cap, 0), rbz(cap, 0);
+  o::Write<o::LO> flags(cap, 0);
+  auto fillArrays = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
+    if (mask > 0) {
+      rx[pid] = rxp[pid] = x(pid, 0);
+      ry[pid] = ryp[pid] = x(pid, 1);
+      rz[pid] = rzp[pid] = x(pid, 2);
+      rvx[pid] = vel(pid, 0); rvy[pid] = vel(pid, 1); rvz[pid] = vel(pid, 2);
+      rex[pid] = efield(pid, 0); rey[pid] = efield(pid, 1); rez[pid] = efield(pid, 2);
+      rbx[pid] = bfield(pid, 0); rby[pid] = bfield(pid, 1); rbz[pid] = bfield(pid, 2);
+    }
+  };
+  ps::parallel_for(ptcls, fillArrays, "fillArrays");
+  p::pushBoris(cap, rx, ry, rz, rxp, ryp, rzp, rvx, rvy, rvz, rex, rey, rez,
+               rbx, rby, rbz, flags, dt);
+  o::Write<o::Real> ref_next(cap * 3, 0, "ref_next");
+  o::Write<o::Real> ref_vel(cap * 3, 0, "ref_vel");
+  auto packReference = OMEGA_H_LAMBDA(const o::LO i) {
+    ref_next[i*3] = rx[i]; ref_next[i*3 + 1] = ry[i]; ref_next[i*3 + 2] = rz[i];
+    ref_vel[i*3] = rvx[i]; ref_vel[i*3 + 1] = rvy[i]; ref_vel[i*3 + 2] = rvz[i];
+  };
+  o::parallel_for(cap, packReference, "packReference");
+  //Particles whose reference position left their element
+  const p::GeometryCache geom(mesh);
+  const auto elem_inv = geom.elemInverses();
+  o::Write<o::LO> refLeft(1, 0, "refLeft");
+  auto countLeft = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
+    if (mask > 0 &&
+        !p::isPointWithinElemTetCached(elem_inv, o::get_vector<3>(ref_next, pid), e))
+      Kokkos::atomic_add(&(refLeft[0]), 1);
+  };
+  ps::parallel_for(ptcls, countLeft, "countLeft");
+  const int numRefLeft = o::HostRead<o::LO>(o::LOs(refLeft))[0];
+  printf("%d of %d particles leave their element\n", numRefLeft, ptcls->nPtcls());
+  if (numRefLeft == 0 || numRefLeft == ptcls->nPtcls()) {
+    fprintf(stderr, "[ERROR] the test needs particles that stay and that leave\n");
+    return EXIT_FAILURE;
+  }
+
+  //Keep the initial velocities to run both pushes from the same state
+  o::Write<o::Real> v0(cap * 3, 0, "v0");
+  auto saveVel = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
+    if (mask > 0)
+      for (int i = 0; i < 3; ++i)
+        v0[pid*3 + i] = vel(pid, i);
+  };
+  ps::parallel_for(ptcls, saveVel, "saveVel");
+  auto resetVel = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
+    if (mask > 0)
+      for (int i = 0; i < 3; ++i)
+        vel(pid, i) = v0[pid*3 + i];
+  };
+
+  int fails = 0;
+  p::pushBoris(ptcls, x, xnext, vel, efield, bfield, CHARGE, MASS, dt);
+  fails += compare(ptcls, ref_next, ref_vel, elem_inv, o::Write<o::LO>(), "pushBoris");
+
+  ps::parallel_for(ptcls, resetVel, "resetVel");
+  p::FieldGather eGather(mesh, geom);
+  eGather.setField(vertexField(mesh, ElectricField()), 3);
+  p::FieldGather bGather(mesh, geom);
+  bGather.setField(vertexField(mesh, MagneticField()), 3);
+  o::Write<o::LO> elem_ids(cap, -2, "elem_ids");
+  const o::LO numLeft = p::pushBoris(ptcls, eGather, bGather, x, xnext, vel, CHARGE, MASS,
+                                     dt, elem_ids);
+  fails += compare(ptcls, ref_next, ref_vel, elem_inv, elem_ids, "fused pushBoris");
+  if (numLeft != numRefLeft) {
+    fprintf(stderr, "[ERROR] fused pushBoris reports %d particles leaving their element, "
+            "expected %d\n", numLeft, numRefLeft);
+    ++fails;
+  }
+  delete ptcls;
+  if (fails)
+    return EXIT_FAILURE;
+  printf("All tests passed\n");
+  return 0;
+}
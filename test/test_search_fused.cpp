@@ -0,0 +1,144 @@
+#include <algorithm>
+#include <Omega_h_file.hpp>
+#include <Omega_h_for.hpp>
+#include <Omega_h_bbox.hpp>
+#include <particle_structs.hpp>
+#include <pumipic_library.hpp>
+#include "pumipic_kktypes.hpp"
+#include "pumipic_adjacency.hpp"
+
+namespace o = Omega_h;
+namespace p = pumipic;
+
+using particle_structs::SellCSigma;
+using particle_structs::MemberTypes;
+using pumipic::Vector3d;
+
+//current position, target position, particle id
+typedef MemberTypes<Vector3d, Vector3d, int> Particle;
+typedef ps::ParticleStructure<Particle> PS;
+
+o::Mesh readMesh(const char* meshFile, o::Library& lib) {
+  std::string fn(meshFile);
+  auto ext = fn.substr(fn.find_last_of(".") + 1);
+  if( ext == "msh")
+    return Omega_h::gmsh::read(meshFile, lib.self());
+  return Omega_h::binary::read(meshFile, lib.self());
+}
+
+/* One particle at the centroid of each element moving along a fixed
+   direction by up to a third of the mesh's largest extent, so particles
+   end in the same element, in elements several layers away or leave the
+   mesh through an exposed face.
+*/
+PS* createParticles(o::Mesh& mesh) {
+  const o::LO ne = mesh.nelems();
+  PS::kkLidView ptcls_per_elem("ptcls_per_elem", ne);
+  PS::kkGidView element_gids("element_gids", ne);
+  auto setPtclsPerElem = OMEGA_H_LAMBDA(const o::LO& e) {
+    element_gids(e) = e;
+    ptcls_per_elem(e) = 1;
+  };
+  o::parallel_for(ne, setPtclsPerElem, "setPtclsPerElem");
+  const int sigma = INT_MAX;
+  const int V = 1024;
+  Kokkos::TeamPolicy<Kokkos::DefaultExecutionSpace> policy(10000, 32);
+  PS* ptcls = new SellCSigma<Particle>(policy, sigma, V, ne, ne,
+                                       ptcls_per_elem, element_gids);
+  const auto bb = o::get_bounding_box<3>(&mesh);
+  o::Real maxLen = 0;
+  for (int i = 0; i < 3; ++i)
+    maxLen = std::max(maxLen, bb.max[i] - bb.min[i]);
+  const auto coords = mesh.coords();
+  const auto elem2verts = mesh.ask_elem_verts();
+  auto x = ptcls->get<0>();
+  auto xtgt = ptcls->get<1>();
+  auto pid_d = ptcls->get<2>();
+  const o::Real dir[3] = {0.267261241912424, 0.534522483824849, 0.801783725737273};
+  auto setPositions = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
+    if (mask > 0) {
+      const o::Real len = maxLen * (0.01 + 0.33 * (pid % 10) / 10.0);
+      for (int i = 0; i < 3; ++i) {
+        o::Real c = 0;
+        for (int v = 0; v < 4; ++v)
+          c += coords[elem2verts[e*4 + v]*3 + i] / 4;
+        x(pid, i) = c;
+        xtgt(pid, i) = c + len * dir[i];
+      }
+      pid_d(pid) = pid;
+    }
+  };
+  ps::parallel_for(ptcls, setPositions, "setPositions");
+  return ptcls;
+}
+
+int main(int argc, char** argv) {
+  p::Library pic_lib(&argc, &argv);
+  o::Library& lib = pic_lib.omega_h_lib();
+  if (argc != 2) {
+    fprintf(stderr, "Usage: %s <3d mesh>\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  o::Mesh mesh = readMesh(argv[1], lib);
+  if (mesh.dim() != 3) {
+    fprintf(stderr, "[ERROR] the fused search requires a tetrahedral mesh\n");
+    return EXIT_FAILURE;
+  }
+  PS* ptcls = createParticles(mesh);
+  auto x = ptcls->get<0>();
+  auto xtgt = ptcls->get<1>();
+  auto pid_d = ptcls->get<2>();
+  const auto cap = ptcls->capacity();
+  const int maxLoops = 1000;
+  p::SearchContext ctx(mesh);
+
+  o::Write<o::LO> elem_ids(cap, -1, "elem_ids");
+  o::Write<o::Real> xpoints(cap * 3, 0, "xpoints");
+  o::Write<o::LO> xfaces(cap, -1, "xfaces");
+  bool found = p::search_mesh_3d<Particle>(ctx, ptcls, x, xtgt, pid_d, elem_ids,
+                                           xpoints, xfaces, maxLoops);
+
+  ctx.setFusedWalk(true);
+  o::Write<o::LO> elem_ids_f(cap, -1, "elem_ids_fused");
+  o::Write<o::Real> xpoints_f(cap * 3, 0, "xpoints_fused");
+  o::Write<o::LO> xfaces_f(cap, -1, "xfaces_fused");
+  bool found_f = p::search_mesh_3d<Particle>(ctx, ptcls, x, xtgt, pid_d, elem_ids_f,
+                                             xpoints_f, xfaces_f, maxLoops);
+  if (!found || !found_f) {
+    fprintf(stderr, "[ERROR] search did not locate every particle (unfused %d fused %d)\n",
+            found, found_f);
+    return EXIT_FAILURE;
+  }
+
+  //The intersection outputs are only defined for particles that left the mesh
+  o::Write<o::LO> fails(1, 0, "fails");
+  o::Write<o::LO> numLeft(1, 0, "numLeft");
+  auto compare = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
+    if (mask > 0) {
+      bool match = elem_ids[pid] == elem_ids_f[pid];
+      if (match && elem_ids[pid] < 0) {
+        Kokkos::atomic_add(&(numLeft[0]), 1);
+        match = xfaces[pid] == xfaces_f[pid];
+        for (int i = 0; i < 3; ++i)
+          match = match && fabs(xpoints[pid*3 + i] - xpoints_f[pid*3 + i]) <= 1e-12;
+      }
+      if (!match) {
+        printf("[ERROR] ptcl %d unfused elm %d face %d fused elm %d face %d\n", pid,
+               elem_ids[pid], xfaces[pid], elem_ids_f[pid], xfaces_f[pid]);
+        Kokkos::atomic_add(&(fails[0]), 1);
+      }
+    }
+  };
+  ps::parallel_for(ptcls, compare, "compare");
+  const int numFails = o::HostRead<o::LO>(o::LOs(fails))[0];
+  printf("%d of %d particles left the mesh\n",
+         o::HostRead<o::LO>(o::LOs(numLeft))[0], ptcls->nPtcls());
+  delete ptcls;
+  if (numFails) {
+    fprintf(stderr, "[ERROR] %d particles differ between the fused and unfused search\n",
+            numFails);
+    return EXIT_FAILURE;
+  }
+  printf("All tests passed\n");
+  return 0;
+}
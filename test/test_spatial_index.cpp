@@ -0,0 +1,67 @@
+#include <Omega_h_file.hpp>
+#include <Omega_h_for.hpp>
+#include <pumipic_library.hpp>
+#include <pumipic_spatial_index.hpp>
+
+namespace o = Omega_h;
+namespace p = pumipic;
+
+o::Mesh readMesh(const char* meshFile, o::Library& lib) {
+  std::string fn(meshFile);
+  auto ext = fn.substr(fn.find_last_of(".") + 1);
+  if( ext == "msh")
+    return Omega_h::gmsh::read(meshFile, lib.self());
+  return Omega_h::binary::read(meshFile, lib.self());
+}
+
+int main(int argc, char** argv) {
+  p::Library pic_lib(&argc, &argv);
+  o::Library& lib = pic_lib.omega_h_lib();
+  if (argc != 2) {
+    fprintf(stderr, "Usage: %s <mesh>\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  o::Mesh mesh = readMesh(argv[1], lib);
+  const int dim = mesh.dim();
+  const o::LO nelems = mesh.nelems();
+  p::SpatialIndex index(mesh);
+  printf("Spatial index built with %d cells for %d elements\n", index.numCells(), nelems);
+
+  //Element centroids are strictly inside their element
+  const auto coords = mesh.coords();
+  const auto elem2verts = mesh.ask_elem_verts();
+  const int nverts = dim + 1;
+  o::Write<o::Real> centroids(nelems * dim, 0, "centroids");
+  auto computeCentroids = OMEGA_H_LAMBDA(o::LO e) {
+    for (int v = 0; v < nverts; ++v)
+      for (int d = 0; d < dim; ++d)
+        centroids[e*dim + d] += coords[elem2verts[e*nverts + v]*dim + d] / nverts;
+  };
+  o::parallel_for(nelems, computeCentroids, "computeCentroids");
+  const auto located = index.locate(o::Reals(centroids));
+
+  o::Write<o::LO> fails(1, 0, "fails");
+  auto checkLocated = OMEGA_H_LAMBDA(o::LO e) {
+    if (located[e] != e) {
+      printf("[ERROR] centroid of element %d located in element %d\n", e, located[e]);
+      Kokkos::atomic_add(&(fails[0]), 1);
+    }
+  };
+  o::parallel_for(nelems, checkLocated, "checkLocated");
+
+  //A point outside the bounding box of the mesh is not found
+  o::Write<o::Real> outside(dim, 1e10, "outside");
+  const auto notLocated = index.locate(o::Reals(outside));
+  o::HostRead<o::LO> notLocated_h(notLocated);
+  if (notLocated_h[0] != -1) {
+    fprintf(stderr, "[ERROR] point outside the mesh located in element %d\n", notLocated_h[0]);
+    return EXIT_FAILURE;
+  }
+  const int numFails = o::HostRead<o::LO>(o::LOs(fails))[0];
+  if (numFails) {
+    fprintf(stderr, "[ERROR] %d centroids were not located in their element\n", numFails);
+    return EXIT_FAILURE;
+  }
+  printf("All tests passed\n");
+  return 0;
+}
@@ -4,6 +4,34 @@ mpi_test(barycentric_3 1 ./barycentric test1)
 mpi_test(search2d 1 ./search2d
   ${TEST_DATA_DIR})
 
+mpi_test(spatial_index_cube 1 ./spatial_index
+  ${TEST_DATA_DIR}/cube.msh)
+mpi_test(spatial_index_xgc_24k 1 ./spatial_index
+  ${TEST_DATA_DIR}/xgc/24k.osh)
+
+mpi_test(deposit_cube 1 ./deposit
+  ${TEST_DATA_DIR}/cube.msh)
+mpi_test(deposit_tri8 1 ./deposit
+  ${TEST_DATA_DIR}/plate/tri8_parDiag.osh)
+
+mpi_test(search_fused_cube 1 ./search_fused
+  ${TEST_DATA_DIR}/cube/7k.osh)
+mpi_test(search_fused_pisces 1 ./search_fused
+  ${TEST_DATA_DIR}/pisces/gitr.msh)
+
+mpi_test(long_flight_cube 1 ./long_flight
+  ${TEST_DATA_DIR}/cube/7k.osh)
+mpi_test(long_flight_pisces 1 ./long_flight
+  ${TEST_DATA_DIR}/pisces/gitr.msh)
+
+mpi_test(push_cube 1 ./push
+  ${TEST_DATA_DIR}/cube/7k.osh)
+
+mpi_test(field_gather_cube 1 ./field_gather
+  ${TEST_DATA_DIR}/cube/7k.osh)
+mpi_test(field_gather_tri8 1 ./field_gather
+  ${TEST_DATA_DIR}/plate/tri8_parDiag.osh)
+
 #mesh/partition tests
 
 mpi_test(print_partition_cube_2 2